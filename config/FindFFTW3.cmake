@@ -4,6 +4,8 @@
 #  FFTW3_INCLUDE_DIR, where to find FFTW3lib.h, etc.
 #  FFTW3_LIBRARIES, the libraries needed to use FFTW3.
 #  JFFTW3_FOUND, If false, do not try to use FFTW3.
+#  FFTW3_THREADS_LIBRARY, the multi-threaded FFTW3 library (fftw3_threads or fftw3_omp),
+#                         if available (define VIGRA_FFTW_THREADS when linking against it).
 # also defined, but not for general use are
 #  FFTW3_LIBRARY, where to find the FFTW3 library.
 
@@ -19,6 +21,8 @@ FIND_PACKAGE_HANDLE_STANDARD_ARGS(FFTW3 DEFAULT_MSG FFTW3_LIBRARY FFTW3_INCLUDE_
 
 IF(FFTW3_FOUND)
   SET(FFTW3_LIBRARIES ${FFTW3_LIBRARY})
+  GET_FILENAME_COMPONENT(FFTW3_LIBRARY_DIR ${FFTW3_LIBRARY} PATH)
+  FIND_LIBRARY(FFTW3_THREADS_LIBRARY NAMES fftw3_threads fftw3_omp HINTS ${FFTW3_LIBRARY_DIR})
 ENDIF(FFTW3_FOUND)
 
 # Deprecated declarations.
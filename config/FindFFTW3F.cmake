@@ -4,6 +4,8 @@
 #  FFTW3F_INCLUDE_DIR, where to find fftw3.h, etc.
 #  FFTW3F_LIBRARIES, the libraries needed to use single-precision FFTW3.
 #  JFFTW3_FOUND, If false, do not try to use FFTW3.
+#  FFTW3F_THREADS_LIBRARY, the multi-threaded single-precision FFTW3 library 
+#                          (fftw3f_threads or fftw3f_omp), if available.
 # also defined, but not for general use are
 #  FFTW3F_LIBRARY, where to find the single-precision FFTW3 library.
 
@@ -19,6 +21,8 @@ FIND_PACKAGE_HANDLE_STANDARD_ARGS(FFTW3F DEFAULT_MSG FFTW3F_LIBRARY FFTW3F_INCLU
 
 IF(FFTW3F_FOUND)
   SET(FFTW3F_LIBRARIES ${FFTW3F_LIBRARY})
+  GET_FILENAME_COMPONENT(FFTW3F_LIBRARY_DIR ${FFTW3F_LIBRARY} PATH)
+  FIND_LIBRARY(FFTW3F_THREADS_LIBRARY NAMES fftw3f_threads fftw3f_omp HINTS ${FFTW3F_LIBRARY_DIR})
 ENDIF(FFTW3F_FOUND)
 
 # Deprecated declarations.
@@ -71,6 +71,7 @@ template <int BinCount> class IntegerHistogram;      // use data values directly
 template <int BinCount> class UserRangeHistogram;    // set min/max explicitly at runtime
 template <int BinCount> class AutoRangeHistogram;    // get min/max from accumulators
 template <int BinCount> class GlobalRangeHistogram;  // like AutoRangeHistogram, but use global min/max rather than region min/max
+template <int BinCount> class AdaptiveRangeHistogram; // adapt the range to the data in a single pass
 
 class FirstSeen;                               // remember the first value seen
 class Minimum;                                 // minimum
@@ -5,31 +5,95 @@
 #include <vigra/multi_convolution.hxx>
 #include <vigra/blockify.hxx>
 #include <vigra/multi_array.hxx>
+#include <vigra/threadpool.hxx>
 
 namespace vigra
 {
 
+/** \brief Options for the streaming variant of \ref separableConvolveBlockwise().
+
+    In addition to the number of threads (see \ref ParallelOptions), a memory 
+    budget limits the memory the convolution of a \ref ChunkedArray may occupy.
+
+    <b>\#include</b> \<vigra/blockwise_convolution.hxx\><br/>
+    Namespace: vigra
+*/
+class BlockwiseConvolutionOptions
+: public ParallelOptions
+{
+  public:
+        /** Create options with <tt>numThreads(Auto)</tt> and unlimited memory.
+        */
+    BlockwiseConvolutionOptions()
+    : memory_budget_(0)
+    {}
+
+        /** Upper bound (in bytes) for the memory occupied by the source and
+            destination chunk caches and the per-thread block buffers
+            during the convolution. 0 means unlimited.
+            
+            Default: 0
+        */
+    BlockwiseConvolutionOptions & memoryBudget(std::size_t bytes)
+    {
+        memory_budget_ = bytes;
+        return *this;
+    }
+
+    std::size_t getMemoryBudget() const
+    {
+        return memory_budget_;
+    }
+
+        /** Set the number of threads, see \ref ParallelOptions::numThreads().
+        */
+    BlockwiseConvolutionOptions & numThreads(const int n)
+    {
+        ParallelOptions::numThreads(n);
+        return *this;
+    }
+
+  private:
+    std::size_t memory_budget_;
+};
+
 namespace blockwise_convolution_detail
 {
 
+template <class DataArray, class OutputBlocksIterator, class KernelIterator, class Shape>
+void convolveBlock(const Overlaps<DataArray>& overlaps, OutputBlocksIterator output_blocks_begin, KernelIterator kit,
+                   Shape const & coordinates)
+{
+    // keep the iterator alive while writing, so that a chunked
+    // destination cannot release the chunk in the meantime
+    OutputBlocksIterator output_block = output_blocks_begin;
+    output_block += coordinates;
+    OverlappingBlock<DataArray> data_block = overlaps[coordinates];
+    separableConvolveMultiArray(data_block.block, *output_block, kit,
+                                data_block.inner_bounds.first, data_block.inner_bounds.second);
+}
+
 template <class DataArray, class OutputBlocksIterator, class KernelIterator>
-void convolveImpl(const Overlaps<DataArray>& overlaps, OutputBlocksIterator output_blocks_begin, KernelIterator kit)
+void convolveImpl(const Overlaps<DataArray>& overlaps, OutputBlocksIterator output_blocks_begin, KernelIterator kit,
+                  ParallelOptions const & options)
 {
     static const unsigned int N = DataArray::actual_dimension;
     typedef typename MultiArrayShape<N>::type Shape;
-    typedef typename OutputBlocksIterator::value_type OutputBlock;
 
     Shape shape = overlaps.shape();
     vigra_assert(shape == output_blocks_begin.shape(), "");
 
-    MultiCoordinateIterator<N> it(shape);
-    MultiCoordinateIterator<N> end = it.getEndIterator();
-    for( ; it != end; ++it)
-    {
-        OutputBlock output_block = output_blocks_begin[*it];
-        OverlappingBlock<DataArray> data_block = overlaps[*it];
-        separableConvolveMultiArray(data_block.block, output_block, kit, data_block.inner_bounds.first, data_block.inner_bounds.second);
-    }
+    // blocks are independent, so the result doesn't depend on the number of threads
+    ThreadPool pool(ParallelOptions().numThreads(std::min<MultiArrayIndex>(options.getNumThreads(), prod(shape))));
+
+    MultiCoordinateIterator<N> begin(shape);
+    MultiCoordinateIterator<N> end = begin.getEndIterator();
+    parallel_foreach(pool, begin, end,
+        [&overlaps, &output_blocks_begin, &kit](int, Shape const & coordinates)
+        {
+            convolveBlock(overlaps, output_blocks_begin, kit, coordinates);
+        },
+        prod(shape));
 }
 
 template <class Shape, class KernelIterator>
@@ -47,6 +111,146 @@ std::pair<Shape, Shape> kernelOverlap(KernelIterator kit)
     return std::make_pair(before, after);
 }
 
+    // Number of chunks touched by an interval of the given length, 
+    // for the worst-case alignment of the interval.
+inline MultiArrayIndex chunksSpanned(MultiArrayIndex length, MultiArrayIndex chunk_length)
+{
+    return length <= 0
+               ? 0
+               : (length + chunk_length - 2) / chunk_length + 1;
+}
+
+    // Memory layout of a streaming convolution: how many blocks are processed 
+    // concurrently, how many neighbouring blocks form a tile whose source chunks 
+    // are kept in the cache, and how the byte budget is split between the caches.
+template <unsigned int N>
+struct StreamingPlan
+{
+    typedef typename MultiArrayShape<N>::type Shape;
+
+    Shape tile_shape;                 // in blocks
+    int num_threads;
+    std::size_t source_cache_bytes;   // 0: leave the source cache alone
+    std::size_t dest_cache_chunks;    // 0: leave the destination cache alone
+    std::size_t peak_bytes;           // predicted peak memory (0: unlimited budget)
+};
+
+    // Bytes held by the source cache while a tile of 'tile' blocks is processed.
+template <class Shape>
+std::size_t tileSourceBytes(Shape const & tile, Shape const & shape, Shape const & block_shape,
+                            Shape const & source_chunk_shape, Shape const & halo, 
+                            std::size_t source_chunk_bytes)
+{
+    std::size_t chunks = 1;
+    for(unsigned int k=0; k<Shape::static_size; ++k)
+    {
+        MultiArrayIndex length = std::min(tile[k]*block_shape[k] + halo[k], shape[k]);
+        chunks *= std::min(chunksSpanned(length, source_chunk_shape[k]), 
+                           (shape[k] + source_chunk_shape[k] - 1) / source_chunk_shape[k]);
+    }
+    return chunks * source_chunk_bytes;
+}
+
+template <class Shape>
+StreamingPlan<Shape::static_size>
+planStreaming(Shape const & shape, Shape const & block_shape, Shape const & source_chunk_shape,
+              Shape const & overlap_before, Shape const & overlap_after,
+              std::size_t source_value_bytes, std::size_t tmp_value_bytes, std::size_t dest_chunk_bytes,
+              int num_threads, std::size_t budget)
+{
+    static const unsigned int N = Shape::static_size;
+    using namespace overlapped_blocks_detail;
+
+    Shape grid = blocksShape(shape, block_shape),
+          halo = overlap_before + overlap_after,
+          halo_block = min(block_shape + halo, shape);
+
+    StreamingPlan<N> plan;
+    plan.num_threads = std::max(1, std::min<int>(num_threads, prod(grid)));
+    if(budget == 0)
+    {
+        plan.tile_shape = grid;
+        plan.source_cache_bytes = 0;
+        plan.dest_cache_chunks = 0;
+        plan.peak_bytes = 0;
+        return plan;
+    }
+
+    // each thread holds one block with halo and the convolution temporaries,
+    // pins one destination chunk, and owns one slot in the destination cache 
+    // (finished destination chunks are written back soon after)
+    std::size_t per_thread = prod(halo_block) * (source_value_bytes + tmp_value_bytes) + 2*dest_chunk_bytes,
+                source_chunk_bytes = prod(source_chunk_shape) * source_value_bytes,
+                min_source = tileSourceBytes(Shape(1), shape, block_shape, source_chunk_shape, 
+                                             halo, source_chunk_bytes);
+    for(; plan.num_threads > 1; --plan.num_threads)
+        if(plan.num_threads * per_thread + min_source <= budget)
+            break;
+    vigra_precondition(plan.num_threads * per_thread + min_source <= budget,
+        "separableConvolveBlockwise(): memory budget too small for a single block.");
+
+    std::size_t source_budget = budget - plan.num_threads * per_thread;
+    
+    // grow the tile along the currently shortest axis (in pixels) while its
+    // source chunks fit into the cache, so that tiles are roughly cubic and 
+    // the halo overhead per tile is small
+    plan.tile_shape = Shape(1);
+    for(;;)
+    {
+        int best = -1;
+        for(unsigned int k=0; k<N; ++k)
+        {
+            if(plan.tile_shape[k] >= grid[k])
+                continue;
+            Shape candidate = plan.tile_shape;
+            ++candidate[k];
+            if(tileSourceBytes(candidate, shape, block_shape, source_chunk_shape, 
+                               halo, source_chunk_bytes) > source_budget)
+                continue;
+            if(best < 0 || plan.tile_shape[k]*block_shape[k] < plan.tile_shape[best]*block_shape[best])
+                best = k;
+        }
+        if(best < 0)
+            break;
+        ++plan.tile_shape[best];
+    }
+    
+    plan.source_cache_bytes = source_budget;
+    plan.dest_cache_chunks = plan.num_threads;
+    plan.peak_bytes = plan.num_threads * per_thread + 
+                      tileSourceBytes(plan.tile_shape, shape, block_shape, source_chunk_shape, 
+                                      halo, source_chunk_bytes);
+    return plan;
+}
+
+    // Restores the cache limits of a ChunkedArray on destruction.
+template <unsigned int N, class T>
+class ChunkCacheLimits
+{
+  public:
+    ChunkCacheLimits(ChunkedArray<N, T> & array)
+    : array_(array),
+      max_size_(array.cacheMaxSize()),
+      max_bytes_(array.cacheMaxBytes())
+    {}
+
+    void set(std::size_t max_size, std::size_t max_bytes)
+    {
+        array_.setCacheMaxBytes(max_bytes);
+        array_.setCacheMaxSize(max_size);
+    }
+
+    ~ChunkCacheLimits()
+    {
+        array_.setCacheMaxSize(max_size_);
+        array_.setCacheMaxBytes(max_bytes_);
+    }
+
+  private:
+    ChunkedArray<N, T> & array_;
+    std::size_t max_size_, max_bytes_;
+};
+
 }
 
 
@@ -55,7 +259,8 @@ template <unsigned int N, class T1, class S1,
           class KernelIterator>
 void separableConvolveBlockwise(MultiArrayView<N, T1, S1> source, MultiArrayView<N, T2, S2> dest, KernelIterator kit,
                                 const typename MultiArrayView<N, T1, S1>::difference_type& block_shape =
-                                     typename MultiArrayView<N, T1, S1>::difference_type(128))
+                                     typename MultiArrayView<N, T1, S1>::difference_type(128),
+                                ParallelOptions const & options = ParallelOptions())
 {
     using namespace blockwise_convolution_detail;
 
@@ -69,17 +274,18 @@ void separableConvolveBlockwise(MultiArrayView<N, T1, S1> source, MultiArrayView
 
     MultiArray<N, MultiArrayView<N, T2, S2> > destination_blocks = blockify(dest, block_shape);
     
-    convolveImpl(overlaps, destination_blocks.begin(), kit);
+    convolveImpl(overlaps, destination_blocks.begin(), kit, options);
 }
 template <unsigned int N, class T1, class S1,
                           class T2, class S2,
           class T3>
 void separableConvolveBlockwise(MultiArrayView<N, T1, S1> source, MultiArrayView<N, T2, S2> dest, const Kernel1D<T3>& kernel,
                                 const typename MultiArrayView<N, T1, S1>::difference_type& block_shape =
-                                     typename MultiArrayView<N, T1, S1>::difference_type(128))
+                                     typename MultiArrayView<N, T1, S1>::difference_type(128),
+                                ParallelOptions const & options = ParallelOptions())
 {
     std::vector<Kernel1D<T3> > kernels(N, kernel);
-    separableConvolveBlockwise(source, dest, kernels.begin(), block_shape);
+    separableConvolveBlockwise(source, dest, kernels.begin(), block_shape, options);
 }
 
 
@@ -97,20 +303,70 @@ void separableConvolveBlockwise(MultiArrayView<N, T1, S1> source, MultiArrayView
     namespace vigra {
         // apply each kernel from the sequence 'kernels' in turn
         template <unsigned int N, class T1, class T2, class KernelIterator>
-        void separableConvolveBlockwise(const ChunkedArra<N, T1>& source, ChunkedArray<N, T2>& destination, KernelIterator kernels);
+        void separableConvolveBlockwise(const ChunkedArra<N, T1>& source, ChunkedArray<N, T2>& destination, KernelIterator kernels,
+                                        ParallelOptions const & options = ParallelOptions());
         // apply the same kernel to all dimensions
         template <unsigned int N, class T1, class T2, class T3>
-        void separableConvolveBlockwise(const ChunkedArra<N, T1>& source, ChunkedArray<N, T2>& destination, Kernel1D<T3> const & kernel);
+        void separableConvolveBlockwise(const ChunkedArra<N, T1>& source, ChunkedArray<N, T2>& destination, Kernel1D<T3> const & kernel,
+                                        ParallelOptions const & options = ParallelOptions());
+
+        // stream through the source with bounded memory
+        template <unsigned int N, class T1, class T2, class KernelIterator>
+        void separableConvolveBlockwise(const ChunkedArra<N, T1>& source, ChunkedArray<N, T2>& destination, KernelIterator kernels,
+                                        BlockwiseConvolutionOptions const & options);
+        template <unsigned int N, class T1, class T2, class T3>
+        void separableConvolveBlockwise(const ChunkedArra<N, T1>& source, ChunkedArray<N, T2>& destination, Kernel1D<T3> const & kernel,
+                                        BlockwiseConvolutionOptions const & options);
     }
     \endcode
 
     This function computes a separated convolution for a given \ref ChunkedArray. For infinite precision T1, this is equivalent to
     \ref separableConvolveMultiArray. In practice, floating point inaccuracies will make the result differ slightly.
+
+    The blocks (one per chunk) are processed in parallel by a \ref vigra::ThreadPool with 
+    <tt>options.getNumThreads()</tt> threads. Since every output block is computed independently,
+    the result is the same for any number of threads. Source and destination must not be the same
+    array unless the data consist of a single chunk.
+
+    The MultiArrayView overloads additionally take the block shape (default: 128 along each axis)
+    before the <tt>options</tt> argument.
+
+    When \ref BlockwiseConvolutionOptions are passed, the ChunkedArray version works as a streaming
+    engine for data much larger than main memory. Each block is a chunk of the destination, read 
+    from the source together with its halo (the kernel radius), convolved, and written back, so that 
+    every destination chunk is computed exactly once. The blocks are visited tile by tile, where a tile 
+    is a group of neighbouring blocks whose source chunks (including the halo) fit into the source 
+    chunk cache, and tiles are grown as cubic as possible. Thus, each source chunk is loaded from the 
+    backend about once, except for chunks in the halo between tiles. If 
+    <tt>options.getMemoryBudget()</tt> is non-zero, the number of threads is reduced until the per-thread 
+    block buffers fit into the budget, the remaining memory is assigned to the source cache (which 
+    determines the tile size), and the destination cache is limited to one chunk per thread. The original cache 
+    limits of both arrays are restored when the function returns. The budget does not include 
+    the backends' fixed overhead (chunk handles, compressed storage). A 
+    <tt>PreconditionViolation</tt> is thrown if the budget cannot hold a single block. Source and 
+    destination may have different chunk shapes.
+
+    <b> Usage:</b>
+
+    <b>\#include</b> \<vigra/blockwise_convolution.hxx\><br/>
+    Namespace: vigra
+
+    \code
+    ChunkedArrayHDF5<3, float> source(...), destination(...);
+    Kernel1D<double> gauss;
+    gauss.initGaussian(2.0);
+
+    // filter a volume much larger than memory with at most 8 GB of buffers
+    separableConvolveBlockwise(source, destination, gauss,
+                               BlockwiseConvolutionOptions().memoryBudget(std::size_t(8) << 30)
+                                                            .numThreads(16));
+    \endcode
 */
 doxygen_overloaded_function(template <...> void separableConvolveBlockwise)
 
 template <unsigned int N, class T1, class T2, class KernelIterator>
-void separableConvolveBlockwise(const ChunkedArray<N, T1>& source, ChunkedArray<N, T2>& destination, KernelIterator kit)
+void separableConvolveBlockwise(const ChunkedArray<N, T1>& source, ChunkedArray<N, T2>& destination, KernelIterator kit,
+                                ParallelOptions const & options = ParallelOptions())
 {
     using namespace blockwise_convolution_detail;
 
@@ -124,13 +380,75 @@ void separableConvolveBlockwise(const ChunkedArray<N, T1>& source, ChunkedArray<
     vigra_precondition(block_shape == destination.chunkShape(), "chunk shapes do not match");
     Overlaps<ChunkedArray<N, T1> > overlaps(source, block_shape, overlap.first, overlap.second);
     
-    convolveImpl(overlaps, destination.chunk_begin(Shape(0), shape), kit);
+    convolveImpl(overlaps, destination.chunk_begin(Shape(0), shape), kit, options);
+}
+template <unsigned int N, class T1, class T2, class T>
+void separableConvolveBlockwise(const ChunkedArray<N, T1>& source, ChunkedArray<N, T2>& destination, const Kernel1D<T>& kernel,
+                                ParallelOptions const & options = ParallelOptions())
+{
+    std::vector<Kernel1D<T> > kernels(N, kernel);
+    separableConvolveBlockwise(source, destination, kernels.begin(), options);
+}
+
+template <unsigned int N, class T1, class T2, class KernelIterator>
+void separableConvolveBlockwise(const ChunkedArray<N, T1>& source, ChunkedArray<N, T2>& destination, KernelIterator kit,
+                                BlockwiseConvolutionOptions const & options)
+{
+    using namespace blockwise_convolution_detail;
+
+    typedef typename ChunkedArray<N, T1>::shape_type Shape;
+    typedef typename NumericTraits<T2>::RealPromote TmpType;
+    
+    Shape shape = source.shape();
+    vigra_precondition(shape == destination.shape(), "shape mismatch of source and destination");
+
+    // blocks coincide with the destination chunks, so that each destination
+    // chunk is written exactly once
+    std::pair<Shape, Shape> overlap = kernelOverlap<Shape, KernelIterator>(kit);
+    Shape block_shape = destination.chunkShape();
+    Overlaps<ChunkedArray<N, T1> > overlaps(source, block_shape, overlap.first, overlap.second);
+
+    StreamingPlan<N> plan = planStreaming(shape, block_shape, source.chunkShape(), 
+                                          overlap.first, overlap.second,
+                                          sizeof(T1), sizeof(TmpType), destination.dataBytesPerChunk(),
+                                          options.getNumThreads(), options.getMemoryBudget());
+
+    // the cache is logically mutable, its limits are restored on exit
+    ChunkCacheLimits<N, T1> source_limits(const_cast<ChunkedArray<N, T1> &>(source));
+    ChunkCacheLimits<N, T2> dest_limits(destination);
+    if(plan.source_cache_bytes > 0)
+    {
+        source_limits.set(NumericTraits<int>::max(), plan.source_cache_bytes);
+        dest_limits.set(plan.dest_cache_chunks, 0);
+    }
+
+    ThreadPool pool(plan.num_threads > 1 ? plan.num_threads : (int)ParallelOptions::NoThreads);
+    typedef typename ChunkedArray<N, T2>::chunk_iterator OutputBlocksIterator;
+    OutputBlocksIterator output_blocks_begin = destination.chunk_begin(Shape(0), shape);
+
+    Shape grid = overlaps.shape(),
+          tiles = overlapped_blocks_detail::blocksShape(grid, plan.tile_shape);
+    MultiCoordinateIterator<N> tile(tiles), tiles_end = tile.getEndIterator();
+    for(; tile != tiles_end; ++tile)
+    {
+        Shape first = *tile * plan.tile_shape,
+              count = min(first + plan.tile_shape, grid) - first;
+        MultiCoordinateIterator<N> begin(count);
+        parallel_foreach(pool, begin, begin.getEndIterator(),
+            [&overlaps, &output_blocks_begin, &kit, &first](int, Shape const & coordinates)
+            {
+                convolveBlock(overlaps, output_blocks_begin, kit, first + coordinates);
+            },
+            prod(count));
+    }
 }
+
 template <unsigned int N, class T1, class T2, class T>
-void separableConvolveBlockwise(const ChunkedArray<N, T1>& source, ChunkedArray<N, T2>& destination, const Kernel1D<T>& kernel)
+void separableConvolveBlockwise(const ChunkedArray<N, T1>& source, ChunkedArray<N, T2>& destination, const Kernel1D<T>& kernel,
+                                BlockwiseConvolutionOptions const & options)
 {
     std::vector<Kernel1D<T> > kernels(N, kernel);
-    separableConvolveBlockse(source, destination, kernels.begin());
+    separableConvolveBlockwise(source, destination, kernels.begin(), options);
 }
 
 
@@ -0,0 +1,358 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2015 by Ullrich Koethe                       */
+/*                                                                      */
+/*    This file is part of the VIGRA computer vision library.           */
+/*    The VIGRA Website is                                              */
+/*        http://hci.iwr.uni-heidelberg.de/vigra/                       */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef VIGRA_BLOCKWISE_FEATURES_HXX
+#define VIGRA_BLOCKWISE_FEATURES_HXX
+
+#include "accumulator.hxx"
+#include "multi_array_chunked.hxx"
+#include "metaprogramming.hxx"
+#include "threadpool.hxx"
+
+#include <algorithm>
+#include <vector>
+
+namespace vigra {
+
+namespace acc {
+
+namespace blockwise_features_detail {
+
+    // Does the tag list contain a coordinate-based statistic (i.e. one
+    // which depends on setCoordinateOffset())?
+template <class T>
+struct UsesCoordinates
+{
+    static const bool value = false;
+};
+
+template <class T>
+struct UsesCoordinates<Coord<T> >
+{
+    static const bool value = true;
+};
+
+template <template <class> class A, class T>
+struct UsesCoordinates<A<T> >
+: public UsesCoordinates<T>
+{};
+
+template <class HEAD, class TAIL>
+struct UsesCoordinates<TypeList<HEAD, TAIL> >
+{
+    static const bool value = UsesCoordinates<HEAD>::value || UsesCoordinates<TAIL>::value;
+};
+
+template <unsigned int N, class T>
+void checkoutBlock(ChunkedArray<N, T> const & array,
+                   typename MultiArrayShape<N>::type const & start,
+                   typename MultiArrayShape<N>::type const & stop,
+                   MultiArray<N, T> & buffer)
+{
+    if(buffer.shape() != stop - start)
+        buffer.reshape(stop - start);
+    array.checkoutSubarray(start, buffer);
+}
+
+    // Provides the data of one block of up to two chunked arrays
+    // as a coupled iterator. The block contents are copied into
+    // buffers owned by the object, so that each thread needs its own copy.
+template <unsigned int N, class T1, class T2=void>
+class ChunkedBlockData
+{
+  public:
+    typedef typename MultiArrayShape<N>::type              Shape;
+    typedef typename CoupledIteratorType<N, T1, T2>::type  iterator;
+
+    ChunkedBlockData(ChunkedArray<N, T1> const & a1, ChunkedArray<N, T2> const & a2)
+    : a1_(&a1),
+      a2_(&a2)
+    {}
+
+    iterator begin(Shape const & start, Shape const & stop)
+    {
+        checkoutBlock(*a1_, start, stop, b1_);
+        checkoutBlock(*a2_, start, stop, b2_);
+        return createCoupledIterator(b1_, b2_);
+    }
+
+    ChunkedArray<N, T1> const & array(MetaInt<1>) const
+    {
+        return *a1_;
+    }
+
+    ChunkedArray<N, T2> const & array(MetaInt<2>) const
+    {
+        return *a2_;
+    }
+
+    Shape const & shape() const
+    {
+        return a1_->shape();
+    }
+
+  private:
+    ChunkedArray<N, T1> const * a1_;
+    ChunkedArray<N, T2> const * a2_;
+    MultiArray<N, T1> b1_;
+    MultiArray<N, T2> b2_;
+};
+
+template <unsigned int N, class T1>
+class ChunkedBlockData<N, T1, void>
+{
+  public:
+    typedef typename MultiArrayShape<N>::type          Shape;
+    typedef typename CoupledIteratorType<N, T1>::type  iterator;
+
+    ChunkedBlockData(ChunkedArray<N, T1> const & a1)
+    : a1_(&a1)
+    {}
+
+    iterator begin(Shape const & start, Shape const & stop)
+    {
+        checkoutBlock(*a1_, start, stop, b1_);
+        return createCoupledIterator(b1_);
+    }
+
+    ChunkedArray<N, T1> const & array(MetaInt<1>) const
+    {
+        return *a1_;
+    }
+
+    Shape const & shape() const
+    {
+        return a1_->shape();
+    }
+
+  private:
+    ChunkedArray<N, T1> const * a1_;
+    MultiArray<N, T1> b1_;
+};
+
+    // Call f(thread, blockStart, blockStop) for all blocks of the given
+    // shape that cover the array.
+template <unsigned int N, class FUNCTOR>
+void forEachBlock(ThreadPool & pool,
+                  typename MultiArrayShape<N>::type const & shape,
+                  typename MultiArrayShape<N>::type const & blockShape,
+                  FUNCTOR f)
+{
+    typedef typename MultiArrayShape<N>::type Shape;
+
+    MultiCoordinateIterator<N> blocks((shape + blockShape - Shape(1)) / blockShape);
+    parallel_foreach(pool, blocks, blocks.getEndIterator(),
+        [&](int thread, Shape const & block)
+        {
+            Shape start = block*blockShape,
+                  stop  = min(start + blockShape, shape);
+            f(thread, start, stop);
+        },
+        prod(blocks.shape()));
+}
+
+    // Chains that do not store regions, or store them sparsely,
+    // need no preparation.
+template <class BLOCKS>
+void allocateRegions(void *, ThreadPool &, BLOCKS &,
+                     typename BLOCKS::Shape const &)
+{}
+
+    // A dense AccumulatorChainArray would only scan the labels of the first
+    // block to determine the region count. Find the maximum label of the
+    // entire label array instead.
+template <class T, class Selected, bool dynamic, class BLOCKS>
+void allocateRegions(AccumulatorChainArray<T, Selected, dynamic> * a,
+                     ThreadPool & pool, BLOCKS & blocks,
+                     typename BLOCKS::Shape const & blockShape)
+{
+    typedef typename BLOCKS::Shape Shape;
+    typedef typename AccumulatorChainArray<T, Selected, dynamic>::InternalBaseType LabelDispatchType;
+    typedef typename BLOCKS::iterator::value_type Handle;
+    typedef HandleArgSelector<Handle, LabelArgTag, typename LabelDispatchType::GlobalAccumulatorChain> LabelHandle;
+    typedef typename LabelHandle::value_type LabelType;
+    static const unsigned int N = LabelHandle::size;
+
+    if(a->regionCount() > 0 || a->sparseRegionStorage())
+        return;
+
+    ChunkedArray<N, LabelType> const & labels = blocks.array(MetaInt<LabelHandle::value>());
+    std::vector<MultiArray<N, LabelType> > buffers(std::max<std::size_t>(pool.nThreads(), 1));
+    std::vector<LabelType> maxima(buffers.size(), LabelType());
+
+    forEachBlock<N>(pool, labels.shape(), blockShape,
+        [&](int thread, Shape const & start, Shape const & stop)
+        {
+            checkoutBlock(labels, start, stop, buffers[thread]);
+            LabelType minimum, maximum;
+            buffers[thread].minmax(&minimum, &maximum);
+            maxima[thread] = std::max(maxima[thread], maximum);
+        });
+    a->setMaxRegionLabel((unsigned int)*std::max_element(maxima.begin(), maxima.end()));
+}
+
+template <class BLOCKS, class ACCUMULATOR>
+void extractFeaturesBlockwise(BLOCKS const & proto, ACCUMULATOR & a,
+                              ParallelOptions const & options)
+{
+    typedef typename BLOCKS::Shape Shape;
+    static const unsigned int N = Shape::static_size;
+    static const bool useCoordinates =
+                  UsesCoordinates<typename ACCUMULATOR::AccumulatorTags>::value;
+
+    Shape shape = proto.shape(),
+          blockShape = proto.array(MetaInt<1>()).chunkShape();
+    if(prod(shape) == 0)
+        return;
+
+    ThreadPool pool(options);
+    MultiCoordinateIterator<N> blockIter((shape + blockShape - Shape(1)) / blockShape);
+    BLOCKS firstBlock(proto);
+
+    allocateRegions(&a, pool, firstBlock, blockShape);
+    acc_detail::extractFeaturesParallel(pool, prod(blockIter.shape()), a,
+        [&]()
+        {
+            return *firstBlock.begin(Shape(), min(blockShape, shape));
+        },
+        [&](ACCUMULATOR & chain, std::ptrdiff_t begin, std::ptrdiff_t stop, unsigned int k)
+        {
+            BLOCKS blocks(proto);
+            for(MultiCoordinateIterator<N> b = blockIter + begin, bend = blockIter + stop; b < bend; ++b)
+            {
+                Shape start = *b*blockShape,
+                      end   = min(start + blockShape, shape);
+                if(useCoordinates)
+                    chain.setCoordinateOffset(start);
+                typename BLOCKS::iterator i    = blocks.begin(start, end),
+                                          iend = i.getEndIterator();
+                for(; i < iend; ++i)
+                    chain.updatePassN(*i, k);
+            }
+        });
+}
+
+} // namespace blockwise_features_detail
+
+/** \addtogroup FeatureAccumulators
+*/
+//@{
+
+/** \brief Compute region features of chunked arrays block by block.
+
+    <b> Declarations:</b>
+
+    \code
+    namespace vigra { namespace acc {
+        template <unsigned int N, class T1, class ACCUMULATOR>
+        void extractFeatures(ChunkedArray<N, T1> const & a1,
+                             ACCUMULATOR & a,
+                             ParallelOptions const & options = ParallelOptions());
+
+        template <unsigned int N, class T1, class T2, class ACCUMULATOR>
+        void extractFeatures(ChunkedArray<N, T1> const & a1,
+                             ChunkedArray<N, T2> const & a2,
+                             ACCUMULATOR & a,
+                             ParallelOptions const & options = ParallelOptions());
+    }}
+    \endcode
+
+    These variants of \ref extractFeatures() work on arrays which need not fit
+    into memory. The arrays are traversed in blocks of the first array's chunk
+    shape (so that the second array should preferably use the same chunk shape).
+    Each thread processes a contiguous range of blocks (in scan order): it copies
+    the current block into a private buffer and passes it to a private copy of
+    the accumulator chain. The per-thread chains are then merged into <tt>a</tt>
+    in block order, so that the result is deterministic for a given number of
+    threads. Chains requiring several passes are handled pass by pass as described
+    for the parallel versions of \ref extractFeatures(), i.e. the chunked arrays
+    are read once per pass. Consequently, only statistics that support merging via the '+='
+    operator can be used; otherwise, a <tt>PreconditionViolation</tt> is thrown.
+
+    Coordinate-based statistics (e.g. <tt>RegionCenter</tt>) are reported in
+    the coordinate system of the entire array. Since the coordinate offset
+    of all regions must be updated for every block, they add a cost proportional
+    to the number of regions per block. When <tt>a</tt> is a dense
+    <tt>AccumulatorChainArray</tt> whose region count is still unknown, the
+    label array is scanned once in advance to determine the maximum label.
+    For segmentations with few, but large labels,
+    <tt>AccumulatorChainArray::setSparseRegionStorage()</tt> avoids both the
+    extra scan and the memory for unused labels.
+
+    <b> Usage:</b>
+
+    <b>\#include</b> \<vigra/blockwise_features.hxx\><br/>
+    Namespace: vigra::acc
+
+    \code
+    ChunkedArrayHDF5<3, float>        data(file, "data");
+    ChunkedArrayHDF5<3, unsigned int> labels(file, "labels");
+
+    AccumulatorChainArray<CoupledArrays<3, float, unsigned int>,
+                          Select<DataArg<1>, LabelArg<2>, Count, Mean, RegionCenter> > a;
+
+    extractFeatures(data, labels, a, ParallelOptions().numThreads(4));
+    \endcode
+*/
+doxygen_overloaded_function(template <...> void extractFeatures)
+
+template <unsigned int N, class T1, class ACCUMULATOR>
+void extractFeatures(ChunkedArray<N, T1> const & a1,
+                     ACCUMULATOR & a,
+                     ParallelOptions const & options = ParallelOptions())
+{
+    blockwise_features_detail::extractFeaturesBlockwise(
+        blockwise_features_detail::ChunkedBlockData<N, T1>(a1), a, options);
+}
+
+template <unsigned int N, class T1, class T2, class ACCUMULATOR>
+void extractFeatures(ChunkedArray<N, T1> const & a1,
+                     ChunkedArray<N, T2> const & a2,
+                     ACCUMULATOR & a,
+                     ParallelOptions const & options = ParallelOptions())
+{
+    vigra_precondition(a1.shape() == a2.shape(),
+        "extractFeatures(): shape mismatch between input arrays.");
+    blockwise_features_detail::extractFeaturesBlockwise(
+        blockwise_features_detail::ChunkedBlockData<N, T1, T2>(a1, a2), a, options);
+}
+
+//@}
+
+} // namespace acc
+
+} // namespace vigra
+
+#endif // VIGRA_BLOCKWISE_FEATURES_HXX
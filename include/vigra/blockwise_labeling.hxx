@@ -44,6 +44,7 @@
 
 #include "visit_border.hxx"
 #include "blockify.hxx"
+#include "threadpool.hxx"
 
 namespace vigra
 {
@@ -57,12 +58,92 @@ class LabelOptions;
 namespace blockwise_labeling_detail
 {
 
-template <class Equal, class Label>
+#ifdef VIGRA_HAS_ATOMIC
+
+    // Union-find array that can be modified concurrently by several threads.
+    // Like UnionFindArray, it always links the larger root to the smaller one,
+    // so that the root of each set is its smallest index. The resulting partition
+    // and the labels assigned by makeContiguous() are therefore independent of
+    // the order in which the unions were made.
+template <class T>
+class ConcurrentUnionFindArray
+{
+    mutable std::vector<threading::atomic<T> > parents_;
+    std::vector<T> labels_;
+
+  public:
+    ConcurrentUnionFindArray(T size)
+    : parents_(size)
+    {
+        for(T k = 0; k < size; ++k)
+            parents_[k].store(k, threading::memory_order_relaxed);
+    }
+
+    T findIndex(T index) const
+    {
+        T parent = parents_[index].load(threading::memory_order_acquire);
+        while(parent != index)
+        {
+            // path halving: a node may always be redirected to one of its ancestors
+            T grandparent = parents_[parent].load(threading::memory_order_acquire);
+            if(grandparent != parent)
+                parents_[index].compare_exchange_weak(parent, grandparent);
+            index = parent;
+            parent = parents_[index].load(threading::memory_order_acquire);
+        }
+        return index;
+    }
+
+    T makeUnion(T l1, T l2)
+    {
+        for(;;)
+        {
+            T i1 = findIndex(l1);
+            T i2 = findIndex(l2);
+            if(i1 == i2)
+                return i1;
+            if(i1 < i2)
+                std::swap(i1, i2);
+            // link the larger root, unless another thread has linked it in the meantime
+            T expected = i1;
+            if(parents_[i1].compare_exchange_strong(expected, i2))
+                return i2;
+            l1 = i1;
+            l2 = i2;
+        }
+    }
+
+        // must only be called when all unions are finished
+    T makeContiguous()
+    {
+        labels_.resize(parents_.size());
+        T count = 0;
+        for(std::size_t k = 0; k < parents_.size(); ++k)
+        {
+            T root = findIndex((T)k);
+            labels_[k] = (root == (T)k)
+                            ? count++
+                            : labels_[root];   // root < k
+        }
+        return count - 1;
+    }
+
+    T findLabel(T index) const
+    {
+        return labels_.size() > 0
+                  ? labels_[index]
+                  : findIndex(index);
+    }
+};
+
+#endif // VIGRA_HAS_ATOMIC
+
+template <class Equal, class Label, class UnionFind = UnionFindArray<Label> >
 struct BorderVisitor
 {
     Label u_label_offset;
     Label v_label_offset;
-    UnionFindArray<Label>* global_unions;
+    UnionFind* global_unions;
     Equal* equal;
     
     template <class Data, class Shape>
@@ -88,7 +169,8 @@ blockwiseLabeling(DataBlocksIterator data_blocks_begin, DataBlocksIterator data_
                   LabelBlocksIterator label_blocks_begin, LabelBlocksIterator label_blocks_end,
                   NeighborhoodType neighborhood, Equal equal,
                   const Value* background_value,
-                  Mapping& mapping)
+                  Mapping& mapping,
+                  ParallelOptions const & options = ParallelOptions())
 {
     typedef typename LabelBlocksIterator::value_type::value_type Label;
     typedef typename DataBlocksIterator::shape_type Shape;
@@ -97,31 +179,44 @@ blockwiseLabeling(DataBlocksIterator data_blocks_begin, DataBlocksIterator data_
     vigra_precondition(blocks_shape == label_blocks_begin.shape() &&
                        blocks_shape == mapping.shape(),
                        "shapes of blocks of blocks do not match");
+    vigra_assert(data_blocks_end - data_blocks_begin == prod(blocks_shape) &&
+                 label_blocks_end - label_blocks_begin == prod(blocks_shape), "");
 
     static const unsigned int Dimensions = DataBlocksIterator::dimension + 1;
     MultiArray<Dimensions, Label> label_offsets(label_blocks_begin.shape());
+
+    ThreadPool pool(options);
     
-    // mapping stage: label each block and save number of labels assigned in blocks before the current block in label_offsets
+    // mapping stage: label each block in parallel, then save the number of labels 
+    // assigned in blocks before the current block in label_offsets
     Label unmerged_label_number;
     {
-        DataBlocksIterator data_blocks_it = data_blocks_begin;
-        LabelBlocksIterator label_blocks_it = label_blocks_begin;
-        typename MultiArray<Dimensions, Label>::iterator offsets_it = label_offsets.begin();
+        MultiArray<Dimensions, Label> label_counts(blocks_shape);
+        parallel_foreach(pool, prod(blocks_shape),
+            [&](int, MultiArrayIndex k)
+            {
+                // the iterators keep chunks alive while the block is labeled
+                DataBlocksIterator data_blocks_it = data_blocks_begin;
+                data_blocks_it += k;
+                LabelBlocksIterator label_blocks_it = label_blocks_begin;
+                label_blocks_it += k;
+                if(background_value)
+                {
+                    label_counts[k] = 1 + labelMultiArrayWithBackground(*data_blocks_it, *label_blocks_it,
+                                                                        neighborhood, *background_value, equal);
+                }
+                else
+                {
+                    label_counts[k] = labelMultiArray(*data_blocks_it, *label_blocks_it,
+                                                      neighborhood, equal);
+                }
+            });
+
         Label current_offset = 0;
-        for( ; data_blocks_it != data_blocks_end; ++data_blocks_it, ++label_blocks_it, ++offsets_it)
+        for(MultiArrayIndex k = 0; k < label_offsets.size(); ++k)
         {
-            vigra_assert(label_blocks_it != label_blocks_end && offsets_it != label_offsets.end(), "");
-            *offsets_it = current_offset;
-            if(background_value)
-            {
-                current_offset += 1 + labelMultiArrayWithBackground(*data_blocks_it, *label_blocks_it,
-                                                                    neighborhood, *background_value, equal);
-            }
-            else
-            {
-                current_offset += labelMultiArray(*data_blocks_it, *label_blocks_it,
-                                                  neighborhood, equal);
-            }
+            label_offsets[k] = current_offset;
+            current_offset += label_counts[k];
         }
         unmerged_label_number = current_offset;
         if(!background_value)
@@ -129,7 +224,14 @@ blockwiseLabeling(DataBlocksIterator data_blocks_begin, DataBlocksIterator data_
     }
     
     // reduce stage: merge adjacent labels if the region overlaps
-    UnionFindArray<Label> global_unions(unmerged_label_number);
+#ifdef VIGRA_HAS_ATOMIC
+    typedef ConcurrentUnionFindArray<Label> GlobalUnions;
+    ThreadPool & merge_pool = pool;
+#else
+    typedef UnionFindArray<Label> GlobalUnions;
+    ThreadPool merge_pool(ParallelOptions::NoThreads);
+#endif
+    GlobalUnions global_unions(unmerged_label_number);
     if(background_value)
     {
         // merge all labels that refer to background
@@ -144,21 +246,33 @@ blockwiseLabeling(DataBlocksIterator data_blocks_begin, DataBlocksIterator data_
     typedef GridGraph<Dimensions, undirected_tag> Graph;
     typedef typename Graph::edge_iterator EdgeIterator;
     Graph blocks_graph(blocks_shape, neighborhood);
+    std::vector<std::pair<Shape, Shape> > block_pairs;
     for(EdgeIterator it = blocks_graph.get_edge_iterator(); it != blocks_graph.get_edge_end_iterator(); ++it)
-    {
-        Shape u = blocks_graph.u(*it);
-        Shape v = blocks_graph.v(*it);
-        Shape difference = v - u;
-        
-        BorderVisitor<Equal, Label> border_visitor;
-        border_visitor.u_label_offset = label_offsets[u];
-        border_visitor.v_label_offset = label_offsets[v];
-        border_visitor.global_unions = &global_unions;
-        border_visitor.equal = &equal;
-        visitBorder(data_blocks_begin[u], label_blocks_begin[u],
-                    data_blocks_begin[v], label_blocks_begin[v],
-                    difference, neighborhood, border_visitor);
-    }
+        block_pairs.push_back(std::make_pair(blocks_graph.u(*it), blocks_graph.v(*it)));
+
+    parallel_foreach(merge_pool, block_pairs.begin(), block_pairs.end(),
+        [&](int, std::pair<Shape, Shape> const & block_pair)
+        {
+            Shape u = block_pair.first;
+            Shape v = block_pair.second;
+            Shape difference = v - u;
+
+            DataBlocksIterator u_data = data_blocks_begin, v_data = data_blocks_begin;
+            u_data += u;
+            v_data += v;
+            LabelBlocksIterator u_labels = label_blocks_begin, v_labels = label_blocks_begin;
+            u_labels += u;
+            v_labels += v;
+
+            BorderVisitor<Equal, Label, GlobalUnions> border_visitor;
+            border_visitor.u_label_offset = label_offsets[u];
+            border_visitor.v_label_offset = label_offsets[v];
+            border_visitor.global_unions = &global_unions;
+            border_visitor.equal = &equal;
+            visitBorder(*u_data, *u_labels, *v_data, *v_labels,
+                        difference, neighborhood, border_visitor);
+        },
+        block_pairs.size());
 
     // fill mapping (local labels) -> (global labels)
     Label last_label = global_unions.makeContiguous();
@@ -214,20 +328,29 @@ blockwiseLabeling(DataBlocksIterator data_blocks_begin, DataBlocksIterator data_
 
 template <class LabelBlocksIterator, class MappingIterator>
 void toGlobalLabels(LabelBlocksIterator label_blocks_begin, LabelBlocksIterator label_blocks_end,
-                    MappingIterator mapping_begin, MappingIterator mapping_end)
+                    MappingIterator mapping_begin, MappingIterator mapping_end,
+                    ParallelOptions const & options = ParallelOptions())
 {
     typedef typename LabelBlocksIterator::value_type LabelBlock;
-    for( ; label_blocks_begin != label_blocks_end; ++label_blocks_begin, ++mapping_begin)
-    {
-        vigra_assert(mapping_begin != mapping_end, "");
-        for(typename LabelBlock::iterator labels_it = label_blocks_begin->begin();
-            labels_it != label_blocks_begin->end();
-            ++labels_it)
+    vigra_assert(label_blocks_end - label_blocks_begin <= mapping_end - mapping_begin, "");
+
+    // blocks are relabeled independently
+    ThreadPool pool(options);
+    parallel_foreach(pool, label_blocks_end - label_blocks_begin,
+        [&](int, MultiArrayIndex k)
         {
-            vigra_assert(*labels_it < mapping_begin->size(), "");
-            *labels_it = (*mapping_begin)[*labels_it];
-        }
-    }
+            LabelBlocksIterator label_blocks_it = label_blocks_begin;
+            label_blocks_it += k;
+            MappingIterator mapping_it = mapping_begin;
+            mapping_it += k;
+            for(typename LabelBlock::iterator labels_it = label_blocks_it->begin();
+                labels_it != label_blocks_it->end();
+                ++labels_it)
+            {
+                vigra_assert(*labels_it < mapping_it->size(), "");
+                *labels_it = (*mapping_it)[*labels_it];
+            }
+        });
 }
 
 
@@ -238,6 +361,7 @@ const T* getBackground(const LabelOptions& options);
 template <class T>
 const T* getBlockShape(const LabelOptions& options);
 NeighborhoodType getNeighborhood(const LabelOptions& options);
+const ParallelOptions& getParallelOptions(const LabelOptions& options);
 
 } // namespace blockwise_labeling_detail
 
@@ -262,6 +386,7 @@ private:
     VIGRA_UNIQUE_PTR<type_erasure_base> background_value_;
     VIGRA_UNIQUE_PTR<type_erasure_base> block_shape_;
     NeighborhoodType neighborhood_;
+    ParallelOptions parallel_options_;
 public:
     LabelOptions()
       : neighborhood_(DirectNeighborhood)
@@ -291,12 +416,19 @@ public:
         return *this;
     }
 
+        // number of threads used by the blockwise algorithms (default: ParallelOptions::Auto)
+    LabelOptions& numThreads(int n)
+    {
+        parallel_options_.numThreads(n);
+        return *this;
+    }
     
     template <class T>
     friend const T* blockwise_labeling_detail::getBackground(const LabelOptions& options);
     template <class T>
     friend const T* blockwise_labeling_detail::getBlockShape(const LabelOptions& options);
     friend NeighborhoodType blockwise_labeling_detail::getNeighborhood(const LabelOptions& options);
+    friend const ParallelOptions& blockwise_labeling_detail::getParallelOptions(const LabelOptions& options);
 };
 
 namespace blockwise_labeling_detail
@@ -328,6 +460,11 @@ inline NeighborhoodType getNeighborhood(const LabelOptions& options)
     return options.neighborhood_;
 }
 
+inline const ParallelOptions& getParallelOptions(const LabelOptions& options)
+{
+    return options.parallel_options_;
+}
+
 }
 
 
@@ -352,7 +489,8 @@ Label labelMultiArrayBlockwise(const MultiArrayView<N, Data, S1>& data,
     MultiArray<N, MultiArrayView<N, Label, S2> > label_blocks = blockify(labels, block_shape);
     return blockwiseLabeling(data_blocks.begin(), data_blocks.end(),
                              label_blocks.begin(), label_blocks.end(),
-                             neighborhood, equal, background_value, mapping);
+                             neighborhood, equal, background_value, mapping,
+                             getParallelOptions(options));
 }
 template <unsigned int N, class Data, class S1,
                           class Label, class S2,
@@ -372,10 +510,12 @@ Label labelMultiArrayBlockwise(const MultiArrayView<N, Data, S1>& data,
     MultiArray<N, std::vector<Label> > mapping(data_blocks.shape());
     Label last_label = blockwiseLabeling(data_blocks.begin(), data_blocks.end(),
                                          label_blocks.begin(), label_blocks.end(),
-                                         neighborhood, equal, background_value, mapping);
+                                         neighborhood, equal, background_value, mapping,
+                                         getParallelOptions(options));
 
     // replace local labels by global labels
-    toGlobalLabels(label_blocks.begin(), label_blocks.end(), mapping.begin(), mapping.end());
+    toGlobalLabels(label_blocks.begin(), label_blocks.end(), mapping.begin(), mapping.end(),
+                   getParallelOptions(options));
     return last_label;
 }
 template <unsigned int N, class Data, class S1,
@@ -423,6 +563,9 @@ Label labelMultiArrayBlockwise(const MultiArrayView<N, Data, S1>& data,
 
     The resulting labeling is equivalent to a labeling by \ref labelMultiArray, that is, the connected components are the same but may have different ids.
     \ref NeighborhoodType and background value (if any) can be specified with the LabelOptions object.
+    The chunks are labeled in parallel, and the labels of adjacent chunks are merged concurrently.
+    The number of threads is set by <tt>LabelOptions::numThreads()</tt> (default: one per core); 
+    the resulting labels do not depend on it.
     If the \a mapping parameter is provided, each chunk is labeled seperately and contiguously (starting at one, zero for background),
     with \a mapping containing a mapping of local labels to global labels for each chunk.
     Thus, the shape of 'mapping' has to be large enough to hold each chunk coordinate.
@@ -487,7 +630,8 @@ Label labelMultiArrayBlockwise(const ChunkedArray<N, Data>& data,
     
     return blockwiseLabeling(data_chunks_begin, data_chunks_begin.getEndIterator(),
                              label_chunks_begin, label_chunks_begin.getEndIterator(),
-                             neighborhood, equal, background_value, mapping);
+                             neighborhood, equal, background_value, mapping,
+                             getParallelOptions(options));
 }
 template <unsigned int N, class Data, class Label, class Equal>
 Label labelMultiArrayBlockwise(const ChunkedArray<N, Data>& data,
@@ -498,7 +642,8 @@ Label labelMultiArrayBlockwise(const ChunkedArray<N, Data>& data,
     MultiArray<N, std::vector<Label> > mapping(data.chunkArrayShape());
     Label result = labelMultiArrayBlockwise(data, labels, options, equal, mapping);
     typedef typename ChunkedArray<N, Data>::shape_type Shape;
-    toGlobalLabels(labels.chunk_begin(Shape(0), data.shape()), labels.chunk_end(Shape(0), data.shape()), mapping.begin(), mapping.end());
+    toGlobalLabels(labels.chunk_begin(Shape(0), data.shape()), labels.chunk_end(Shape(0), data.shape()), mapping.begin(), mapping.end(),
+                   getParallelOptions(options));
     return result;
 }
 template <unsigned int N, class Data, class Label>
@@ -41,6 +41,7 @@
 #include "blockify.hxx"
 #include "blockwise_labeling.hxx"
 #include "overlapped_blocks.hxx"
+#include "threadpool.hxx"
 
 #include <limits>
 
@@ -57,7 +58,8 @@ namespace blockwise_watersheds_detail
 template <class DataArray, class DirectionsBlocksIterator>
 void prepareBlockwiseWatersheds(const Overlaps<DataArray>& overlaps,
                                 DirectionsBlocksIterator directions_blocks_begin,
-                                NeighborhoodType neighborhood)
+                                NeighborhoodType neighborhood,
+                                ParallelOptions const & options = ParallelOptions())
 {
     static const unsigned int N = DataArray::actual_dimension;
     typedef typename MultiArrayShape<N>::type Shape;
@@ -65,42 +67,50 @@ void prepareBlockwiseWatersheds(const Overlaps<DataArray>& overlaps,
     Shape shape = overlaps.shape();
     vigra_assert(shape == directions_blocks_begin.shape(), "");
     
-    MultiCoordinateIterator<N> it(shape);
-    MultiCoordinateIterator<N> end = it.getEndIterator();
-    for( ; it != end; ++it)
-    {
-        DirectionsBlock directions_block = directions_blocks_begin[*it];
-        OverlappingBlock<DataArray> data_block = overlaps[*it];
-        
-        typedef GridGraph<N, undirected_tag> Graph;
-        typedef typename Graph::NodeIt GraphScanner;
-        typedef typename Graph::OutArcIt NeighborIterator;
-        
-        Graph graph(data_block.block.shape(), neighborhood);
-        for(GraphScanner node(graph); node != lemon::INVALID; ++node)
+    // the direction of each pixel only depends on its neighbors, 
+    // so blocks can be processed in any order
+    ThreadPool pool(options);
+    MultiCoordinateIterator<N> begin(shape);
+    MultiCoordinateIterator<N> end = begin.getEndIterator();
+    parallel_foreach(pool, begin, end,
+        [&](int, Shape const & block_coordinates)
         {
-            if(within(*node, data_block.inner_bounds))
+            // keep the iterator alive, so that a chunked array doesn't release the chunk
+            DirectionsBlocksIterator directions_block_it = directions_blocks_begin;
+            directions_block_it += block_coordinates;
+            DirectionsBlock & directions_block = *directions_block_it;
+            OverlappingBlock<DataArray> data_block = overlaps[block_coordinates];
+            
+            typedef GridGraph<N, undirected_tag> Graph;
+            typedef typename Graph::NodeIt GraphScanner;
+            typedef typename Graph::OutArcIt NeighborIterator;
+            
+            Graph graph(data_block.block.shape(), neighborhood);
+            for(GraphScanner node(graph); node != lemon::INVALID; ++node)
             {
-                typedef typename DataArray::value_type Data;
-                Data lowest_neighbor = data_block.block[*node];
-                
-                typedef typename DirectionsBlock::value_type Direction;
-                Direction lowest_neighbor_direction = std::numeric_limits<unsigned short>::max();
-                
-                for(NeighborIterator arc(graph, *node); arc != lemon::INVALID; ++arc)
+                if(within(*node, data_block.inner_bounds))
                 {
-                    Shape neighbor_coordinates = graph.target(*arc);
-                    Data neighbor_data = data_block.block[neighbor_coordinates];
-                    if(neighbor_data < lowest_neighbor)
+                    typedef typename DataArray::value_type Data;
+                    Data lowest_neighbor = data_block.block[*node];
+                    
+                    typedef typename DirectionsBlock::value_type Direction;
+                    Direction lowest_neighbor_direction = std::numeric_limits<unsigned short>::max();
+                    
+                    for(NeighborIterator arc(graph, *node); arc != lemon::INVALID; ++arc)
                     {
-                        lowest_neighbor = neighbor_data;
-                        lowest_neighbor_direction = arc.neighborIndex();
+                        Shape neighbor_coordinates = graph.target(*arc);
+                        Data neighbor_data = data_block.block[neighbor_coordinates];
+                        if(neighbor_data < lowest_neighbor)
+                        {
+                            lowest_neighbor = neighbor_data;
+                            lowest_neighbor_direction = arc.neighborIndex();
+                        }
                     }
+                    directions_block[*node - data_block.inner_bounds.first] = lowest_neighbor_direction;
                 }
-                directions_block[*node - data_block.inner_bounds.first] = lowest_neighbor_direction;
             }
-        }
-    }
+        },
+        prod(shape));
 }
 
 template <unsigned int N>
@@ -131,7 +141,8 @@ Label unionFindWatershedsBlockwise(MultiArrayView<N, Data, S1> data,
                                    MultiArrayView<N, Label, S2> labels,
                                    NeighborhoodType neighborhood = DirectNeighborhood,
                                    const typename MultiArrayView<N, Data, S1>::difference_type& block_shape = 
-                                           typename MultiArrayView<N, Data, S1>::difference_type(128))
+                                           typename MultiArrayView<N, Data, S1>::difference_type(128),
+                                   ParallelOptions const & options = ParallelOptions())
 {
     using namespace blockwise_watersheds_detail;
 
@@ -144,10 +155,13 @@ Label unionFindWatershedsBlockwise(MultiArrayView<N, Data, S1> data,
     MultiArray<N, MultiArrayView<N, unsigned short> > directions_blocks = blockify(directions, block_shape);
 
     Overlaps<MultiArrayView<N, Data, S1> > overlaps(data, block_shape, Shape(1), Shape(1));
-    prepareBlockwiseWatersheds(overlaps, directions_blocks.begin(), neighborhood);
+    prepareBlockwiseWatersheds(overlaps, directions_blocks.begin(), neighborhood, options);
     GridGraph<N, undirected_tag> graph(data.shape(), neighborhood);
     UnionFindWatershedsEquality<N> equal = {&graph};
-    return labelMultiArrayBlockwise(directions, labels, LabelOptions().neighborhood(neighborhood).blockShape(block_shape), equal);
+    return labelMultiArrayBlockwise(directions, labels, 
+                                    LabelOptions().neighborhood(neighborhood).blockShape(block_shape)
+                                                  .numThreads(options.getNumThreads()), 
+                                    equal);
 }
 
 /*************************************************************/
@@ -165,14 +179,16 @@ Label unionFindWatershedsBlockwise(MultiArrayView<N, Data, S1> data,
         template <unsigned int N, class Data, class Label>
         Label unionFindWatershedsBlockwise(const ChunkedArray<N, Data>& data,
                                           ChunkedArray<N, Label>& labels,
-                                          NeighborhoodType neighborhood = DirectNeighborhood);
+                                          NeighborhoodType neighborhood = DirectNeighborhood,
+                                          ParallelOptions const & options = ParallelOptions());
 
         // provide temporary directions storage
         template <unsigned int N, class Data, class Label>
         Label unionFindWatershedsBlockwise(const ChunkedArray<N, Data>& data,
                                           ChunkedArray<N, Label>& labels,
                                           NeighborhoodType neighborhood,
-                                          ChunkedArray<N, unsigned short>& temporary_storage);
+                                          ChunkedArray<N, unsigned short>& temporary_storage,
+                                          ParallelOptions const & options = ParallelOptions());
     }
     \endcode
     
@@ -181,6 +197,10 @@ Label unionFindWatershedsBlockwise(MultiArrayView<N, Data, S1> data,
     If \a temporary_storage is provided, this array is used for intermediate result storage.
     Otherwise, a newly created \ref ChunkedArrayLazy is used.
 
+    The chunks are processed in parallel with <tt>options.getNumThreads()</tt> threads, 
+    and plateaus and basins are merged across chunk borders by \ref labelMultiArrayBlockwise().
+    The labels are the same for any number of threads.
+
     Return: the number of labels assigned (=largest label, because labels start at one)
     
     <b> Usage: </b>
@@ -205,7 +225,8 @@ template <unsigned int N, class Data, class Label>
 Label unionFindWatershedsBlockwise(const ChunkedArray<N, Data>& data,
                                    ChunkedArray<N, Label>& labels,
                                    NeighborhoodType neighborhood,
-                                   ChunkedArray<N, unsigned short>& directions)
+                                   ChunkedArray<N, unsigned short>& directions,
+                                   ParallelOptions const & options = ParallelOptions())
 {
     using namespace blockwise_watersheds_detail;
     
@@ -217,11 +238,13 @@ Label unionFindWatershedsBlockwise(const ChunkedArray<N, Data>& data,
     
     Overlaps<ChunkedArray<N, Data> > overlaps(data, data.chunkShape(), Shape(1), Shape(1));
     
-    prepareBlockwiseWatersheds(overlaps, directions.chunk_begin(Shape(0), shape), neighborhood);
+    prepareBlockwiseWatersheds(overlaps, directions.chunk_begin(Shape(0), shape), neighborhood, options);
     
     GridGraph<N, undirected_tag> graph(shape, neighborhood);
     UnionFindWatershedsEquality<N> equal = {&graph};
-    return labelMultiArrayBlockwise(directions, labels, LabelOptions().neighborhood(neighborhood), equal);
+    return labelMultiArrayBlockwise(directions, labels, 
+                                    LabelOptions().neighborhood(neighborhood).numThreads(options.getNumThreads()), 
+                                    equal);
 }
 
 template <unsigned int N, class Data,
@@ -229,10 +252,11 @@ template <unsigned int N, class Data,
 inline Label 
 unionFindWatershedsBlockwise(const ChunkedArray<N, Data>& data,
                                    ChunkedArray<N, Label>& labels,
-                                   NeighborhoodType neighborhood = DirectNeighborhood)
+                                   NeighborhoodType neighborhood = DirectNeighborhood,
+                                   ParallelOptions const & options = ParallelOptions())
 {
     ChunkedArrayLazy<N, unsigned short> directions(data.shape(), data.chunkShape());
-    return unionFindWatershedsBlockwise(data, labels, neighborhood, directions);
+    return unionFindWatershedsBlockwise(data, labels, neighborhood, directions, options);
 }
 
 //@}
@@ -50,22 +50,61 @@ enum CompressionMethod {  DEFAULT_COMPRESSION=-2,  // use default method (depend
                           ZLIB_FAST=1, // fastest compression using zlib
                           ZLIB=6,      // zlib default compression level
                           ZLIB_BEST=9, // highest compression using zlib
-                          LZ4          // very fast LZ4 algorithm
+                          LZ4,         // very fast LZ4 algorithm
+                          ZSTD_FAST,   // fastest compression using Zstandard (level 1)
+                          ZSTD,        // Zstandard default compression level (level 3)
+                          ZSTD_BEST    // high compression using Zstandard (level 19)
                        };
 
+namespace detail {
+
+inline int zstdCompressionLevel(CompressionMethod method)
+{
+    return method == ZSTD_FAST
+              ? 1
+              : method == ZSTD_BEST
+                   ? 19
+                   : 3;
+}
+
+} // namespace detail
+
 /** Compress the source buffer.
 
     The destination array will be resized as required.
+    
+    If <tt>shuffleTypeSize > 1</tt>, the source is interpreted as an array of 
+    elements with <tt>shuffleTypeSize</tt> bytes each, and the bytes are 
+    reordered by \ref byteShuffle() before compression (as in the Blosc library). 
+    This usually improves the compression of numeric data considerably. 
+    The same <tt>shuffleTypeSize</tt> must then be passed to \ref uncompress().
 */
-VIGRA_EXPORT void compress(char const * source, std::size_t size, ArrayVector<char> & dest, CompressionMethod method);
-VIGRA_EXPORT void compress(char const * source, std::size_t size, std::vector<char> & dest, CompressionMethod method);
+VIGRA_EXPORT void compress(char const * source, std::size_t size, ArrayVector<char> & dest, CompressionMethod method,
+                           std::size_t shuffleTypeSize = 0);
+VIGRA_EXPORT void compress(char const * source, std::size_t size, std::vector<char> & dest, CompressionMethod method,
+                           std::size_t shuffleTypeSize = 0);
 
 /** Uncompress the source buffer when the uncompressed size is known.
 
     The destination buffer must be allocated to the correct size.
 */
 VIGRA_EXPORT void uncompress(char const * source, std::size_t srcSize, 
-                             char * dest, std::size_t destSize, CompressionMethod method);
+                             char * dest, std::size_t destSize, CompressionMethod method,
+                             std::size_t shuffleTypeSize = 0);
+
+/** Reorder the bytes of an array of elements with <tt>typeSize</tt> bytes each, 
+    such that the first bytes of all elements come first, followed by all second 
+    bytes and so on. Similar bytes (e.g. the exponents of floating point numbers)
+    thus become neighbors, which makes the data much more compressible.
+    
+    Trailing bytes which do not form a complete element are copied unchanged.
+    <tt>source</tt> and <tt>dest</tt> must not overlap.
+*/
+VIGRA_EXPORT void byteShuffle(char const * source, char * dest, std::size_t size, std::size_t typeSize);
+
+/** Invert the reordering of \ref byteShuffle().
+*/
+VIGRA_EXPORT void byteUnshuffle(char const * source, char * dest, std::size_t size, std::size_t typeSize);
 
 
 } // namespace vigra
@@ -265,6 +265,38 @@
 #  define VIGRA_SHARED_PTR  std::shared_ptr
 #endif
 
+///////////////////////////////////////////////////////////
+//                                                       //
+//                       threading                       //
+//                                                       //
+///////////////////////////////////////////////////////////
+
+    // check whether the standard library provides <thread>, <mutex>, and <atomic>
+    // (if not, <vigra/threading.hxx> needs boost::thread)
+#if !defined(VIGRA_SINGLE_THREADED) && !defined(VIGRA_NO_STD_THREADING)
+# if defined(__clang__)
+#  if (!__has_include(<thread>) || !__has_include(<mutex>) || !__has_include(<atomic>))
+#    define VIGRA_NO_STD_THREADING
+#  endif
+# else
+#  if defined(__GNUC__) && (!defined(_GLIBCXX_HAS_GTHREADS) || !defined(_GLIBCXX_USE_C99_STDINT_TR1) || !defined(_GLIBCXX_USE_SCHED_YIELD))
+#    define VIGRA_NO_STD_THREADING
+#  endif
+# endif
+
+# if defined(_MSC_VER) && _MSC_VER <= 1600
+#  define VIGRA_NO_STD_THREADING
+# endif
+#endif
+
+    // VIGRA_HAS_THREADPOOL is defined when <vigra/threadpool.hxx> can be
+    // included, i.e. when threading is disabled or some implementation is
+    // available. Headers whose multi-threaded overloads are optional use it
+    // to guard these overloads.
+#if defined(VIGRA_SINGLE_THREADED) || defined(USE_BOOST_THREAD) || !defined(VIGRA_NO_STD_THREADING)
+#  define VIGRA_HAS_THREADPOOL
+#endif
+
 #ifndef VIGRA_NO_THREADSAFE_STATIC_INIT    
     // usage: 
     //   static int * p = VIGRA_SAFE_STATIC(p, new int(42));
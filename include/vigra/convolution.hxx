@@ -1078,6 +1078,11 @@ gaussianGradient(MultiArrayView<2, T1, S1> const & src,
     the squared gradient magnitude is computed for each band separately, and the
     return value is the square root of the sum of these squared magnitudes.
 
+    The arbitrary-dimensional variants never store the gradient vectors: the
+    derivative along each axis is computed into a single scalar buffer and its
+    square is accumulated directly, so the temporary memory is one scalar array
+    regardless of the dimension.
+
     <b> Declarations:</b>
 
     use arbitrary-dimensional arrays:
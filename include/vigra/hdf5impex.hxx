@@ -78,6 +78,7 @@
 #include "multi_impex.hxx"
 #include "utilities.hxx"
 #include "error.hxx"
+#include "compression.hxx"
 
 #if defined(_MSC_VER)
 #  include <io.h>
@@ -2120,6 +2121,10 @@ class HDF5File
             where 0 stands for no compression and 9 for maximum compression. If 
             a non-zero compression level is specified, but the chunk size is zero,
             a default chunk size will be chosen (compression always requires chunks).
+            Alternatively, <tt>ZSTD_FAST</tt>, <tt>ZSTD</tt> or <tt>ZSTD_BEST</tt> 
+            select Zstandard compression, which requires the HDF5 Zstandard 
+            filter plugin (filter ID 32015) at runtime. If <tt>shuffle</tt> is true,
+            the HDF5 byte shuffle filter is applied before compression.
 
             If the first character of datasetName is a "/", the path will be interpreted as absolute path,
             otherwise it will be interpreted as path relative to the current group.
@@ -2140,7 +2145,8 @@ class HDF5File
 #else
                   TinyVector<MultiArrayIndex, N> const & chunkSize = (TinyVector<MultiArrayIndex, N>()), 
 #endif
-                  int compressionParameter = 0);
+                  int compressionParameter = 0,
+                  bool shuffle = false);
 
         // for backwards compatibility
     template<int N, class T>
@@ -2695,7 +2701,8 @@ HDF5File::createDataset(std::string datasetName,
                         TinyVector<MultiArrayIndex, N> const & shape, 
                         typename detail::HDF5TypeTraits<T>::value_type init, 
                          TinyVector<MultiArrayIndex, N> const & chunkSize, 
-                         int compressionParameter)
+                         int compressionParameter,
+                         bool shuffle)
 {
     vigra_precondition(!isReadOnly(),
         "HDF5File::createDataset(): file is read-only.");
@@ -2750,7 +2757,22 @@ HDF5File::createDataset(std::string datasetName,
     // enable compression
     if(compressionParameter > 0)
     {
-        H5Pset_deflate(plist, compressionParameter);
+        // the shuffle filter must come before the compression filter
+        if(shuffle)
+            H5Pset_shuffle(plist);
+        if(compressionParameter >= ZSTD_FAST && compressionParameter <= ZSTD_BEST)
+        {
+            // ID of the Zstandard filter plugin registered with the HDF group
+            const H5Z_filter_t zstdFilter = 32015;
+            vigra_precondition(H5Zfilter_avail(zstdFilter) > 0,
+                "HDF5File::createDataset(): the HDF5 Zstandard filter plugin is not available.");
+            unsigned int level = detail::zstdCompressionLevel((CompressionMethod)compressionParameter);
+            H5Pset_filter(plist, zstdFilter, H5Z_FLAG_MANDATORY, 1, &level);
+        }
+        else
+        {
+            H5Pset_deflate(plist, compressionParameter);
+        }
     }
 
     //create the dataset.
@@ -130,7 +130,12 @@
 #define VIGRA_MULTI_ARRAY_CHUNKED_HXX
 
 #include <queue>
+#include <list>
+#include <set>
 #include <string>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
 
 #include "multi_fwd.hxx"
 #include "multi_handle.hxx"
@@ -138,6 +143,7 @@
 #include "memory.hxx"
 #include "metaprogramming.hxx"
 #include "threading.hxx"
+#include "threadpool.hxx"
 #include "compression.hxx"
 
 // // FIXME: why is this needed when compiling the Python bindng,
@@ -364,15 +370,23 @@ class SharedChunkHandle
     SharedChunkHandle()
     : pointer_(0) 
     , chunk_state_()
+    , last_access_()
+    , hits_()
     {
         chunk_state_ = chunk_uninitialized;
+        last_access_ = 0;
+        hits_ = 0;
     }
     
     SharedChunkHandle(SharedChunkHandle const & rhs)
     : pointer_(rhs.pointer_)
     , chunk_state_()
+    , last_access_()
+    , hits_()
     {
         chunk_state_ = chunk_uninitialized;
+        last_access_ = 0;
+        hits_ = 0;
     }
     
     shape_type const & strides() const
@@ -383,10 +397,273 @@ class SharedChunkHandle
     ChunkBase<N, T> * pointer_;
     mutable threading::atomic_long chunk_state_;
     
+        // time stamp of the most recent access, used by the cache policies
+    mutable threading::atomic_long last_access_;
+    
+        // number of cache hits, kept per chunk so that concurrent hits
+        // on different chunks don't write to a shared counter
+    mutable threading::atomic_long hits_;
+    
   private:
     SharedChunkHandle & operator=(SharedChunkHandle const & rhs);
 };
 
+/** \brief Eviction policies for the chunk cache of a \ref ChunkedArray.
+
+    <ul>
+    <li> <b>CACHE_FIFO</b>: Chunks are evicted in the order they were loaded. 
+         This is the default.
+    <li> <b>CACHE_LRU</b>: The least recently used chunk is evicted first. 
+         Since accesses are recorded without locking, the queue is only 
+         reordered lazily: a chunk that reaches the front of the queue and 
+         was accessed since it was queued is moved to the end.
+    <li> <b>CACHE_CLOCK</b>: Cheap approximation of LRU: a clock hand sweeps 
+         over the cache and evicts the first chunk that was not accessed 
+         since the hand last passed it. The queue is never reordered.
+    <li> <b>CACHE_SLRU</b>: Segmented LRU. Chunks that have been accessed only 
+         once since they were loaded (e.g. by a sequential scan) are evicted 
+         before chunks that were accessed repeatedly, so that a single pass 
+         over the array does not flush the working set.
+    </ul>
+    
+    An access is counted whenever a chunk is acquired by an iterator, a 
+    subarray view, or an indexing operation. Cache hits need no lock and
+    only write to the chunk's own handle. Time stamps are therefore taken 
+    from a clock that only advances on cache misses, i.e. chunks hit between 
+    the same two misses are considered equally recent. On a cache miss, FIFO and CLOCK take constant amortized time. LRU and SLRU 
+    additionally move chunks accessed since they were queued to their new 
+    position, which is searched from the recently used end of the queue. 
+    Chunks loaded by background prefetching 
+    are evicted only when no other chunk can be evicted.
+*/
+enum ChunkCachePolicy { CACHE_FIFO, CACHE_LRU, CACHE_CLOCK, CACHE_SLRU };
+
+namespace detail {
+
+    // compare time stamps such that wrap-around of the access counter is harmless
+inline bool 
+accessedBefore(long a, long b)
+{
+    return static_cast<long>(static_cast<unsigned long>(a) - static_cast<unsigned long>(b)) < 0;
+}
+
+    // Bookkeeping of the loaded chunks of a ChunkedArray. All functions
+    // must only be called while the array's chunk_lock_ is held.
+    //
+    // Accesses are only recorded as time stamps in the chunk handles (so that 
+    // cache hits need no lock). The queues are therefore ordered by the time 
+    // stamp an entry had when it was queued ('mark'). When an entry reaches 
+    // the front of its queue and was accessed in the meantime, it is re-queued 
+    // according to its new time stamp (LRU, SLRU) or gets a second chance (CLOCK). 
+    // Every re-queue is paid for by an access, and the position is searched from 
+    // the back of the queue, where recently used chunks are.
+template <class Handle>
+class ChunkCache
+{
+  public:
+    struct Entry
+    {
+        Handle * handle;
+        long mark;           // access time stamp when the entry was (re-)queued or last inspected
+        std::size_t bytes;
+        bool prefetched;     // loaded in the background and not yet accessed by the consumer
+    };
+    
+    typedef std::list<Entry> List;
+    typedef typename List::iterator iterator;
+    
+    explicit ChunkCache(ChunkCachePolicy policy = CACHE_FIFO)
+    : queue_()
+    , protected_()
+    , hand_(queue_.end())
+    , size_(0)
+    , protected_size_(0)
+    , bytes_(0)
+    , policy_(policy)
+    {}
+    
+    std::size_t size() const
+    {
+        return size_;
+    }
+    
+    std::size_t bytes() const
+    {
+        return bytes_;
+    }
+    
+    ChunkCachePolicy policy() const
+    {
+        return policy_;
+    }
+    
+    void setPolicy(ChunkCachePolicy policy)
+    {
+        policy_ = policy;
+        queue_.splice(queue_.end(), protected_);
+        protected_size_ = 0;
+        hand_ = queue_.end();
+    }
+    
+    void insert(Handle * handle, std::size_t bytes, bool prefetched = false)
+    {
+        Entry e = { handle, handle->last_access_.load(threading::memory_order_relaxed), 
+                    bytes, prefetched };
+        // new entries are placed just behind the clock hand, i.e. at the end 
+        // of the queue for all other policies
+        queue_.insert(hand_, e);
+        ++size_;
+        bytes_ += bytes;
+    }
+    
+        // remove entries whose chunk is no longer loaded
+    void removeUnloaded()
+    {
+        removeUnloaded(queue_);
+        removeUnloaded(protected_);
+    }
+    
+        // Evict chunks until the cache satisfies the given limits (a limit of 
+        // zero bytes means that memory is not bounded), or until 'how_many' 
+        // chunks have been removed. Chunks that are currently in use are skipped. 
+        // Evicted chunks are claimed for unloading (i.e. put into state chunk_locked)
+        // and appended to 'victims'. The caller must unload them, preferably after
+        // releasing the array's chunk_lock_. Returns the number of evicted chunks.
+    template <class Array>
+    std::size_t 
+    evict(Array & array, std::size_t max_size, std::size_t max_bytes, int how_many,
+          std::vector<Handle*> & victims)
+    {
+        std::size_t evicted = 0;
+        // Every entry is inspected at most twice: once to re-queue it, and once 
+        // to evict it. Prefetched chunks will be needed soon, so they are only 
+        // evicted in the second round.
+        for(std::size_t steps = 2*size_; steps > 0 && how_many > 0 && exceeds(max_size, max_bytes); --steps)
+        {
+            if(policy_ == CACHE_CLOCK && hand_ == queue_.end())
+                hand_ = queue_.begin();
+            
+            // SLRU: the protected segment may occupy at most 3/4 of the 
+            // cache (so that it can age) -- evict its excess first
+            bool from_protected = policy_ == CACHE_SLRU &&
+                                  (queue_.empty() || 
+                                   protected_size_ > 3*std::min(max_size, size_) / 4);
+            List & list = from_protected ? protected_ : queue_;
+            iterator i = policy_ == CACHE_CLOCK ? hand_ : list.begin();
+            
+            long stamp = i->handle->last_access_.load(threading::memory_order_relaxed);
+            if(stamp != i->mark)
+            {
+                // accessed since it was queued (for a prefetched chunk, the 
+                // first access by the consumer counts as its insertion)
+                bool first_access = i->prefetched;
+                i->mark = stamp;
+                i->prefetched = false;
+                if(policy_ == CACHE_CLOCK)
+                {
+                    ++hand_;
+                    continue;
+                }
+                if(policy_ != CACHE_FIFO || first_access)
+                {
+                    if(policy_ == CACHE_SLRU && !from_protected && !first_access)
+                    {
+                        // second access => promote to the protected segment
+                        protected_.splice(insertionPoint(protected_, stamp), queue_, i);
+                        ++protected_size_;
+                    }
+                    else
+                    {
+                        list.splice(insertionPoint(list, stamp), list, i);
+                    }
+                    continue;
+                }
+            }
+            if(i->prefetched && steps > size_)
+            {
+                requeue(list, i);
+                continue;
+            }
+            
+            long rc;
+            if(array.claimChunk(i->handle, rc))
+            {
+                victims.push_back(i->handle);
+                ++evicted;
+            }
+            else if(rc > 0 || rc == Handle::chunk_locked)
+            {
+                // chunk is still needed (or currently being loaded)
+                requeue(list, i);
+                continue;
+            }
+            erase(list, i);
+            --how_many;
+        }
+        return evicted;
+    }
+    
+  private:
+    bool exceeds(std::size_t max_size, std::size_t max_bytes) const
+    {
+        return size_ > max_size || (max_bytes > 0 && bytes_ > max_bytes);
+    }
+    
+        // position behind the last entry queued before 'stamp'
+    iterator insertionPoint(List & list, long stamp)
+    {
+        iterator i = list.end();
+        while(i != list.begin())
+        {
+            iterator prev = i;
+            if(!accessedBefore(stamp, (--prev)->mark))
+                break;
+            i = prev;
+        }
+        return i;
+    }
+    
+        // move an entry that is not evicted now behind the others
+    void requeue(List & list, iterator i)
+    {
+        if(policy_ == CACHE_CLOCK)
+            ++hand_;
+        else
+            list.splice(list.end(), list, i);
+    }
+    
+    iterator erase(List & list, iterator i)
+    {
+        --size_;
+        if(&list == &protected_)
+            --protected_size_;
+        bytes_ -= i->bytes;
+        bool at_hand = (&list == &queue_ && i == hand_);
+        iterator next = list.erase(i);
+        if(at_hand)
+            hand_ = next;
+        return next;
+    }
+    
+    void removeUnloaded(List & list)
+    {
+        for(iterator i = list.begin(); i != list.end();)
+        {
+            if(i->handle->chunk_state_.load() >= 0)
+                ++i;
+            else
+                i = erase(list, i);
+        }
+    }
+    
+    List queue_, protected_;   // 'protected_' holds the protected segment of CACHE_SLRU
+    iterator hand_;
+    std::size_t size_, protected_size_, bytes_;
+    ChunkCachePolicy policy_;
+};
+
+} // namespace detail
+
 template <unsigned int N, class T>
 class ChunkedArrayBase
 {
@@ -430,6 +707,17 @@ class ChunkedArrayBase
         return false;
     }
     
+        // Number of chunks that a ChunkIterator requests ahead of its 
+        // current position (0: prefetching is disabled).
+    virtual int prefetchSize() const
+    {
+        return 0;
+    }
+    
+        // Request to load the chunk with the given index in the background.
+    virtual void prefetchChunk(shape_type const &) const
+    {}
+    
     MultiArrayIndex size() const
     {
         return prod(shape_);
@@ -1269,7 +1557,12 @@ class ChunkedArrayOptions
     ChunkedArrayOptions()
     : fill_value(0.0)
     , cache_max(-1)
+    , cache_max_bytes(0)
+    , cache_policy(CACHE_FIFO)
+    , prefetch_size(0)
     , compression_method(DEFAULT_COMPRESSION)
+    , compression_threads(0)
+    , compression_shuffle(false)
     {}
     
     ChunkedArrayOptions & fillValue(double v)
@@ -1294,6 +1587,43 @@ class ChunkedArrayOptions
         return ChunkedArrayOptions(*this).cacheMax(v);
     }
     
+        // Limit the memory occupied by the cached chunks (0 means unlimited).
+        // If only this limit is given, the number of cached chunks is unbounded.
+    ChunkedArrayOptions & cacheMaxBytes(std::size_t v)
+    {
+        cache_max_bytes = v;
+        return *this;
+    }
+    
+    ChunkedArrayOptions cacheMaxBytes(std::size_t v) const
+    {
+        return ChunkedArrayOptions(*this).cacheMaxBytes(v);
+    }
+    
+    ChunkedArrayOptions & cachePolicy(ChunkCachePolicy v)
+    {
+        cache_policy = v;
+        return *this;
+    }
+    
+    ChunkedArrayOptions cachePolicy(ChunkCachePolicy v) const
+    {
+        return ChunkedArrayOptions(*this).cachePolicy(v);
+    }
+    
+        // Number of chunks a ChunkIterator loads ahead in a background 
+        // thread (0: no prefetching). Should be smaller than the cache size.
+    ChunkedArrayOptions & prefetch(int v)
+    {
+        prefetch_size = v;
+        return *this;
+    }
+    
+    ChunkedArrayOptions prefetch(int v) const
+    {
+        return ChunkedArrayOptions(*this).prefetch(v);
+    }
+    
     ChunkedArrayOptions & compression(CompressionMethod v)
     {
         compression_method = v;
@@ -1305,9 +1635,43 @@ class ChunkedArrayOptions
         return ChunkedArrayOptions(*this).compression(v);
     }
     
+        // Number of background threads which compress evicted chunks and 
+        // decompress chunks in checkoutSubarray() (ChunkedArrayCompressed only).
+        // 0 means that all work is done in the calling thread, 
+        // ParallelOptions::Auto uses one thread per core.
+    ChunkedArrayOptions & compressionThreads(int v)
+    {
+        compression_threads = v;
+        return *this;
+    }
+    
+    ChunkedArrayOptions compressionThreads(int v) const
+    {
+        return ChunkedArrayOptions(*this).compressionThreads(v);
+    }
+    
+        // Reorder the bytes of each chunk by byteShuffle() before compression
+        // (ChunkedArrayCompressed and ChunkedArrayHDF5). This usually improves
+        // the compression ratio of numeric data considerably.
+    ChunkedArrayOptions & shuffle(bool v = true)
+    {
+        compression_shuffle = v;
+        return *this;
+    }
+    
+    ChunkedArrayOptions shuffle(bool v = true) const
+    {
+        return ChunkedArrayOptions(*this).shuffle(v);
+    }
+    
     double fill_value;
     int cache_max;
+    std::size_t cache_max_bytes;
+    ChunkCachePolicy cache_policy;
+    int prefetch_size;
     CompressionMethod compression_method;
+    int compression_threads;
+    bool compression_shuffle;
 };
 
 /*
@@ -1431,7 +1795,7 @@ class ChunkedArray
     typedef ChunkBase<N, T> Chunk;
     typedef MultiArrayView<N, T, ChunkedArrayTag>                   view_type;
     typedef MultiArrayView<N, T const, ChunkedArrayTag>             const_view_type;
-    typedef std::queue<Handle*> CacheType;
+    typedef detail::ChunkCache<Handle> CacheType;
     
     static const long chunk_asleep = Handle::chunk_asleep;
     static const long chunk_uninitialized = Handle::chunk_uninitialized;
@@ -1445,16 +1809,25 @@ class ChunkedArray
     , bits_(initBitMask(this->chunk_shape_))
     , mask_(this->chunk_shape_ -shape_type(1))
     , cache_max_size_(options.cache_max)
+    , cache_max_bytes_(options.cache_max_bytes)
     , chunk_lock_(new threading::mutex())
+    , cache_(options.cache_policy)
     , fill_value_(T(options.fill_value))
     , fill_scalar_(options.fill_value)
     , handle_array_(detail::computeChunkArrayShape(shape, bits_, mask_))
-    , data_bytes_()
+    , data_bytes_(0)
     , overhead_bytes_(handle_array_.size()*sizeof(Handle))
+    , access_clock_()
+    , cache_misses_(0)
+    , cache_evictions_(0)
+    , prefetch_size_(0)
+    , prefetch_lock_(new threading::mutex())
     {
+        access_clock_ = 0;
         fill_value_chunk_.pointer_ = &fill_value_;
         fill_value_handle_.pointer_ = &fill_value_chunk_;
         fill_value_handle_.chunk_state_.store(1);
+        setPrefetchSize(options.prefetch_size);
     }
     
     static shape_type initBitMask(shape_type const & chunk_shape)
@@ -1480,6 +1853,11 @@ class ChunkedArray
         return cache_.size();
     }
     
+    std::size_t cacheBytes() const
+    {
+        return cache_.bytes();
+    }
+    
     std::size_t dataBytes() const
     {
         return data_bytes_;
@@ -1598,10 +1976,7 @@ class ChunkedArray
             unrefChunk(chunks[k]);
         
         if(cacheMaxSize() > 0)
-        {
-            threading::lock_guard<threading::mutex> guard(*chunk_lock_);
-            cleanCache(cache_.size());
-        }
+            shrinkCache();
     }
     
     long acquireRef(Handle * handle) const
@@ -1631,7 +2006,7 @@ class ChunkedArray
                 }
                 else if(rc == chunk_locked)
                 {
-                    // cache management in progress => try again later
+                    // another thread loads or unloads the chunk => try again later
                     threading::this_thread::yield();
                     rc = handle->chunk_state_.load(threading::memory_order_acquire);
                 }
@@ -1643,41 +2018,78 @@ class ChunkedArray
         }
     }
         
-    pointer getChunk(Handle * handle, bool isConst, bool insertInCache, shape_type const & chunk_index) const
+        // Record a cache hit for the cache policies and statistics. Hits get 
+        // odd time stamps, so that a hit after the chunk was queued (with the 
+        // even stamp of its cache miss) is always noticed by the cache policy.
+    void recordCacheHit(Handle * handle) const
+    {
+        handle->hits_.fetch_add(1, threading::memory_order_relaxed);
+        long stamp = access_clock_.load(threading::memory_order_relaxed) + 1;
+        if(handle->last_access_.load(threading::memory_order_relaxed) != stamp)
+            handle->last_access_.store(stamp, threading::memory_order_relaxed);
+    }
+    
+        // record a cache miss, which advances the access clock
+    void recordCacheMiss(Handle * handle) const
+    {
+        ++cache_misses_;
+        long stamp = access_clock_.fetch_add(2, threading::memory_order_relaxed) + 2;
+        handle->last_access_.store(stamp, threading::memory_order_relaxed);
+    }
+    
+    pointer getChunk(Handle * handle, bool isConst, bool insertInCache, shape_type const & chunk_index,
+                     bool isPrefetch = false) const
     {
         ChunkedArray * self = const_cast<ChunkedArray *>(this);
         
         long rc = acquireRef(handle);        
         if(rc >= 0)
+        {
+            if(handle != &fill_value_handle_)
+                recordCacheHit(handle);
             return handle->pointer_->pointer_;
+        }
 
-        threading::lock_guard<threading::mutex> guard(*chunk_lock_);
+        // We now own the chunk exclusively (its state is chunk_locked), so 
+        // it can be loaded without holding the chunk_lock_. Thus, many threads
+        // can load (and decompress) different chunks simultaneously.
+        T * p = 0;
+        std::vector<Handle*> victims;
         try
         {
-            T * p = self->loadChunk(&handle->pointer_, chunk_index);
+            // an asleep chunk may still hold memory (e.g. compressed data), 
+            // which is replaced by the loaded data
+            if(handle->pointer_ != 0)
+                self->data_bytes_ -= dataBytes(handle->pointer_);
+            p = self->loadChunk(&handle->pointer_, chunk_index);
             Chunk * chunk = handle->pointer_;
             if(!isConst && rc == chunk_uninitialized)
                 std::fill(p, p + prod(chunkShape(chunk_index)), this->fill_value_);
                 
             self->data_bytes_ += dataBytes(chunk);
+            recordCacheMiss(handle);
             
-            if(cacheMaxSize() > 0 && insertInCache)
+            threading::lock_guard<threading::mutex> guard(*chunk_lock_);
+            if(insertInCache && cacheMaxSize() > 0)
             {
                 // insert in queue of mapped chunks
-                self->cache_.push(handle);
+                self->cache_.insert(handle, dataBytes(chunk), isPrefetch);
 
                 // do cache management if cache is full
-                // (note that we still hold the chunk_lock_)
-                self->cleanCache(2);
+                self->cleanCache(2, victims);
             }
+            // publish the chunk while we still hold the lock, so that 
+            // cache management never sees a locked chunk in the cache
             handle->chunk_state_.store(1, threading::memory_order_release);
-            return p;
         }
         catch(...)
         {
             handle->chunk_state_.store(chunk_failed);
             throw;
         }
+        // unload the evicted chunks outside of the chunk_lock_
+        self->evictChunks(victims);
+        return p;
     }
     
     inline pointer 
@@ -1731,55 +2143,100 @@ class ChunkedArray
         return chunkForIteratorImpl(point, strides, upper_bound, h, true);
     }
     
-    // NOTE: This function must only be called while we hold the chunk_lock_.
-    //       This implies refcount != chunk_locked, so that race conditions are avoided.
-    long releaseChunk(Handle * handle, bool destroy = false)
+    // Obtain exclusive access to an unused chunk in order to unload it. 
+    // This succeeds if the refcount is zero (or the chunk is asleep and 
+    // 'destroy' is true). The chunk is then in state chunk_locked and must be 
+    // passed to unloadClaimedChunk(). 'rc' receives the previous chunk state.
+    bool claimChunk(Handle * handle, long & rc, bool destroy = false)
+    {
+        rc = 0;
+        if(handle->chunk_state_.compare_exchange_strong(rc, chunk_locked))
+            return true;
+        if(destroy && rc == chunk_asleep)
+            return handle->chunk_state_.compare_exchange_strong(rc, chunk_locked);
+        return false;
+    }
+    
+    void unloadClaimedChunk(Handle * handle, bool destroy = false)
     {
-        long rc = 0;
-        bool mayUnload = handle->chunk_state_.compare_exchange_strong(rc, chunk_locked);
-        if(!mayUnload && destroy)
+        try
         {
-            rc = chunk_asleep;
-            mayUnload = handle->chunk_state_.compare_exchange_strong(rc, chunk_locked);
+            vigra_invariant(handle != &fill_value_handle_,
+               "ChunkedArray::releaseChunk(): attempt to release fill_value_handle_.");
+            Chunk * chunk = handle->pointer_;
+            this->data_bytes_ -= dataBytes(chunk);
+            int didDestroy = unloadChunk(chunk, destroy);
+            this->data_bytes_ += dataBytes(chunk);
+            if(didDestroy)
+                handle->chunk_state_.store(chunk_uninitialized);
+            else
+                handle->chunk_state_.store(chunk_asleep);
+        }
+        catch(...)
+        {
+            handle->chunk_state_.store(chunk_failed);
+            throw;
         }
-        if(mayUnload)
+    }
+    
+    // unload all claimed chunks, even if some of them fail
+    void unloadChunks(std::vector<Handle*> const & chunks, std::size_t k = 0)
+    {
+        for(; k < chunks.size(); ++k)
         {
-            // refcount was zero or chunk_asleep => can unload
             try
             {
-                vigra_invariant(handle != &fill_value_handle_,
-                   "ChunkedArray::releaseChunk(): attempt to release fill_value_handle_.");
-                Chunk * chunk = handle->pointer_;
-                this->data_bytes_ -= dataBytes(chunk);
-                int didDestroy = unloadChunk(chunk, destroy);
-                this->data_bytes_ += dataBytes(chunk);
-                if(didDestroy)
-                    handle->chunk_state_.store(chunk_uninitialized);
-                else
-                    handle->chunk_state_.store(chunk_asleep);
+                unloadClaimedChunk(chunks[k]);
             }
             catch(...)
             {
-                handle->chunk_state_.store(chunk_failed);
+                unloadChunks(chunks, k+1);
                 throw;
             }
         }
+    }
+    
+    // Unload the chunk if it is not in use. Returns the previous chunk state.
+    long releaseChunk(Handle * handle, bool destroy = false)
+    {
+        long rc;
+        if(claimChunk(handle, rc, destroy))
+            unloadClaimedChunk(handle, destroy);
         return rc;
     }
     
     // NOTE: this function must only be called while we hold the chunk_lock_
-    void cleanCache(int how_many = -1)
+    void cleanCache(int how_many, std::vector<Handle*> & victims)
     {
         if(how_many == -1)
             how_many = cache_.size();
-        for(; cache_.size() > cacheMaxSize() && how_many > 0; --how_many)
+        cache_evictions_ += cache_.evict(*this, cacheMaxSize(), cacheMaxBytes(), how_many, victims);
+    }
+    
+    // Evict chunks until the cache limits are met. The evicted chunks 
+    // are unloaded after the chunk_lock_ has been released.
+    void shrinkCache(int how_many = -1)
+    {
+        std::vector<Handle*> victims;
         {
-            Handle * handle = cache_.front();
-            cache_.pop();
-            long rc = releaseChunk(handle);
-            if(rc > 0) // refcount was positive => chunk is still needed
-                cache_.push(handle);
+            threading::lock_guard<threading::mutex> guard(*chunk_lock_);
+            cleanCache(how_many, victims);
         }
+        evictChunks(victims);
+    }
+    
+        // Unload chunks which were claimed by cache management. Backends may 
+        // override this to defer the work to a background thread.
+    virtual void evictChunks(std::vector<Handle*> const & victims)
+    {
+        unloadChunks(victims);
+    }
+    
+        // Thread pool used to load the chunks of checkoutSubarray() in 
+        // parallel (0: load them sequentially in the calling thread).
+    virtual ThreadPool * loaderPool() const
+    {
+        return 0;
     }
     
         // Sends all chunks asleep which are completely inside the given ROI.
@@ -1793,11 +2250,14 @@ class ChunkedArray
     {
         checkSubarrayBounds(start, stop, "ChunkedArray::releaseChunks()");
                            
-        MultiCoordinateIterator<N> i(chunkStart(start), chunkStop(stop)),
+        // (MultiCoordinateIterator yields coordinates relative to chunk_start)
+        shape_type chunk_start(chunkStart(start));
+        MultiCoordinateIterator<N> i(chunkStop(stop) - chunk_start),
                                    end(i.getEndIterator());
         for(; i != end; ++i)
         {
-            shape_type chunkOffset = *i * this->chunk_shape_;
+            shape_type chunkIndex = chunk_start + *i,
+                       chunkOffset = chunkIndex * this->chunk_shape_;
             if(!allLessEqual(start, chunkOffset) ||
                !allLessEqual(min(chunkOffset+this->chunk_shape_, this->shape()), stop))
             {
@@ -1805,21 +2265,14 @@ class ChunkedArray
                 continue;
             }
 
-            Handle * handle = this->lookupHandle(*i);
+            Handle * handle = this->lookupHandle(chunkIndex);
             threading::lock_guard<threading::mutex> guard(*chunk_lock_);
             releaseChunk(handle, destroy);
         }
         
         // remove all chunks from the cache that are asleep or unitialized
         threading::lock_guard<threading::mutex> guard(*chunk_lock_);
-        int cache_size = cache_.size();
-        for(int k=0; k < cache_size; ++k)
-        {
-            Handle * handle = cache_.front();
-            cache_.pop();
-            if(handle->chunk_state_.load() >= 0)
-                cache_.push(handle);
-        }
+        cache_.removeUnloaded();
     }
     
     template <class U, class Stride>
@@ -1830,6 +2283,48 @@ class ChunkedArray
         shape_type stop   = start + subarray.shape();
         
         checkSubarrayBounds(start, stop, "ChunkedArray::checkoutSubarray()");
+        
+        shape_type chunk_start(chunkStart(start)), 
+                   chunk_count(chunkStop(stop) - chunk_start);
+        ThreadPool * pool = loaderPool();
+        if(pool != 0 && pool->nThreads() > 1 && prod(chunk_count) > 1)
+        {
+            // the chunks are disjoint, so they can be loaded and copied concurrently
+            ChunkedArray * self = const_cast<ChunkedArray *>(this);
+            parallel_foreach(*pool, prod(chunk_count),
+                [self, &start, &stop, &chunk_start, &chunk_count, &subarray](int, std::ptrdiff_t k)
+                {
+                    shape_type chunkIndex;
+                    detail::ScanOrderToCoordinate<N>::exec(k, chunk_count, chunkIndex);
+                    chunkIndex += chunk_start;
+                    shape_type chunkOffset = chunkIndex * self->chunk_shape_,
+                               roi_start = max(start, chunkOffset),
+                               roi_stop  = min(stop, chunkOffset + self->chunk_shape_);
+                    
+                    bool insertInCache = true;
+                    Handle * handle = self->lookupHandle(chunkIndex);
+                    if(handle->chunk_state_.load() == chunk_uninitialized)
+                    {
+                        handle = &self->fill_value_handle_;
+                        insertInCache = false;
+                    }
+                    pointer p = self->getChunk(handle, true, insertInCache, chunkIndex);
+                    try
+                    {
+                        MultiArrayView<N, T, StridedArrayTag> 
+                            chunk(self->chunkShape(chunkIndex), handle->strides(), p);
+                        subarray.subarray(roi_start - start, roi_stop - start) = 
+                            chunk.subarray(roi_start - chunkOffset, roi_stop - chunkOffset);
+                    }
+                    catch(...)
+                    {
+                        self->unrefChunk(handle);
+                        throw;
+                    }
+                    self->unrefChunk(handle);
+                });
+            return;
+        }
                            
         chunk_const_iterator i = chunk_cbegin(start, stop);
         for(; i.isValid(); ++i)
@@ -1878,20 +2373,21 @@ class ChunkedArray
         Unref * unref = new Unref(view.chunks_.size(), self);
         view.unref_ = VIGRA_SHARED_PTR<Unref>(unref);
         
-        MultiCoordinateIterator<N> i(chunk_start, chunk_stop),
+        MultiCoordinateIterator<N> i(chunk_stop - chunk_start),
                                    end(i.getEndIterator());
         for(; i != end; ++i)
         {
-            Handle * handle = self->lookupHandle(*i);
+            shape_type chunkIndex = chunk_start + *i;
+            Handle * handle = self->lookupHandle(chunkIndex);
             
             if(isConst && handle->chunk_state_.load() == chunk_uninitialized)
                 handle = &self->fill_value_handle_;
                 
             // This potentially acquires the chunk_lock_ in each iteration.
             // Would it be better to acquire it once before the loop?
-            pointer p = getChunk(handle, isConst, true, *i);
+            pointer p = getChunk(handle, isConst, true, chunkIndex);
             
-            ChunkBase<N, T> * mini_chunk = &view.chunks_[*i - chunk_start];
+            ChunkBase<N, T> * mini_chunk = &view.chunks_[*i];
             mini_chunk->pointer_ = p;
             mini_chunk->strides_ = handle->strides();
             unref->chunks_[i.scanOrderIndex()] = handle;
@@ -2012,18 +2508,139 @@ class ChunkedArray
     std::size_t cacheMaxSize() const
     {
         if(cache_max_size_ < 0)
-            const_cast<int &>(cache_max_size_) = detail::defaultCacheSize(this->chunkArrayShape());
+            const_cast<int &>(cache_max_size_) = cache_max_bytes_ > 0
+                                                     ? NumericTraits<int>::max()
+                                                     : detail::defaultCacheSize(this->chunkArrayShape());
         return cache_max_size_;
     }
     
     void setCacheMaxSize(std::size_t c)
     {
         cache_max_size_ = c;
-        if(c < cache_.size())
+        shrinkCache();
+    }
+    
+        // Memory limit of the cache in bytes (0 means unlimited).
+    std::size_t cacheMaxBytes() const
+    {
+        return cache_max_bytes_;
+    }
+    
+    void setCacheMaxBytes(std::size_t c)
+    {
+        cache_max_bytes_ = c;
+        shrinkCache();
+    }
+    
+    ChunkCachePolicy cachePolicy() const
+    {
+        return cache_.policy();
+    }
+    
+    void setCachePolicy(ChunkCachePolicy policy)
+    {
+        threading::lock_guard<threading::mutex> guard(*chunk_lock_);
+        cache_.setPolicy(policy);
+    }
+    
+        // Number of chunk accesses that found the chunk already in memory.
+    std::size_t cacheHits() const
+    {
+        threading::lock_guard<threading::mutex> guard(*chunk_lock_);
+        long hits = 0;
+        for(typename MultiArray<N, Handle>::const_iterator i = handle_array_.begin(); 
+            i != handle_array_.end(); ++i)
+            hits += i->hits_.load(threading::memory_order_relaxed);
+        return (std::size_t)hits;
+    }
+    
+        // Number of chunk accesses that had to load the chunk.
+    std::size_t cacheMisses() const
+    {
+        return cache_misses_.load();
+    }
+    
+        // Number of chunks that were unloaded by the cache policy.
+    std::size_t cacheEvictions() const
+    {
+        threading::lock_guard<threading::mutex> guard(*chunk_lock_);
+        return cache_evictions_;
+    }
+    
+    void resetCacheStatistics()
+    {
+        threading::lock_guard<threading::mutex> guard(*chunk_lock_);
+        for(typename MultiArray<N, Handle>::iterator i = handle_array_.begin(); 
+            i != handle_array_.end(); ++i)
+            i->hits_.store(0, threading::memory_order_relaxed);
+        cache_misses_ = 0;
+        cache_evictions_ = 0;
+    }
+    
+    virtual int prefetchSize() const
+    {
+        return prefetch_size_;
+    }
+    
+        // Enable (n > 0) or disable (n == 0) background loading of the next 'n' 
+        // chunks during iteration with ChunkIterator. Prefetching only applies 
+        // to backends with a cache and is not available when VIGRA is 
+        // compiled without thread support.
+    void setPrefetchSize(int n)
+    {
+        vigra_precondition(n >= 0,
+            "ChunkedArray::setPrefetchSize(): size must be non-negative.");
+        finishPrefetching();
+      #ifdef VIGRA_SINGLE_THREADED
+        n = 0;
+      #endif
+        prefetch_size_ = n;
+        if(n > 0 && !prefetch_pool_)
+            prefetch_pool_.reset(new ThreadPool(1));
+    }
+    
+        // Block until all pending prefetch requests are finished. Backends must 
+        // call this in their destructor before they release their chunks.
+    void finishPrefetching() const
+    {
+        if(prefetch_pool_)
+            prefetch_pool_->waitFinished();
+    }
+    
+    virtual void prefetchChunk(shape_type const & chunk_index) const
+    {
+      #ifndef VIGRA_SINGLE_THREADED
+        ChunkedArray * self = const_cast<ChunkedArray *>(this);
+        Handle * handle = self->lookupHandle(chunk_index);
+        
+        // only chunks that must be read from the backend are worth prefetching
+        if(prefetch_size_ == 0 || cacheMaxSize() == 0 ||
+           handle->chunk_state_.load() != chunk_asleep)
+            return;
         {
-            threading::lock_guard<threading::mutex> guard(*chunk_lock_);
-            cleanCache();
+            threading::lock_guard<threading::mutex> guard(*prefetch_lock_);
+            if(!self->prefetch_pending_.insert(handle).second)
+                return; // already requested
+        }
+        prefetch_pool_->enqueue([self, handle, chunk_index](int)
+        {
+            self->prefetchTask(handle, chunk_index);
+        });
+      #endif
+    }
+    
+    void prefetchTask(Handle * handle, shape_type const & chunk_index)
+    {
+        {
+            threading::lock_guard<threading::mutex> guard(*prefetch_lock_);
+            prefetch_pending_.erase(handle);
         }
+        // skip the chunk if the consumer got there first
+        // (errors are reported when the consumer accesses the failed chunk)
+        if(handle->chunk_state_.load() != chunk_asleep)
+            return;
+        getChunk(handle, true, true, chunk_index, true);
+        unrefChunk(handle);
     }
     
     iterator begin()
@@ -2091,6 +2708,7 @@ class ChunkedArray
     
     shape_type bits_, mask_;
     int cache_max_size_;
+    std::size_t cache_max_bytes_;
     VIGRA_SHARED_PTR<threading::mutex> chunk_lock_;
     CacheType cache_;
     Chunk fill_value_chunk_;
@@ -2098,7 +2716,14 @@ class ChunkedArray
     value_type fill_value_;
     double fill_scalar_;
     MultiArray<N, Handle> handle_array_;
-    std::size_t data_bytes_, overhead_bytes_; 
+    threading::atomic<std::size_t> data_bytes_, overhead_bytes_; 
+    mutable threading::atomic_long access_clock_;
+    mutable threading::atomic_long cache_misses_;
+    std::size_t cache_evictions_;
+    int prefetch_size_;
+    VIGRA_SHARED_PTR<ThreadPool> prefetch_pool_;
+    VIGRA_SHARED_PTR<threading::mutex> prefetch_lock_;
+    std::set<Handle*> prefetch_pending_;
 };
 
 /** Returns a CoupledScanOrderIterator to simultaneously iterate over image m1 and its coordinates. 
@@ -2426,14 +3051,15 @@ class ChunkedArrayCompressed
             compressed_.clear();
         }
                 
-        void compress(CompressionMethod method)
+        void compress(CompressionMethod method, std::size_t shuffleTypeSize = 0)
         {
             if(this->pointer_ != 0)
             {
                 vigra_invariant(compressed_.size() == 0,
                     "ChunkedArrayCompressed::Chunk::compress(): compressed and uncompressed pointer are both non-zero.");
 
-                ::vigra::compress((char const *)this->pointer_, size_*sizeof(T), compressed_, method);
+                ::vigra::compress((char const *)this->pointer_, size_*sizeof(T), compressed_, 
+                                  method, shuffleTypeSize);
 
                 // std::cerr << "compression ratio: " << double(compressed_.size())/(this->size()*sizeof(T)) << "\n";
                 detail::destroy_dealloc_n(this->pointer_, size_, alloc_);
@@ -2441,7 +3067,7 @@ class ChunkedArrayCompressed
             }
         }
         
-        pointer uncompress(CompressionMethod method)
+        pointer uncompress(CompressionMethod method, std::size_t shuffleTypeSize = 0)
         {
             if(this->pointer_ == 0)
             {
@@ -2450,7 +3076,8 @@ class ChunkedArrayCompressed
                     this->pointer_ = alloc_.allocate((typename Alloc::size_type)size_);
 
                     ::vigra::uncompress(compressed_.data(), compressed_.size(), 
-                                        (char*)this->pointer_, size_*sizeof(T), method);
+                                        (char*)this->pointer_, size_*sizeof(T), 
+                                        method, shuffleTypeSize);
                     compressed_.clear();
                 }
                 else
@@ -2476,22 +3103,43 @@ class ChunkedArrayCompressed
     
     typedef MultiArray<N, SharedChunkHandle<N, T> > ChunkStorage;
     typedef typename ChunkStorage::difference_type  shape_type;
+    typedef typename ChunkedArray<N, T>::Handle Handle;
     typedef T value_type;
     typedef value_type * pointer;
     typedef value_type & reference;
     
+        /** Construct with given 'shape', 'chunk_shape' and 'options'.
+        
+            If <tt>options.compression_threads</tt> is non-zero, evicted chunks are 
+            compressed in a background thread pool, and checkoutSubarray() 
+            decompresses the required chunks in parallel.
+        */
     explicit ChunkedArrayCompressed(shape_type const & shape, 
                                     shape_type const & chunk_shape=shape_type(),
                                     ChunkedArrayOptions const & options = ChunkedArrayOptions())
     : ChunkedArray<N, T>(shape, chunk_shape, options),
-       compression_method_(options.compression_method)
+       compression_method_(options.compression_method),
+       shuffle_type_size_(options.compression_shuffle 
+                             ? sizeof(typename ExpandElementResult<T>::type)
+                             : 0),
+       pending_compressions_(0)
     {
         if(compression_method_ == DEFAULT_COMPRESSION)
             compression_method_ = LZ4;
+      #ifndef VIGRA_SINGLE_THREADED
+        if(options.compression_threads != 0)
+        {
+            int n = ParallelOptions().numThreads(options.compression_threads).getActualNumThreads();
+            if(n > 0)
+                compression_pool_.reset(new ThreadPool(n));
+        }
+      #endif
     }
     
     ~ChunkedArrayCompressed()
     {
+        this->finishPrefetching();
+        finishCompression();
         typename ChunkStorage::iterator i   = this->handle_array_.begin(), 
                                         end = this->handle_array_.end();
         for(; i != end; ++i)
@@ -2509,7 +3157,7 @@ class ChunkedArrayCompressed
             *p = new Chunk(this->chunkShape(index));
             this->overhead_bytes_ += sizeof(Chunk);
         }
-        return static_cast<Chunk *>(*p)->uncompress(compression_method_);
+        return static_cast<Chunk *>(*p)->uncompress(compression_method_, shuffle_type_size_);
     }
     
     virtual bool unloadChunk(ChunkBase<N, T> * chunk, bool destroy)
@@ -2517,26 +3165,107 @@ class ChunkedArrayCompressed
         if(destroy)
             static_cast<Chunk *>(chunk)->deallocate();
         else
-            static_cast<Chunk *>(chunk)->compress(compression_method_);
+            static_cast<Chunk *>(chunk)->compress(compression_method_, shuffle_type_size_);
         return destroy;
     }
     
-    virtual std::string backend() const
+        // With a compression pool, evicted chunks are sent asleep uncompressed 
+        // (loadChunk() simply reuses their data when they are needed again 
+        // before the background thread got to them). Until then, their 
+        // uncompressed size remains in dataBytes(), and getChunk() replaces it 
+        // by the loaded size upon reactivation. At most maxPendingCompressions() 
+        // uncompressed chunks may be asleep at any time, further victims 
+        // are compressed in the calling thread.
+    virtual void evictChunks(std::vector<Handle*> const & victims)
     {
-        switch(compression_method_)
+      #ifndef VIGRA_SINGLE_THREADED
+        if(compression_pool_)
         {
-          case ZLIB:
-            return "ChunkedArrayCompressed<ZLIB>";
-          case ZLIB_NONE:
-            return "ChunkedArrayCompressed<ZLIB_NONE>";
-          case ZLIB_FAST:
-            return "ChunkedArrayCompressed<ZLIB_FAST>";
-          case ZLIB_BEST:
-            return "ChunkedArrayCompressed<ZLIB_BEST>";
-          case LZ4:
-            return "ChunkedArrayCompressed<LZ4>";
-          default:
-            return "unknown";
+            std::vector<Handle*> inline_victims;
+            for(std::size_t k=0; k<victims.size(); ++k)
+            {
+                Handle * handle = victims[k];
+                if(pending_compressions_.fetch_add(1) >= maxPendingCompressions())
+                {
+                    --pending_compressions_;
+                    inline_victims.push_back(handle);
+                    continue;
+                }
+                handle->chunk_state_.store(this->chunk_asleep);
+                compression_pool_->enqueue([this, handle](int)
+                {
+                    this->compressTask(handle);
+                });
+            }
+            this->unloadChunks(inline_victims);
+            return;
+        }
+      #endif
+        this->unloadChunks(victims);
+    }
+    
+    void compressTask(Handle * handle)
+    {
+        // skip the chunk if it was reloaded or destroyed in the meantime
+        // (errors are reported when the chunk is accessed the next time)
+        --pending_compressions_;
+        long rc = this->chunk_asleep;
+        if(handle->chunk_state_.compare_exchange_strong(rc, this->chunk_locked))
+            this->unloadClaimedChunk(handle);
+    }
+    
+        /** Maximum number of evicted chunks waiting for background compression.
+        */
+    long maxPendingCompressions() const
+    {
+        return 4*compressionThreads();
+    }
+    
+    virtual ThreadPool * loaderPool() const
+    {
+        return compression_pool_.get();
+    }
+    
+        /** Number of threads used for background compression
+            (0: compression happens in the calling thread).
+        */
+    int compressionThreads() const
+    {
+        return compression_pool_
+                  ? (int)compression_pool_->nThreads()
+                  : 0;
+    }
+    
+        /** Block until all evicted chunks are compressed.
+        */
+    void finishCompression() const
+    {
+        if(compression_pool_)
+            compression_pool_->waitFinished();
+    }
+    
+    virtual std::string backend() const
+    {
+        switch(compression_method_)
+        {
+          case ZLIB:
+            return "ChunkedArrayCompressed<ZLIB>";
+          case ZLIB_NONE:
+            return "ChunkedArrayCompressed<ZLIB_NONE>";
+          case ZLIB_FAST:
+            return "ChunkedArrayCompressed<ZLIB_FAST>";
+          case ZLIB_BEST:
+            return "ChunkedArrayCompressed<ZLIB_BEST>";
+          case LZ4:
+            return "ChunkedArrayCompressed<LZ4>";
+          case ZSTD_FAST:
+            return "ChunkedArrayCompressed<ZSTD_FAST>";
+          case ZSTD:
+            return "ChunkedArrayCompressed<ZSTD>";
+          case ZSTD_BEST:
+            return "ChunkedArrayCompressed<ZSTD_BEST>";
+          default:
+            return "unknown";
         }
     }
     
@@ -2553,6 +3282,9 @@ class ChunkedArrayCompressed
     }
         
     CompressionMethod compression_method_;
+    std::size_t shuffle_type_size_;
+    threading::atomic_long pending_compressions_;
+    VIGRA_SHARED_PTR<ThreadPool> compression_pool_;
 };
 
 template <unsigned int N, class T>
@@ -2705,6 +3437,7 @@ class ChunkedArrayTmpFile
     
     ~ChunkedArrayTmpFile()
     {
+        this->finishPrefetching();
         typename ChunkStorage::iterator  i = this->handle_array_.begin(), 
                                          end = this->handle_array_.end();
         for(; i != end; ++i)
@@ -2728,6 +3461,8 @@ class ChunkedArrayTmpFile
             shape_type shape = this->chunkShape(index);
             std::size_t chunk_size = computeAllocSize(shape);
         #ifdef VIGRA_NO_SPARSE_FILE
+            // chunks may be loaded concurrently => serialize file allocation
+            threading::lock_guard<threading::mutex> guard(file_lock_);
             std::size_t offset = file_size_;
             if(offset + chunk_size > file_capacity_)
             {
@@ -2779,6 +3514,539 @@ class ChunkedArrayTmpFile
   #endif
     FileHandle file_, mappedFile_;  // the file back-end
     std::size_t file_size_, file_capacity_;
+  #ifdef VIGRA_NO_SPARSE_FILE
+    threading::mutex file_lock_;
+  #endif
+};
+
+namespace detail {
+
+    // Modes of mapFileRegion(). Copy-on-write mappings can be modified in 
+    // memory, but the changes never reach the file.
+enum FileMapMode { MapReadWrite, MapReadOnly, MapCopyOnWrite };
+
+#ifdef _WIN32
+
+inline void * mapFileRegion(HANDLE mapping, std::size_t offset, std::size_t size, 
+                            FileMapMode mode, std::string const & message)
+{
+    static const std::size_t bits = sizeof(DWORD)*8,
+                             mask = (std::size_t(1) << bits) - 1;
+    DWORD access = mode == MapReadOnly 
+                       ? FILE_MAP_READ 
+                       : mode == MapCopyOnWrite 
+                             ? FILE_MAP_COPY 
+                             : FILE_MAP_ALL_ACCESS;
+    void * res = MapViewOfFile(mapping, access,
+                               std::size_t(offset) >> bits, offset & mask, size);
+    if(res == 0)
+        winErrorToException(message);
+    return res;
+}
+
+inline void unmapFileRegion(void * p, std::size_t)
+{
+    ::UnmapViewOfFile(p);
+}
+
+#else
+
+inline void * mapFileRegion(int file, std::size_t offset, std::size_t size, 
+                            FileMapMode mode, std::string const & message)
+{
+    void * res = mmap(0, size, mode == MapReadOnly ? PROT_READ : PROT_READ | PROT_WRITE, 
+                      mode == MapCopyOnWrite ? MAP_PRIVATE : MAP_SHARED,
+                      file, offset);
+    if(res == MAP_FAILED)
+        throw std::runtime_error(message + "mmap() failed.");
+    return res;
+}
+
+inline void unmapFileRegion(void * p, std::size_t size)
+{
+    munmap(p, size);
+}
+
+#endif
+
+    // fixed part of the file header of ChunkedArrayMmap
+template <unsigned int N>
+struct ChunkedFileHeader
+{
+    typedef typename MultiArrayShape<N>::type shape_type;
+    
+    static const UInt32 version = 1;
+    static const UInt32 byte_order_mark = 0x01020304;
+    
+    static std::size_t size()
+    {
+        return 48 + 16*N;
+    }
+    
+    static char const * magic()
+    {
+        return "VIGRAMAP";
+    }
+    
+    ChunkedFileHeader()
+    : value_size(0)
+    , band_count(0)
+    , scalar_kind(0)
+    , alignment(0)
+    , fill_value(0.0)
+    {}
+    
+    template <class U>
+    static void put(char * buffer, std::size_t offset, U value)
+    {
+        std::memcpy(buffer + offset, &value, sizeof(U));
+    }
+    
+    template <class U>
+    static U get(char const * buffer, std::size_t offset)
+    {
+        U value;
+        std::memcpy(&value, buffer + offset, sizeof(U));
+        return value;
+    }
+    
+    void write(char * buffer) const
+    {
+        std::memcpy(buffer, magic(), 8);
+        put<UInt32>(buffer,  8, version);
+        put<UInt32>(buffer, 12, byte_order_mark);
+        put<UInt32>(buffer, 16, N);
+        put<UInt32>(buffer, 20, value_size);
+        put<UInt32>(buffer, 24, band_count);
+        put<UInt32>(buffer, 28, scalar_kind);
+        put<UInt64>(buffer, 32, alignment);
+        put<double>(buffer, 40, fill_value);
+        for(unsigned int k=0; k<N; ++k)
+        {
+            put<Int64>(buffer, 48 + 8*k, shape[k]);
+            put<Int64>(buffer, 48 + 8*(N+k), chunk_shape[k]);
+        }
+    }
+    
+    void read(char const * buffer)
+    {
+        vigra_precondition(std::memcmp(buffer, magic(), 8) == 0,
+            "ChunkedArrayMmap(): file is not a ChunkedArrayMmap file.");
+        vigra_precondition(get<UInt32>(buffer, 8) == version,
+            "ChunkedArrayMmap(): unsupported file format version.");
+        vigra_precondition(get<UInt32>(buffer, 12) == byte_order_mark,
+            "ChunkedArrayMmap(): file was written on a machine with different byte order.");
+        vigra_precondition(get<UInt32>(buffer, 16) == N,
+            "ChunkedArrayMmap(): dimension mismatch between file and array.");
+        value_size = get<UInt32>(buffer, 20);
+        band_count = get<UInt32>(buffer, 24);
+        scalar_kind = get<UInt32>(buffer, 28);
+        alignment  = get<UInt64>(buffer, 32);
+        fill_value = get<double>(buffer, 40);
+        for(unsigned int k=0; k<N; ++k)
+        {
+            shape[k]       = get<Int64>(buffer, 48 + 8*k);
+            chunk_shape[k] = get<Int64>(buffer, 48 + 8*(N+k));
+        }
+    }
+    
+    static ChunkedFileHeader read(std::string const & filename)
+    {
+        ArrayVector<char> buffer(size());
+        FILE * file = std::fopen(filename.c_str(), "rb");
+        vigra_precondition(file != 0,
+            "ChunkedArrayMmap(): unable to open file '" + filename + "'.");
+        std::size_t count = std::fread(buffer.data(), 1, buffer.size(), file);
+        std::fclose(file);
+        vigra_precondition(count == buffer.size(),
+            "ChunkedArrayMmap(): file is not a ChunkedArrayMmap file.");
+        ChunkedFileHeader res;
+        res.read(buffer.data());
+        return res;
+    }
+    
+    shape_type shape, chunk_shape;
+    UInt32 value_size, band_count, scalar_kind;
+    UInt64 alignment;
+    double fill_value;
+};
+
+} // namespace detail
+
+/** Implementation of ChunkedArray which stores the data in a named, persistent 
+    memory-mapped file.
+    
+    In contrast to ChunkedArrayTmpFile, the file survives the array object and can be 
+    reopened later. Opening an existing file only reads its small header, so that 
+    startup is instantaneous even for huge arrays. Chunks are mapped into memory 
+    on demand and accessed without any copying or parsing, and the operating 
+    system's page cache decides which data actually reside in RAM. The file 
+    is created as a sparse file when the file system supports it.
+    
+    <b>File layout</b> (all numbers in the byte order of the creating machine, 
+    which is checked by means of a byte order mark):
+    
+    <table>
+    <tr><th>Offset</th><th>Type</th><th>Content</th></tr>
+    <tr><td>0</td><td>char[8]</td><td>magic string "VIGRAMAP"</td></tr>
+    <tr><td>8</td><td>UInt32</td><td>format version (currently 1)</td></tr>
+    <tr><td>12</td><td>UInt32</td><td>byte order mark 0x01020304</td></tr>
+    <tr><td>16</td><td>UInt32</td><td>dimension N</td></tr>
+    <tr><td>20</td><td>UInt32</td><td>size of the value type in bytes</td></tr>
+    <tr><td>24</td><td>UInt32</td><td>number of scalar bands per element</td></tr>
+    <tr><td>28</td><td>UInt32</td><td>kind of the scalar type: 1 (signed integer), 
+        2 (unsigned integer) or 3 (floating point)</td></tr>
+    <tr><td>32</td><td>UInt64</td><td>alignment A of the chunks in the file</td></tr>
+    <tr><td>40</td><td>double</td><td>fill value</td></tr>
+    <tr><td>48</td><td>Int64[N]</td><td>array shape</td></tr>
+    <tr><td>48+8N</td><td>Int64[N]</td><td>chunk shape</td></tr>
+    <tr><td>48+16N</td><td>UInt8[C]</td><td>status of the C chunks: 0 if the chunk was never 
+        written (it then holds the fill value), 1 otherwise</td></tr>
+    <tr><td>D</td><td></td><td>chunk data</td></tr>
+    </table>
+    
+    The chunk data start at offset <tt>D = 48+16N+C</tt>, rounded up to a multiple of A. 
+    The chunks are stored in scan order of the chunk grid (first index 
+    changing fastest), each one padded to a multiple of A bytes. The chunks at 
+    the upper array border are clipped to the array shape. The elements within 
+    a chunk are stored in scan order as well.
+    
+    A is the memory mapping granularity of the creating machine (page size or 
+    allocation granularity), and reopening a file requires that it is a multiple of 
+    the granularity of the current machine.
+    
+    <b>\#include</b> \<vigra/multi_array_chunked.hxx\> <br/>
+    Namespace: vigra
+*/
+template <unsigned int N, class T>
+class ChunkedArrayMmap
+: public ChunkedArray<N, T>
+{
+  public:
+#ifdef _WIN32
+    typedef HANDLE FileHandle;
+#else
+    typedef int FileHandle;
+#endif    
+    
+    class Chunk
+    : public ChunkBase<N, T>
+    {
+      public:
+        typedef typename MultiArrayShape<N>::type  shape_type;
+        typedef T value_type;
+        typedef value_type * pointer;
+        typedef value_type & reference;
+        
+        Chunk(shape_type const & shape,
+              std::size_t offset, size_t alloc_size,
+              FileHandle file, bool read_only) 
+        : ChunkBase<N, T>(detail::defaultStride(shape))
+        , offset_(offset)
+        , alloc_size_(alloc_size)
+        , file_(file)
+        , read_only_(read_only)
+        {}
+        
+        ~Chunk()
+        {
+            unmap();
+        }
+        
+        pointer map()
+        {
+            if(this->pointer_ == 0)
+            {
+                // chunks of a read-only file are mapped copy-on-write: non-const 
+                // iterators (and the fill value of never written chunks) may 
+                // modify them in memory, just as with the other read-only backends
+                this->pointer_ = (pointer)detail::mapFileRegion(file_, offset_, alloc_size_, 
+                                                                read_only_ ? detail::MapCopyOnWrite
+                                                                           : detail::MapReadWrite,
+                                                                "ChunkedArrayMmap::Chunk::map(): ");
+            }
+            return this->pointer_;
+        }
+                
+        void unmap()
+        {
+            if(this->pointer_ != 0)
+            {
+                detail::unmapFileRegion(this->pointer_, alloc_size_);
+                this->pointer_ = 0;
+            }
+        }
+        
+        std::size_t offset_, alloc_size_;
+        FileHandle file_;
+        bool read_only_;
+        
+      private:
+        Chunk & operator=(Chunk const &);
+    };
+
+    typedef MultiArray<N, SharedChunkHandle<N, T>  > ChunkStorage;
+    typedef MultiArray<N, std::size_t>               OffsetStorage;
+    typedef typename ChunkStorage::difference_type   shape_type;
+    typedef detail::ChunkedFileHeader<N>             Header;
+    typedef typename ExpandElementResult<T>::type    scalar_type;
+    typedef T value_type;
+    typedef value_type * pointer;
+    typedef value_type & reference;
+    
+        /** Create a new file 'filename' (an existing file is overwritten).
+        */
+    ChunkedArrayMmap(std::string const & filename,
+                     shape_type const & shape,
+                     shape_type const & chunk_shape=shape_type(),
+                     ChunkedArrayOptions const & options = ChunkedArrayOptions())
+    : ChunkedArray<N, T>(shape, chunk_shape, options)
+    , filename_(filename)
+    , read_only_(false)
+    , alignment_(mmap_alignment)
+    {
+        vigra_precondition(this->size() > 0,
+            "ChunkedArrayMmap(): invalid shape.");
+        Header header;
+        header.shape = this->shape_;
+        header.chunk_shape = this->chunk_shape_;
+        header.value_size = sizeof(T);
+        header.band_count = ExpandElementResult<T>::size;
+        header.scalar_kind = scalarKind();
+        header.alignment = alignment_;
+        header.fill_value = this->fill_scalar_;
+        
+        init(true);
+        header.write(header_);
+    }
+    
+        /** Open the existing file 'filename'. Shape and chunk shape are read from the 
+            file, and so is the fill value (overriding <tt>options.fill_value</tt>).
+            When <tt>read_only</tt> is true, the file is never modified: data written 
+            through non-const iterators only change the in-memory copy of a chunk 
+            and are lost when the chunk is evicted from the cache.
+        */
+    explicit ChunkedArrayMmap(std::string const & filename,
+                              bool read_only = false,
+                              ChunkedArrayOptions const & options = ChunkedArrayOptions())
+    : ChunkedArrayMmap(filename, Header::read(filename), read_only, options)
+    {}
+    
+    ~ChunkedArrayMmap()
+    {
+        this->finishPrefetching();
+        typename ChunkStorage::iterator  i = this->handle_array_.begin(), 
+                                         end = this->handle_array_.end();
+        for(; i != end; ++i)
+        {
+            if(i->pointer_)
+                delete static_cast<Chunk*>(i->pointer_);
+            i->pointer_ = 0;
+        }
+        detail::unmapFileRegion(header_, data_offset_);
+    #ifdef _WIN32
+        ::CloseHandle(mappedFile_);
+        ::CloseHandle(file_);
+    #else
+        ::close(file_);
+    #endif
+    }
+    
+    std::size_t computeAllocSize(shape_type const & shape) const
+    {
+        std::size_t size = prod(shape)*sizeof(T);
+        std::size_t mask = alignment_ - 1;
+        return (size + mask) & ~mask;
+    }
+    
+    virtual pointer loadChunk(ChunkBase<N, T> ** p, shape_type const & index)
+    {
+        if(*p == 0)
+        {
+            shape_type shape = this->chunkShape(index);
+            *p = new Chunk(shape, offset_array_[index], computeAllocSize(shape), 
+                           mappedFile_, read_only_);
+            this->overhead_bytes_ += sizeof(Chunk);
+        }
+        pointer res = static_cast<Chunk*>(*p)->map();
+        if(!read_only_)
+        {
+            // the chunk is about to receive data => remember this in the file
+            UInt8 & status = chunk_status_[dot(index, offset_array_.stride())];
+            if(status == 0)
+                status = 1;
+        }
+        return res;
+    }
+
+    virtual bool unloadChunk(ChunkBase<N, T> * chunk, bool /* destroy*/)
+    {
+        static_cast<Chunk *>(chunk)->unmap();
+        return false; // never destroys the data
+    }
+    
+    virtual std::string backend() const
+    {
+        return "ChunkedArrayMmap";
+    }
+    
+    virtual bool isReadOnly() const
+    {
+        return read_only_;
+    }
+    
+        /** Name of the underlying file.
+        */
+    std::string const & fileName() const
+    {
+        return filename_;
+    }
+    
+        /** Total size of the file in bytes.
+        */
+    std::size_t fileSize() const
+    {
+        return file_size_;
+    }
+
+    virtual std::size_t dataBytes(ChunkBase<N,T> * c) const
+    {
+        return c->pointer_ == 0
+                 ? 0
+                 : static_cast<Chunk*>(c)->alloc_size_;
+    }
+    
+    virtual std::size_t overheadBytesPerChunk() const
+    {
+        return sizeof(Chunk) + sizeof(SharedChunkHandle<N, T>) + sizeof(std::size_t);
+    }
+    
+  private:
+  
+    static UInt32 scalarKind()
+    {
+        return NumericTraits<scalar_type>::isIntegral::value
+                   ? NumericTraits<scalar_type>::isSigned::value
+                         ? 1
+                         : 2
+                   : 3;
+    }
+  
+    ChunkedArrayMmap(std::string const & filename, Header const & header,
+                     bool read_only, ChunkedArrayOptions const & options)
+    : ChunkedArray<N, T>(header.shape, header.chunk_shape, 
+                         ChunkedArrayOptions(options).fillValue(header.fill_value))
+    , filename_(filename)
+    , read_only_(read_only)
+    , alignment_(header.alignment)
+    {
+        vigra_precondition(header.value_size == sizeof(T) && 
+                           header.band_count == (UInt32)ExpandElementResult<T>::size &&
+                           header.scalar_kind == scalarKind(),
+            "ChunkedArrayMmap(): value type mismatch between file and array.");
+        vigra_precondition(this->chunk_shape_ == header.chunk_shape,
+            "ChunkedArrayMmap(): invalid chunk shape in file.");
+        vigra_precondition(alignment_ > 0 && alignment_ % mmap_alignment == 0,
+            "ChunkedArrayMmap(): file alignment is incompatible with this machine.");
+        
+        init(false);
+        
+        typename ChunkStorage::iterator i   = this->handle_array_.begin(), 
+                                        end = this->handle_array_.end();
+        for(UInt8 const * status = chunk_status_; i != end; ++i, ++status)
+        {
+            if(*status != 0)
+                i->chunk_state_.store(this->chunk_asleep);
+        }
+    }
+    
+    void init(bool create)
+    {
+        // compute the chunk offsets in the file
+        offset_array_.reshape(this->chunkArrayShape());
+        std::size_t mask = alignment_ - 1;
+        data_offset_ = (Header::size() + offset_array_.size() + mask) & ~mask;
+        
+        typename OffsetStorage::iterator i = offset_array_.begin(), 
+                                         end = offset_array_.end();
+        std::size_t size = data_offset_;
+        for(; i != end; ++i)
+        {
+            *i = size;
+            size += computeAllocSize(this->chunkShape(i.point()));
+        }
+        file_size_ = size;
+        this->overhead_bytes_ += offset_array_.size()*sizeof(std::size_t);
+        
+    #ifdef _WIN32
+        file_ = ::CreateFile(filename_.c_str(), 
+                             read_only_ ? GENERIC_READ : GENERIC_READ | GENERIC_WRITE,
+                             FILE_SHARE_READ, NULL, 
+                             create ? CREATE_ALWAYS : OPEN_EXISTING, 
+                             FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file_ == INVALID_HANDLE_VALUE) 
+            winErrorToException("ChunkedArrayMmap(): ");
+        if(create)
+        {
+            DWORD dwTemp;
+            if(!::DeviceIoControl(file_, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &dwTemp, NULL))
+                winErrorToException("ChunkedArrayMmap(): ");
+        }
+        else
+        {
+            LARGE_INTEGER actual_size;
+            if(!::GetFileSizeEx(file_, &actual_size))
+                winErrorToException("ChunkedArrayMmap(): ");
+            vigra_precondition(std::size_t(actual_size.QuadPart) >= file_size_,
+                "ChunkedArrayMmap(): file is truncated.");
+        }
+        
+        // (creating the mapping resizes a new file)
+        static const std::size_t bits = sizeof(LONG)*8, bitmask = (std::size_t(1) << bits) - 1;
+        mappedFile_ = CreateFileMapping(file_, NULL, read_only_ ? PAGE_READONLY : PAGE_READWRITE, 
+                                        file_size_ >> bits, file_size_ & bitmask, NULL);
+        if(!mappedFile_)
+            winErrorToException("ChunkedArrayMmap(): ");
+    #else
+        mappedFile_ = file_ = create
+                                 ? ::open(filename_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)
+                                 : ::open(filename_.c_str(), read_only_ ? O_RDONLY : O_RDWR);
+        if(file_ == -1)
+            throw std::runtime_error("ChunkedArrayMmap(): unable to open file '" + filename_ + "'.");
+        if(create)
+        {
+            // a sparse file: disk space is only allocated when chunks are written
+            if(::ftruncate(file_, file_size_) == -1)
+            {
+                ::close(file_);
+                throw std::runtime_error("ChunkedArrayMmap(): unable to resize file.");
+            }
+        }
+        else
+        {
+            struct stat info;
+            if(::fstat(file_, &info) == -1 || std::size_t(info.st_size) < file_size_)
+            {
+                ::close(file_);
+                vigra_precondition(false, "ChunkedArrayMmap(): file is truncated.");
+            }
+        }
+    #endif
+        
+        header_ = (char *)detail::mapFileRegion(mappedFile_, 0, data_offset_, 
+                                                read_only_ ? detail::MapReadOnly : detail::MapReadWrite, 
+                                                "ChunkedArrayMmap(): ");
+        chunk_status_ = (UInt8 *)header_ + Header::size();
+    }
+    
+    std::string filename_;
+    bool read_only_;
+    std::size_t alignment_;
+    OffsetStorage offset_array_;  // the file offsets of the chunks
+    FileHandle file_, mappedFile_;  // the file back-end
+    std::size_t file_size_, data_offset_;
+    char * header_;         // the mapped header
+    UInt8 * chunk_status_;  // the chunk status table in the header
 };
 
 template<unsigned int N, class U>
@@ -2909,9 +4177,29 @@ class ChunkIterator
     {
         base_type::operator++();
         getChunk();
+        prefetch();
         return *this;
     }
     
+        // ask the array to load the chunks following the current one 
+        // in the background (a no-op unless prefetching is enabled)
+    void prefetch() const
+    {
+        if(!array_)
+            return;
+        MultiArrayIndex count = std::min<MultiArrayIndex>(array_->prefetchSize(),
+                    prod(base_type::shape()) - base_type::scanOrderIndex() - 1);
+        if(count <= 0)
+            return;
+        shape_type chunk_offset = chunk_.offset_ / chunk_shape_;
+        base_type i(*this);
+        for(MultiArrayIndex k=0; k<count; ++k)
+        {
+            ++i;
+            array_->prefetchChunk(chunk_offset + *i);
+        }
+    }
+    
     ChunkIterator operator++(int)
     {
         ChunkIterator res(*this);
@@ -91,6 +91,8 @@ class ChunkedArrayHDF5
             {
                 if(!array_->file_.isReadOnly())
                 {
+                    // the HDF5 library is not thread-safe
+                    threading::lock_guard<threading::mutex> guard(array_->io_lock_);
                     herr_t status = array_->file_.writeBlock(array_->dataset_, start_, 
                                           MultiArrayView<N, T>(shape_, this->strides_, this->pointer_));
                     vigra_postcondition(status >= 0,
@@ -109,6 +111,7 @@ class ChunkedArrayHDF5
             if(this->pointer_ == 0)
             {
                 this->pointer_ = alloc_.allocate(this->size());
+                threading::lock_guard<threading::mutex> guard(array_->io_lock_);
                 herr_t status = array_->file_.readBlock(array_->dataset_, start_, shape_, 
                                      MultiArrayView<N, T>(shape_, this->strides_, this->pointer_));
                 vigra_postcondition(status >= 0,
@@ -143,6 +146,7 @@ class ChunkedArrayHDF5
       dataset_name_(dataset),
       dataset_(),
       compression_(options.compression_method),
+      shuffle_(options.compression_shuffle),
       alloc_(alloc)
     {
         init(mode);
@@ -157,6 +161,7 @@ class ChunkedArrayHDF5
       dataset_name_(dataset),
       dataset_(),
       compression_(options.compression_method),
+      shuffle_(options.compression_shuffle),
       alloc_(alloc)
     {
         init(mode);
@@ -218,7 +223,8 @@ class ChunkedArrayHDF5
                                                  this->shape_, 
                                                  init,
                                                  this->chunk_shape_, 
-                                                 compression_);
+                                                 compression_,
+                                                 shuffle_);
         }
         else
         {
@@ -281,6 +287,7 @@ class ChunkedArrayHDF5
     
     void closeImpl(bool force_destroy)
     {
+        this->finishPrefetching();
         flushToDiskImpl(true, force_destroy);
         file_.close();
     }
@@ -381,7 +388,9 @@ class ChunkedArrayHDF5
     std::string dataset_name_;
     HDF5HandleShared dataset_;
     CompressionMethod compression_;
+    bool shuffle_;
     Alloc alloc_;
+    threading::mutex io_lock_;
 };
 
 } // namespace vigra
@@ -39,6 +39,7 @@
 #define VIGRA_MULTI_CONVOLUTION_H
 
 #include "separableconvolution.hxx"
+#include "recursiveconvolution.hxx"
 #include "array_vector.hxx"
 #include "multi_array.hxx"
 #include "accessor.hxx"
@@ -50,10 +51,17 @@
 #include "functorexpression.hxx"
 #include "tinyvector.hxx"
 #include "algorithm.hxx"
+#ifdef VIGRA_HAS_THREADPOOL
+#  include "threadpool.hxx"
+#endif
 
 namespace vigra
 {
 
+#ifndef VIGRA_HAS_THREADPOOL
+class ThreadPool; // only passed around as a null pointer
+#endif
+
 namespace detail
 {
 
@@ -334,13 +342,17 @@ class ConvolutionOptions
     ParamVec outer_scale;
     double window_ratio;
     Shape from_point, to_point;
+    int num_threads;
+    bool recursive_filter;
      
     ConvolutionOptions()
     : sigma_eff(0.0),
       sigma_d(0.0),
       step_size(1.0),
       outer_scale(0.0),
-      window_ratio(0.0)
+      window_ratio(0.0),
+      num_threads(0), // ParallelOptions::NoThreads
+      recursive_filter(false)
     {}
 
     typedef typename detail::WrapDoubleIteratorTriple<ParamIt, ParamIt, ParamIt>
@@ -486,6 +498,49 @@ class ConvolutionOptions
         to_point = to;
         return *this;
     }
+
+        /** Number of threads used by the Gaussian filters.
+
+            Each separable pass consists of many independent 1D convolutions
+            (one per line along the current axis). When more than one thread
+            is requested, these lines are split among the threads of a 
+            \ref vigra::ThreadPool along one of the other axes. The result is 
+            identical to the serial computation. The special values of
+            \ref vigra::ParallelOptions (e.g. <tt>ParallelOptions::Auto</tt>)
+            are accepted as well. When VIGRA is compiled without thread 
+            support (i.e. <tt>VIGRA_HAS_THREADPOOL</tt> is undefined), 
+            this option is ignored.
+            
+            Default: <tt>ParallelOptions::NoThreads</tt> (i.e. compute serially)
+        */
+    ConvolutionOptions<dim> & numThreads(int n)
+    {
+        num_threads = n;
+        return *this;
+    }
+
+        /** Use recursive (IIR) instead of FIR Gaussian filters.
+
+            When set, each axis is filtered by \ref recursiveGaussianFilterLine()
+            (the third order recursive approximation of the Gaussian by Young and 
+            van Vliet), whose cost per pixel does not depend on the scale. 
+            Derivatives are computed by central differences of the smoothed lines.
+            This is much faster than the FIR filters for large scales 
+            (e.g. <tt>sigma >= 5</tt> on volume data), but less accurate 
+            for small ones (<tt>sigma < 2</tt>). The option is supported by 
+            \ref gaussianSmoothMultiArray(), \ref gaussianGradientMultiArray(),
+            \ref laplacianOfGaussianMultiArray() and \ref hessianOfGaussianMultiArray()
+            (and the functions built upon them, such as \ref gaussianGradientMagnitude() 
+            and \ref structureTensorMultiArray()). The filterWindowSize() option
+            is ignored, and every axis must have at least length 4.
+            
+            Default: <tt>false</tt> (i.e. use FIR filters)
+        */
+    ConvolutionOptions<dim> & useRecursiveFilter(bool recursive = true)
+    {
+        recursive_filter = recursive;
+        return *this;
+    }
 };
 
 namespace detail
@@ -493,64 +548,345 @@ namespace detail
 
 /********************************************************/
 /*                                                      */
-/*        internalSeparableConvolveMultiArray           */
+/*             internalConvolveLineBlock                */
 /*                                                      */
 /********************************************************/
 
-template <class SrcIterator, class SrcShape, class SrcAccessor,
-          class DestIterator, class DestAccessor, class KernelIterator>
+    // number of lines convolved together by internalConvolveLineBlock()
+static const int convolveLineBlockSize = 32;
+
+inline bool
+convolveLineBlockApplicable(BorderTreatmentMode border)
+{
+    return border == BORDER_TREATMENT_REFLECT || border == BORDER_TREATMENT_REPEAT ||
+           border == BORDER_TREATMENT_WRAP    || border == BORDER_TREATMENT_ZEROPAD;
+}
+
+    // Compute d[i] = sum_k kernel[k]*t[i-k*stride] for 0 <= i < n, i.e. convolve 
+    // 'stride' interleaved lines at once, in the same summation order as convolveLine().
+template <class TmpType, class KernelIterator, class SumType>
 void
-internalSeparableConvolveMultiArrayTmp(
-                      SrcIterator si, SrcShape const & shape, SrcAccessor src,
-                      DestIterator di, DestAccessor dest, KernelIterator kit)
+convolveInterleavedLines(TmpType const * t, KernelIterator kernel, int kleft, int kright,
+                         SumType * d, int n, int stride, VigraFalseType)
+{
+    std::fill(d, d + n, NumericTraits<SumType>::zero());
+    for(int k = kright; k >= kleft; --k)
+    {
+        typename std::iterator_traits<KernelIterator>::value_type kv = kernel[k];
+        TmpType const * row = t - k*stride;
+        for(int i = 0; i < n; ++i)
+            d[i] += kv * row[i];
+    }
+}
+
+#ifdef VIGRA_CONVOLVE_LINE_SIMD
+
+template <class TmpType, class KernelIterator, class SumType>
+inline void
+convolveInterleavedLines(TmpType const * t, KernelIterator kernel, int kleft, int kright,
+                         SumType * d, int n, int stride, VigraTrueType)
+{
+    convolveLineSimd(t, &*kernel, kleft, kright, d, n, stride);
+}
+
+#endif // VIGRA_CONVOLVE_LINE_SIMD
+
+    // Convolve 'count' lines of length 'w' at once, with the same result as
+    // convolveLine() for each line. The source lines are copied into a tile 
+    // where the lines are interleaved (i.e. the tile is position-major), so 
+    // that neighbouring lines along a strided axis share the cache lines that 
+    // are loaded, and the innermost loop runs across the lines and vectorizes. 
+    // The border is filled into the tile according to the kernel's border 
+    // treatment, which must be one of convolveLineBlockApplicable(). If 
+    // 'stop' is non-zero, only the outputs in [start, stop) are computed, and 
+    // the destination lines refer to that subrange. The source and destination 
+    // lines may be identical.
+template <class SrcLineIterator, class SrcAccessor,
+          class DestLineIterator, class DestAccessor,
+          class T, class TmpType>
+void
+internalConvolveLineBlock(SrcLineIterator const * slines, SrcAccessor src,
+                          DestLineIterator const * dlines, DestAccessor dest,
+                          int count, int w, Kernel1D<T> const & kernel,
+                          int start, int stop, ArrayVector<TmpType> & tile)
+{
+    enum { B = convolveLineBlockSize };
+    typedef typename PromoteTraits<TmpType, T>::Promote SumType;
+    typedef typename DestAccessor::value_type DestType;
+
+    int kleft = kernel.left(), 
+        kright = kernel.right();
+    BorderTreatmentMode border = kernel.borderTreatment();
+
+    vigra_precondition(w >= std::max(kright, -kleft) + 1,
+                 "convolveLine(): kernel longer than line.\n");
+    vigra_precondition(count <= B,
+                 "internalConvolveLineBlock(): too many lines.\n");
+    if(stop == 0)
+    {
+        start = 0;
+        stop = w;
+    }
+
+    tile.resize((w + kright - kleft) * B);
+    // row of position 0 (rows are indexed by source position)
+    TmpType * t = tile.begin() + kright * B;
+
+    for(int x = 0; x < w; ++x)
+        for(int j = 0; j < count; ++j)
+            t[x*B + j] = src(slines[j], x);
+
+    for(int m = 1; m <= kright; ++m)
+    {
+        TmpType * row = t - m*B;
+        switch(border)
+        {
+          case BORDER_TREATMENT_WRAP:
+            std::copy(t + (w - m)*B, t + (w - m + 1)*B, row);
+            break;
+          case BORDER_TREATMENT_REFLECT:
+            std::copy(t + m*B, t + (m + 1)*B, row);
+            break;
+          case BORDER_TREATMENT_REPEAT:
+            std::copy(t, t + B, row);
+            break;
+          default:
+            std::fill(row, row + B, NumericTraits<TmpType>::zero());
+        }
+    }
+    for(int m = 1; m <= -kleft; ++m)
+    {
+        TmpType * row = t + (w - 1 + m)*B;
+        switch(border)
+        {
+          case BORDER_TREATMENT_WRAP:
+            std::copy(t + (m - 1)*B, t + m*B, row);
+            break;
+          case BORDER_TREATMENT_REFLECT:
+            std::copy(t + (w - 1 - m)*B, t + (w - m)*B, row);
+            break;
+          case BORDER_TREATMENT_REPEAT:
+            std::copy(t + (w - 1)*B, t + w*B, row);
+            break;
+          default:
+            std::fill(row, row + B, NumericTraits<TmpType>::zero());
+        }
+    }
+
+    ArrayVector<SumType> sum((stop - start)*B);
+    convolveInterleavedLines(t + start*B, kernel.center(), kleft, kright, 
+                             sum.begin(), (stop - start)*B, B,
+                             typename ConvolveLineSimdTypes<TmpType, T>::type());
+    SumType const * s = sum.begin();
+    for(int x = 0; x < stop - start; ++x)
+        for(int j = 0; j < count; ++j)
+            dest.set(RequiresExplicitCast<DestType>::cast(s[x*B + j]), dlines[j], x);
+}
+
+/********************************************************/
+/*                                                      */
+/*                internalConvolveLines                 */
+/*                                                      */
+/********************************************************/
+
+    // Convolve all lines along 'dim' of the source block [sstart, sstop) and 
+    // write them to the corresponding lines of the destination block [dstart, dstop).
+    // If 'stop' is non-zero, only the outputs in [start, stop) are computed, and 
+    // the destination lines refer to that subrange. Works in-place.
+template <class SrcIterator, class Shape, class SrcAccessor,
+          class DestIterator, class DestAccessor, class T>
+void
+internalConvolveLines(SrcIterator s, Shape const & sstart, Shape const & sstop, SrcAccessor src,
+                      DestIterator d, Shape const & dstart, Shape const & dstop, DestAccessor dest,
+                      int dim, Kernel1D<T> const & kernel, int start = 0, int stop = 0)
 {
     enum { N = 1 + SrcIterator::level };
 
     typedef typename NumericTraits<typename DestAccessor::value_type>::RealPromote TmpType;
-    typedef typename AccessorTraits<TmpType>::default_accessor TmpAcessor;
+    typedef typename AccessorTraits<TmpType>::default_accessor TmpAccessor;
+    typedef typename AccessorTraits<TmpType>::default_const_accessor TmpConstAccessor;
+    typedef MultiArrayNavigator<SrcIterator, N> SNavigator;
+    typedef MultiArrayNavigator<DestIterator, N> DNavigator;
 
     // temporary array to hold the current line to enable in-place operation
-    ArrayVector<TmpType> tmp( shape[0] );
+    ArrayVector<TmpType> tmp( sstop[dim] - sstart[dim] );
 
-    typedef MultiArrayNavigator<SrcIterator, N> SNavigator;
-    typedef MultiArrayNavigator<DestIterator, N> DNavigator;
-    
-    TmpAcessor acc;
+    SNavigator snav( s, sstart, sstop, dim );
+    DNavigator dnav( d, dstart, dstop, dim );
 
+    if(dim > 0 && convolveLineBlockApplicable(kernel.borderTreatment()))
     {
-        // only operate on first dimension here
-        SNavigator snav( si, shape, 0 );
-        DNavigator dnav( di, shape, 0 );
-        
-        for( ; snav.hasMore(); snav++, dnav++ )
+        // the lines are strided: convolve blocks of neighbouring lines together
+        enum { B = convolveLineBlockSize };
+        typename SNavigator::iterator slines[B];
+        typename DNavigator::iterator dlines[B];
+        while(snav.hasMore())
         {
-             // first copy source to tmp for maximum cache efficiency
-             copyLine(snav.begin(), snav.end(), src, tmp.begin(), acc);
-
-             convolveLine(srcIterRange(tmp.begin(), tmp.end(), acc),
-                          destIter( dnav.begin(), dest ),
-                          kernel1d( *kit ) );
+            int count = 0;
+            for( ; count < B && snav.hasMore(); ++count, snav++, dnav++ )
+            {
+                slines[count] = snav.begin();
+                dlines[count] = dnav.begin();
+            }
+            internalConvolveLineBlock(slines, src, dlines, dest, count, 
+                                      sstop[dim] - sstart[dim], kernel, start, stop, tmp);
         }
-        ++kit;
+        return;
     }
 
-    // operate on further dimensions
-    for( int d = 1; d < N; ++d, ++kit )
+    for( ; snav.hasMore(); snav++, dnav++ )
     {
-        DNavigator dnav( di, shape, d );
+        // first copy source to tmp for maximum cache efficiency
+        copyLine(snav.begin(), snav.end(), src, tmp.begin(), TmpAccessor());
 
-        tmp.resize( shape[d] );
+        convolveLine(srcIterRange(tmp.begin(), tmp.end(), TmpConstAccessor()),
+                     destIter( dnav.begin(), dest ),
+                     kernel1d( kernel ), start, stop);
+    }
+}
 
-        for( ; dnav.hasMore(); dnav++ )
+#ifdef VIGRA_HAS_THREADPOOL
+
+    // Call 'f(sstart, sstop, dstart, dstop)' for sub-blocks of the given source and 
+    // destination blocks, such that every line along 'dim' is contained in exactly 
+    // one sub-block. The sub-blocks are distributed among the threads of 'pool' 
+    // (if non-zero). Since every line is processed independently, the result 
+    // does not depend on the number of threads.
+template <class Shape, class Functor>
+void
+internalForEachLineBlockParallel(ThreadPool * pool,
+                                 Shape const & sstart, Shape const & sstop,
+                                 Shape const & dstart, Shape const & dstop,
+                                 int dim, Functor f)
+{
+    enum { N = Shape::static_size };
+
+    // split the outermost axis that has enough extent, or else the longest one
+    Shape extent = dstop - dstart;
+    int axis = -1;
+    if(pool != 0 && pool->nThreads() > 1)
+    {
+        int nThreads = (int)pool->nThreads();
+        for(int k = N-1; k >= 0 && axis < 0; --k)
+            if(k != dim && extent[k] >= nThreads)
+                axis = k;
+        for(int k = 0; k < N && axis < 0; ++k)
+            if(k != dim && extent[k] > 1 && (axis < 0 || extent[k] > extent[axis]))
+                axis = k;
+    }
+    if(axis < 0)
+    {
+        f(sstart, sstop, dstart, dstop);
+        return;
+    }
+
+    MultiArrayIndex size = extent[axis];
+    int nBlocks = (int)std::min<MultiArrayIndex>(size, 4*pool->nThreads());
+    parallel_foreach(*pool, nBlocks,
+        [&](int /* thread_id */, std::ptrdiff_t k)
         {
-             // first copy source to tmp since convolveLine() cannot work in-place
-             copyLine(dnav.begin(), dnav.end(), dest, tmp.begin(), acc);
+            MultiArrayIndex b = size * k / nBlocks,
+                            e = size * (k + 1) / nBlocks;
+            Shape bsstart(sstart), bsstop(sstop), bdstart(dstart), bdstop(dstop);
+            bsstart[axis] = sstart[axis] + b;
+            bsstop[axis]  = sstart[axis] + e;
+            bdstart[axis] = dstart[axis] + b;
+            bdstop[axis]  = dstart[axis] + e;
+            f(bsstart, bsstop, bdstart, bdstop);
+        });
+}
 
-             convolveLine(srcIterRange(tmp.begin(), tmp.end(), acc),
-                          destIter( dnav.begin(), dest ),
-                          kernel1d( *kit ) );
-        }
+    // Owns the thread pool requested by ConvolutionOptions::numThreads(),
+    // or no pool when the computation is single-threaded.
+class ConvolutionThreadPool
+{
+  public:
+    explicit ConvolutionThreadPool(int numThreads)
+    {
+        int n = ParallelOptions().numThreads(numThreads).getActualNumThreads();
+        if(n > 1)
+            pool_.reset(new ThreadPool(n));
+    }
+
+    ThreadPool * get() const
+    {
+        return pool_.get();
+    }
+
+  private:
+    VIGRA_UNIQUE_PTR<ThreadPool> pool_;
+};
+
+#else // VIGRA_HAS_THREADPOOL
+
+    // without thread support, all lines are processed by the calling thread
+template <class Shape, class Functor>
+inline void
+internalForEachLineBlockParallel(ThreadPool *,
+                                 Shape const & sstart, Shape const & sstop,
+                                 Shape const & dstart, Shape const & dstop,
+                                 int, Functor f)
+{
+    f(sstart, sstop, dstart, dstop);
+}
+
+class ConvolutionThreadPool
+{
+  public:
+    explicit ConvolutionThreadPool(int)
+    {}
+
+    ThreadPool * get() const
+    {
+        return 0;
     }
+};
+
+#endif // VIGRA_HAS_THREADPOOL
+
+    // Same as internalConvolveLines(), but the lines are split among the 
+    // threads of 'pool' (if non-zero).
+template <class SrcIterator, class Shape, class SrcAccessor,
+          class DestIterator, class DestAccessor, class T>
+void
+internalConvolveLinesParallel(ThreadPool * pool,
+                      SrcIterator s, Shape const & sstart, Shape const & sstop, SrcAccessor src,
+                      DestIterator d, Shape const & dstart, Shape const & dstop, DestAccessor dest,
+                      int dim, Kernel1D<T> const & kernel, int start = 0, int stop = 0)
+{
+    internalForEachLineBlockParallel(pool, sstart, sstop, dstart, dstop, dim,
+        [&](Shape const & bsstart, Shape const & bsstop, Shape const & bdstart, Shape const & bdstop)
+        {
+            internalConvolveLines(s, bsstart, bsstop, src, d, bdstart, bdstop, dest, 
+                                  dim, kernel, start, stop);
+        });
+}
+
+/********************************************************/
+/*                                                      */
+/*        internalSeparableConvolveMultiArray           */
+/*                                                      */
+/********************************************************/
+
+template <class SrcIterator, class SrcShape, class SrcAccessor,
+          class DestIterator, class DestAccessor, class KernelIterator>
+void
+internalSeparableConvolveMultiArrayTmp(
+                      SrcIterator si, SrcShape const & shape, SrcAccessor src,
+                      DestIterator di, DestAccessor dest, KernelIterator kit,
+                      ThreadPool * pool = 0)
+{
+    enum { N = 1 + SrcIterator::level };
+
+    SrcShape zero;
+
+    // only operate on first dimension here
+    internalConvolveLinesParallel(pool, si, zero, shape, src, di, zero, shape, dest, 0, *kit);
+    ++kit;
+
+    // operate on further dimensions
+    for( int d = 1; d < N; ++d, ++kit )
+        internalConvolveLinesParallel(pool, di, zero, shape, dest, di, zero, shape, dest, d, *kit);
 }
 
 /********************************************************/
@@ -565,13 +901,13 @@ void
 internalSeparableConvolveSubarray(
                       SrcIterator si, SrcShape const & shape, SrcAccessor src,
                       DestIterator di, DestAccessor dest, KernelIterator kit,
-                      SrcShape const & start, SrcShape const & stop)
+                      SrcShape const & start, SrcShape const & stop,
+                      ThreadPool * pool = 0)
 {
     enum { N = 1 + SrcIterator::level };
 
     typedef typename NumericTraits<typename DestAccessor::value_type>::RealPromote TmpType;
     typedef MultiArray<N, TmpType> TmpArray;
-    typedef typename TmpArray::traverser TmpIterator;
     typedef typename AccessorTraits<TmpType>::default_accessor TmpAcessor;
     
     SrcShape sstart, sstop, axisorder, tmpshape;
@@ -593,53 +929,33 @@ internalSeparableConvolveSubarray(
     dstop[axisorder[0]]  = stop[axisorder[0]] - start[axisorder[0]];
     
     // temporary array to hold the current line to enable in-place operation
-    MultiArray<N, TmpType> tmp(dstop);
+    TmpArray tmp(dstop);
 
-    typedef MultiArrayNavigator<SrcIterator, N> SNavigator;
-    typedef MultiArrayNavigator<TmpIterator, N> TNavigator;
-    
     TmpAcessor acc;
 
     {
         // only operate on first dimension here
-        SNavigator snav( si, sstart, sstop, axisorder[0]);
-        TNavigator tnav( tmp.traverser_begin(), dstart, dstop, axisorder[0]);
-        
-        ArrayVector<TmpType> tmpline(sstop[axisorder[0]] - sstart[axisorder[0]]);
-        
         int lstart = start[axisorder[0]] - sstart[axisorder[0]];
         int lstop  = lstart + (stop[axisorder[0]] - start[axisorder[0]]);
 
-        for( ; snav.hasMore(); snav++, tnav++ )
-        {
-            // first copy source to tmp for maximum cache efficiency
-            copyLine(snav.begin(), snav.end(), src, tmpline.begin(), acc);
-            
-            convolveLine(srcIterRange(tmpline.begin(), tmpline.end(), acc),
-                         destIter(tnav.begin(), acc),
-                         kernel1d( kit[axisorder[0]] ), lstart, lstop);
-        }
+        internalConvolveLinesParallel(pool, si, sstart, sstop, src, 
+                                      tmp.traverser_begin(), dstart, dstop, acc,
+                                      axisorder[0], kit[axisorder[0]], lstart, lstop);
     }
     
     // operate on further dimensions
     for( int d = 1; d < N; ++d)
     {
-        TNavigator tnav( tmp.traverser_begin(), dstart, dstop, axisorder[d]);
-        
-        ArrayVector<TmpType> tmpline(dstop[axisorder[d]] - dstart[axisorder[d]]);
-        
         int lstart = start[axisorder[d]] - sstart[axisorder[d]];
         int lstop  = lstart + (stop[axisorder[d]] - start[axisorder[d]]);
 
-        for( ; tnav.hasMore(); tnav++ )
-        {
-            // first copy source to tmp because convolveLine() cannot work in-place
-            copyLine(tnav.begin(), tnav.end(), acc, tmpline.begin(), acc );
+        SrcShape ldstart(dstart), ldstop(dstop);
+        ldstart[axisorder[d]] = lstart;
+        ldstop[axisorder[d]] = lstop;
 
-            convolveLine(srcIterRange(tmpline.begin(), tmpline.end(), acc),
-                         destIter( tnav.begin() + lstart, acc ),
-                         kernel1d( kit[axisorder[d]] ), lstart, lstop);
-        }
+        internalConvolveLinesParallel(pool, tmp.traverser_begin(), dstart, dstop, acc,
+                                      tmp.traverser_begin(), ldstart, ldstop, acc,
+                                      axisorder[d], kit[axisorder[d]], lstart, lstop);
         
         dstart[axisorder[d]] = lstart;
         dstop[axisorder[d]] = lstop;
@@ -649,6 +965,284 @@ internalSeparableConvolveSubarray(
 }
 
 
+template <class SrcIterator, class SrcShape, class SrcAccessor,
+          class DestIterator, class DestAccessor, class KernelIterator>
+void
+separableConvolveMultiArrayImpl( SrcIterator s, SrcShape const & shape, SrcAccessor src,
+                                 DestIterator d, DestAccessor dest, 
+                                 KernelIterator kernels,
+                                 SrcShape start, SrcShape stop,
+                                 ThreadPool * pool = 0)
+{
+    typedef typename NumericTraits<typename DestAccessor::value_type>::RealPromote TmpType;
+
+    if(stop != SrcShape())
+    {
+        enum { N = 1 + SrcIterator::level };
+        RelativeToAbsoluteCoordinate<N-1>::exec(shape, start);
+        RelativeToAbsoluteCoordinate<N-1>::exec(shape, stop);
+        
+        for(int k=0; k<N; ++k)
+            vigra_precondition(0 <= start[k] && start[k] < stop[k] && stop[k] <= shape[k],
+              "separableConvolveMultiArray(): invalid subarray shape.");
+
+        internalSeparableConvolveSubarray(s, shape, src, d, dest, kernels, start, stop, pool);
+    }
+    else if(!IsSameType<TmpType, typename DestAccessor::value_type>::boolResult)
+    {
+        // need a temporary array to avoid rounding errors
+        MultiArray<SrcShape::static_size, TmpType> tmpArray(shape);
+        internalSeparableConvolveMultiArrayTmp( s, shape, src,
+             tmpArray.traverser_begin(), typename AccessorTraits<TmpType>::default_accessor(), 
+             kernels, pool );
+        copyMultiArray(srcMultiArrayRange(tmpArray), destIter(d, dest));
+    }
+    else
+    {
+        // work directly on the destination array
+        internalSeparableConvolveMultiArrayTmp( s, shape, src, d, dest, kernels, pool );
+    }
+}
+
+template <unsigned int N, class T1, class S1,
+                          class T2, class S2, 
+          class KernelIterator>
+void
+separableConvolveMultiArrayImpl(MultiArrayView<N, T1, S1> const & source,
+                                MultiArrayView<N, T2, S2> dest, 
+                                KernelIterator kit,
+                                typename MultiArrayShape<N>::type start,
+                                typename MultiArrayShape<N>::type stop,
+                                ThreadPool * pool = 0)
+{
+    if(stop != typename MultiArrayShape<N>::type())
+    {
+        RelativeToAbsoluteCoordinate<N-1>::exec(source.shape(), start);
+        RelativeToAbsoluteCoordinate<N-1>::exec(source.shape(), stop);
+        vigra_precondition(dest.shape() == (stop - start),
+            "separableConvolveMultiArray(): shape mismatch between ROI and output.");
+    }
+    else
+    {
+        vigra_precondition(source.shape() == dest.shape(),
+            "separableConvolveMultiArray(): shape mismatch between input and output.");
+    }
+    separableConvolveMultiArrayImpl( source.traverser_begin(), source.shape(), 
+                                     typename AccessorTraits<T1>::default_const_accessor(),
+                                     dest.traverser_begin(), 
+                                     typename AccessorTraits<T2>::default_accessor(), 
+                                     kit, start, stop, pool );
+}
+
+    // Filter a block of 'count' lines of length 'w' (count <= convolveLineBlockSize) 
+    // with the recursive Gaussian of recursiveGaussianFilterLine(). The lines are 
+    // interleaved in 'forward' and 'backward', so that the recursions of all lines
+    // run in lock-step. Derivatives of the given 'order' are computed by central 
+    // differences of the smoothed lines with reflective border treatment, 
+    // multiplied by 'scale'. The source and destination lines may be identical.
+template <class SrcLineIterator, class SrcAccessor,
+          class DestLineIterator, class DestAccessor, class TmpType>
+void
+internalRecursiveGaussianLineBlock(SrcLineIterator const * slines, SrcAccessor src,
+                                   DestLineIterator const * dlines, DestAccessor dest,
+                                   int count, int w, double sigma, int order, double scale,
+                                   ArrayVector<TmpType> & forward, ArrayVector<TmpType> & backward)
+{
+    enum { B = convolveLineBlockSize };
+    typedef detail::RequiresExplicitCast<TmpType> Cast;
+
+    vigra_precondition(w >= 4,
+        "recursiveGaussianFilterLine(): line must have at least length 4.");
+
+    double b0, b1, b2, b3;
+    recursiveGaussianCoefficients(sigma, b0, b1, b2, b3);
+    int kernelw = std::min(w-4, (int)(4.0*sigma));
+
+    forward.resize(w*B);
+    backward.resize(w*B);
+    TmpType * f = forward.begin(), 
+            * b = backward.begin();
+
+    for(int x = 0; x < w; ++x)
+    {
+        for(int j = 0; j < count; ++j)
+            f[x*B + j] = src(slines[j], x);
+        for(int j = count; j < B; ++j)
+            f[x*B + j] = NumericTraits<TmpType>::zero();
+    }
+
+    // initialise the filter for reflective boundary conditions
+    std::fill(b + kernelw*B, b + (kernelw+4)*B, NumericTraits<TmpType>::zero());
+    for(int x = kernelw; x >= 0; --x)
+        for(int j = 0; j < B; ++j)
+            b[x*B+j] = Cast::cast(b0*f[x*B+j] + (b1*b[(x+1)*B+j] + b2*b[(x+2)*B+j] + b3*b[(x+3)*B+j]));
+
+    // causal filter (in-place)
+    for(int j = 0; j < B; ++j)
+    {
+        f[j]     = Cast::cast(b0*f[j]     + (b1*b[B+j] + b2*b[2*B+j] + b3*b[3*B+j]));
+        f[B+j]   = Cast::cast(b0*f[B+j]   + (b1*f[j]   + b2*b[B+j]   + b3*b[2*B+j]));
+        f[2*B+j] = Cast::cast(b0*f[2*B+j] + (b1*f[B+j] + b2*f[j]     + b3*b[B+j]));
+    }
+    for(int x = 3; x < w; ++x)
+        for(int j = 0; j < B; ++j)
+            f[x*B+j] = Cast::cast(b0*f[x*B+j] + (b1*f[(x-1)*B+j] + b2*f[(x-2)*B+j] + b3*f[(x-3)*B+j]));
+
+    // anti-causal filter
+    TmpType * fe = f + (w-1)*B, 
+            * be = b + (w-1)*B;
+    for(int j = 0; j < B; ++j)
+    {
+        be[j]     = Cast::cast(b0*fe[j]     + (b1*fe[j-B]  + b2*fe[j-2*B] + b3*fe[j-3*B]));
+        be[j-B]   = Cast::cast(b0*fe[j-B]   + (b1*be[j]    + b2*fe[j-B]   + b3*fe[j-2*B]));
+        be[j-2*B] = Cast::cast(b0*fe[j-2*B] + (b1*be[j-B]  + b2*be[j]     + b3*fe[j-B]));
+    }
+    for(int x = w-4; x >= 0; --x)
+        for(int j = 0; j < B; ++j)
+            b[x*B+j] = Cast::cast(b0*f[x*B+j] + (b1*b[(x+1)*B+j] + b2*b[(x+2)*B+j] + b3*b[(x+3)*B+j]));
+
+    for(int x = 0; x < w; ++x)
+    {
+        TmpType const * left  = b + (x > 0   ? x-1 : 1)*B,
+                      * right = b + (x < w-1 ? x+1 : w-2)*B;
+        for(int j = 0; j < count; ++j)
+        {
+            switch(order)
+            {
+              case 0:
+                dest.set(b[x*B+j], dlines[j], x);
+                break;
+              case 1:
+                dest.set(Cast::cast(0.5*scale*(right[j] - left[j])), dlines[j], x);
+                break;
+              default:
+                dest.set(Cast::cast(scale*(right[j] - 2.0*b[x*B+j] + left[j])), dlines[j], x);
+            }
+        }
+    }
+}
+
+    // Recursive Gaussian filtering of all lines along 'dim' of the source block 
+    // [sstart, sstop), written to the destination block [dstart, dstop). Works in-place.
+template <class SrcIterator, class Shape, class SrcAccessor,
+          class DestIterator, class DestAccessor>
+void
+internalRecursiveGaussianLines(SrcIterator s, Shape const & sstart, Shape const & sstop, SrcAccessor src,
+                               DestIterator d, Shape const & dstart, Shape const & dstop, DestAccessor dest,
+                               int dim, double sigma, int order, double scale)
+{
+    enum { N = 1 + SrcIterator::level, B = convolveLineBlockSize };
+
+    typedef typename NumericTraits<typename DestAccessor::value_type>::RealPromote TmpType;
+    typedef MultiArrayNavigator<SrcIterator, N> SNavigator;
+    typedef MultiArrayNavigator<DestIterator, N> DNavigator;
+
+    ArrayVector<TmpType> forward, backward;
+    typename SNavigator::iterator slines[B];
+    typename DNavigator::iterator dlines[B];
+
+    SNavigator snav( s, sstart, sstop, dim );
+    DNavigator dnav( d, dstart, dstop, dim );
+
+    while(snav.hasMore())
+    {
+        int count = 0;
+        for( ; count < B && snav.hasMore(); ++count, snav++, dnav++ )
+        {
+            slines[count] = snav.begin();
+            dlines[count] = dnav.begin();
+        }
+        internalRecursiveGaussianLineBlock(slines, src, dlines, dest, count, 
+                                           sstop[dim] - sstart[dim], sigma, order, scale, 
+                                           forward, backward);
+    }
+}
+
+    // Recursive counterpart of separableConvolveMultiArrayImpl() for the Gaussian
+    // derivative with the given 'order' per axis at the scale specified by 'opt'.
+template <class SrcIterator, class SrcShape, class SrcAccessor,
+          class DestIterator, class DestAccessor>
+void
+recursiveGaussianMultiArrayImpl(SrcIterator s, SrcShape const & shape, SrcAccessor src,
+                                DestIterator d, DestAccessor dest,
+                                ConvolutionOptions<SrcShape::static_size> const & opt,
+                                SrcShape const & order, const char * const function_name,
+                                ThreadPool * pool = 0)
+{
+    static const int N = SrcShape::static_size;
+
+    typedef typename NumericTraits<typename DestAccessor::value_type>::RealPromote TmpType;
+    typedef typename AccessorTraits<TmpType>::default_accessor TmpAccessor;
+    typedef typename MultiArray<N, TmpType>::traverser TmpIterator;
+
+    SrcShape start(opt.from_point), stop(opt.to_point);
+    if(stop != SrcShape())
+    {
+        RelativeToAbsoluteCoordinate<N-1>::exec(shape, start);
+        RelativeToAbsoluteCoordinate<N-1>::exec(shape, stop);
+
+        for(int k=0; k<N; ++k)
+            vigra_precondition(0 <= start[k] && start[k] < stop[k] && stop[k] <= shape[k],
+              "separableConvolveMultiArray(): invalid subarray shape.");
+    }
+    else
+    {
+        stop = shape;
+    }
+
+    // the recursive filters have infinite support, so the entire array
+    // must be filtered even if only a subarray is requested
+    MultiArray<N, TmpType> tmp(shape);
+    TmpIterator t = tmp.traverser_begin();
+    SrcShape zero;
+
+    typename ConvolutionOptions<N>::ScaleIterator params = opt.scaleParams();
+    for(int dim = 0; dim < N; ++dim, ++params)
+    {
+        double sigma = params.sigma_scaled(function_name);
+        double scale = std::pow(params.step_size(), -(double)order[dim]);
+        if(dim == 0)
+        {
+            internalForEachLineBlockParallel(pool, zero, shape, zero, shape, dim,
+                [&](SrcShape const & bsstart, SrcShape const & bsstop, 
+                    SrcShape const & bdstart, SrcShape const & bdstop)
+                {
+                    internalRecursiveGaussianLines(s, bsstart, bsstop, src, t, bdstart, bdstop, TmpAccessor(),
+                                                   dim, sigma, order[dim], scale);
+                });
+        }
+        else
+        {
+            internalForEachLineBlockParallel(pool, zero, shape, zero, shape, dim,
+                [&](SrcShape const & bsstart, SrcShape const & bsstop, 
+                    SrcShape const & bdstart, SrcShape const & bdstop)
+                {
+                    internalRecursiveGaussianLines(t, bsstart, bsstop, TmpAccessor(), t, bdstart, bdstop, TmpAccessor(),
+                                                   dim, sigma, order[dim], scale);
+                });
+        }
+    }
+    copyMultiArray(t + start, stop - start, TmpAccessor(), d, dest);
+}
+
+    // Gaussian derivative of the given 'order' per axis, either by convolution with
+    // the FIR 'kernels' or by recursive filtering, as requested by 'opt'.
+template <class SrcIterator, class SrcShape, class SrcAccessor,
+          class DestIterator, class DestAccessor, class KernelIterator>
+inline void
+gaussianDerivativeMultiArrayImpl(SrcIterator s, SrcShape const & shape, SrcAccessor src,
+                                 DestIterator d, DestAccessor dest, KernelIterator kernels,
+                                 ConvolutionOptions<SrcShape::static_size> const & opt,
+                                 SrcShape const & order, const char * const function_name,
+                                 ThreadPool * pool = 0)
+{
+    if(opt.recursive_filter)
+        recursiveGaussianMultiArrayImpl(s, shape, src, d, dest, opt, order, function_name, pool);
+    else
+        separableConvolveMultiArrayImpl(s, shape, src, d, dest, kernels, 
+                                        opt.from_point, opt.to_point, pool);
+}
+
 template <class K>
 void 
 scaleKernel(K & kernel, double a)
@@ -695,6 +1289,11 @@ scaleKernel(K & kernel, double a)
     array directly would cause round-off errors (i.e. if
     <tt>typeid(typename NumericTraits<T2>::RealPromote) != typeid(T2)</tt>).
     
+    All dimensions except the innermost one are convolved in blocks of neighbouring 
+    lines (when the kernel's border treatment is BORDER_TREATMENT_REFLECT, 
+    BORDER_TREATMENT_REPEAT, BORDER_TREATMENT_WRAP or BORDER_TREATMENT_ZEROPAD). 
+    This makes much better use of the cache along the strided axes.
+    
     If <tt>start</tt> and <tt>stop</tt> have non-default values, they must represent
     a valid subarray of the input array. The convolution is then restricted to that 
     subarray, and it is assumed that the output array only refers to the
@@ -844,42 +1443,14 @@ doxygen_overloaded_function(template <...> void separableConvolveMultiArray)
 
 template <class SrcIterator, class SrcShape, class SrcAccessor,
           class DestIterator, class DestAccessor, class KernelIterator>
-void
+inline void
 separableConvolveMultiArray( SrcIterator s, SrcShape const & shape, SrcAccessor src,
                              DestIterator d, DestAccessor dest, 
                              KernelIterator kernels,
                              SrcShape start = SrcShape(),
                              SrcShape stop = SrcShape())
 {
-    typedef typename NumericTraits<typename DestAccessor::value_type>::RealPromote TmpType;
-
-
-    if(stop != SrcShape())
-    {
-        
-        enum { N = 1 + SrcIterator::level };
-        detail::RelativeToAbsoluteCoordinate<N-1>::exec(shape, start);
-        detail::RelativeToAbsoluteCoordinate<N-1>::exec(shape, stop);
-        
-        for(int k=0; k<N; ++k)
-            vigra_precondition(0 <= start[k] && start[k] < stop[k] && stop[k] <= shape[k],
-              "separableConvolveMultiArray(): invalid subarray shape.");
-
-        detail::internalSeparableConvolveSubarray(s, shape, src, d, dest, kernels, start, stop);
-    }
-    else if(!IsSameType<TmpType, typename DestAccessor::value_type>::boolResult)
-    {
-        // need a temporary array to avoid rounding errors
-        MultiArray<SrcShape::static_size, TmpType> tmpArray(shape);
-        detail::internalSeparableConvolveMultiArrayTmp( s, shape, src,
-             tmpArray.traverser_begin(), typename AccessorTraits<TmpType>::default_accessor(), kernels );
-        copyMultiArray(srcMultiArrayRange(tmpArray), destIter(d, dest));
-    }
-    else
-    {
-        // work directly on the destination array
-        detail::internalSeparableConvolveMultiArrayTmp( s, shape, src, d, dest, kernels );
-    }
+    detail::separableConvolveMultiArrayImpl(s, shape, src, d, dest, kernels, start, stop);
 }
 
 template <class SrcIterator, class SrcShape, class SrcAccessor,
@@ -934,20 +1505,7 @@ separableConvolveMultiArray(MultiArrayView<N, T1, S1> const & source,
                             typename MultiArrayShape<N>::type start = typename MultiArrayShape<N>::type(),
                             typename MultiArrayShape<N>::type stop = typename MultiArrayShape<N>::type())
 {
-    if(stop != typename MultiArrayShape<N>::type())
-    {
-        detail::RelativeToAbsoluteCoordinate<N-1>::exec(source.shape(), start);
-        detail::RelativeToAbsoluteCoordinate<N-1>::exec(source.shape(), stop);
-        vigra_precondition(dest.shape() == (stop - start),
-            "separableConvolveMultiArray(): shape mismatch between ROI and output.");
-    }
-    else
-    {
-        vigra_precondition(source.shape() == dest.shape(),
-            "separableConvolveMultiArray(): shape mismatch between input and output.");
-    }
-    separableConvolveMultiArray( srcMultiArrayRange(source),
-                                 destMultiArray(dest), kit, start, stop );
+    detail::separableConvolveMultiArrayImpl(source, dest, kit, start, stop);
 }
 
 template <unsigned int N, class T1, class S1,
@@ -985,6 +1543,9 @@ separableConvolveMultiArray(MultiArrayView<N, T1, S1> const & source,
 
     This function may work in-place, which means that <tt>source.data() == dest.data()</tt> is allowed.
 
+    When <tt>dim > 0</tt>, blocks of neighbouring lines are convolved together
+    (see \ref separableConvolveMultiArray()).
+
     <b> Declarations:</b>
 
     pass arbitrary-dimensional array views:
@@ -1067,13 +1628,6 @@ convolveMultiArrayOneDimension(SrcIterator s, SrcShape const & shape, SrcAccesso
                         "convolveMultiArrayOneDimension(): The dimension number to convolve must be smaller "
                         "than the data dimensionality" );
 
-    typedef typename NumericTraits<typename DestAccessor::value_type>::RealPromote TmpType;
-    typedef typename AccessorTraits<TmpType>::default_const_accessor TmpAccessor;
-    ArrayVector<TmpType> tmp( shape[dim] );
-
-    typedef MultiArrayNavigator<SrcIterator, N> SNavigator;
-    typedef MultiArrayNavigator<DestIterator, N> DNavigator;
-    
     SrcShape sstart, sstop(shape), dstart, dstop(shape);
     
     if(stop != SrcShape())
@@ -1085,19 +1639,8 @@ convolveMultiArrayOneDimension(SrcIterator s, SrcShape const & shape, SrcAccesso
         dstop = stop - start;
     }
 
-    SNavigator snav( s, sstart, sstop, dim );
-    DNavigator dnav( d, dstart, dstop, dim );
-
-    for( ; snav.hasMore(); snav++, dnav++ )
-    {
-        // first copy source to temp for maximum cache efficiency
-        copyLine(snav.begin(), snav.end(), src,
-                 tmp.begin(), typename AccessorTraits<TmpType>::default_accessor() );
-
-        convolveLine(srcIterRange( tmp.begin(), tmp.end(), TmpAccessor()),
-                     destIter( dnav.begin(), dest ),
-                     kernel1d( kernel), start[dim], stop[dim]);
-    }
+    detail::internalConvolveLines(s, sstart, sstop, src, d, dstart, dstop, dest, 
+                                  dim, kernel, start[dim], stop[dim]);
 }
 
 template <class SrcIterator, class SrcShape, class SrcAccessor,
@@ -1260,7 +1803,9 @@ gaussianSmoothMultiArray( SrcIterator s, SrcShape const & shape, SrcAccessor src
     for (int dim = 0; dim < N; ++dim, ++params)
         kernels[dim].initGaussian(params.sigma_scaled(function_name), 1.0, opt.window_ratio);
 
-    separableConvolveMultiArray(s, shape, src, d, dest, kernels.begin(), opt.from_point, opt.to_point);
+    detail::ConvolutionThreadPool pool(opt.num_threads);
+    detail::gaussianDerivativeMultiArrayImpl(s, shape, src, d, dest, kernels.begin(), opt, 
+                                             SrcShape(), function_name, pool.get());
 }
 
 template <class SrcIterator, class SrcShape, class SrcAccessor,
@@ -1362,7 +1907,7 @@ gaussianSmoothMultiArray(MultiArrayView<N, T1, S1> const & source,
                   class T2, class S2>
         void
         gaussianGradientMultiArray(MultiArrayView<N, T1, S1> const & source,
-                                   MultiArrayView<N, TinyVector<T2, N>, S2> dest,
+                                   MultiArrayView<N, TinyVector<T2, int(N)>, S2> dest,
                                    double sigma,
                                    ConvolutionOptions<N> opt = ConvolutionOptions<N>());
 
@@ -1371,7 +1916,7 @@ gaussianSmoothMultiArray(MultiArrayView<N, T1, S1> const & source,
                                   class T2, class S2>
         void
         gaussianGradientMultiArray(MultiArrayView<N, T1, S1> const & source,
-                                   MultiArrayView<N, TinyVector<T2, N>, S2> dest,
+                                   MultiArrayView<N, TinyVector<T2, int(N)>, S2> dest,
                                    ConvolutionOptions<N> opt);
     }
     \endcode
@@ -1469,14 +2014,16 @@ gaussianGradientMultiArray(SrcIterator si, SrcShape const & shape, SrcAccessor s
 
     typedef VectorElementAccessor<DestAccessor> ElementAccessor;
 
+    detail::ConvolutionThreadPool pool(opt.num_threads);
+
     // compute gradient components
     for (int dim = 0; dim < N; ++dim, ++params2)
     {
         ArrayVector<Kernel1D<KernelType> > kernels(plain_kernels);
         kernels[dim].initGaussianDerivative(params2.sigma_scaled(), 1, 1.0, opt.window_ratio);
         detail::scaleKernel(kernels[dim], 1.0 / params2.step_size());
-        separableConvolveMultiArray(si, shape, src, di, ElementAccessor(dim, dest), kernels.begin(), 
-                                    opt.from_point, opt.to_point);
+        detail::gaussianDerivativeMultiArrayImpl(si, shape, src, di, ElementAccessor(dim, dest), kernels.begin(), 
+                                                 opt, SrcShape::unitVector(dim), function_name, pool.get());
     }
 }
 
@@ -1517,7 +2064,7 @@ template <unsigned int N, class T1, class S1,
                           class T2, class S2>
 inline void
 gaussianGradientMultiArray(MultiArrayView<N, T1, S1> const & source,
-                           MultiArrayView<N, TinyVector<T2, N>, S2> dest,
+                           MultiArrayView<N, TinyVector<T2, int(N)>, S2> dest,
                            ConvolutionOptions<N> opt )
 {
     if(opt.to_point != typename MultiArrayShape<N>::type())
@@ -1541,7 +2088,7 @@ template <unsigned int N, class T1, class S1,
           class T2, class S2>
 inline void
 gaussianGradientMultiArray(MultiArrayView<N, T1, S1> const & source,
-                           MultiArrayView<N, TinyVector<T2, N>, S2> dest,
+                           MultiArrayView<N, TinyVector<T2, int(N)>, S2> dest,
                            double sigma,
                            ConvolutionOptions<N> opt = ConvolutionOptions<N>())
 {
@@ -1577,18 +2124,53 @@ gaussianGradientMagnitudeImpl(MultiArrayView<N+1, T1, S1> const & src,
             "gaussianGradientMagnitude(): shape mismatch between input and output.");
     }
               
-    dest.init(0.0);
-    
     typedef typename NumericTraits<T1>::RealPromote TmpType;
-    MultiArray<N, TinyVector<TmpType, N> > grad(dest.shape());
-    
+    typedef typename NumericTraits<TmpType>::RealPromote KernelType;
+    typedef typename ConvolutionOptions<N>::ScaleIterator ParamType;
+    const char * const function_name = "gaussianGradientMagnitude";
+
+    dest.init(0.0);
+    for(int k=0; k<(int)N; ++k)
+        if(shape[k] <= 0)
+            return;
+
+    // The kernels only depend on 'opt', so they are set up once for all bands.
+    ParamType params = opt.scaleParams();
+    ArrayVector<Kernel1D<KernelType> > plain_kernels(N);
+    for(int dim = 0; dim < (int)N; ++dim, ++params)
+        plain_kernels[dim].initGaussian(params.sigma_scaled(function_name), 1.0, opt.window_ratio);
+
+    ArrayVector<ArrayVector<Kernel1D<KernelType> > > derivative_kernels(N, plain_kernels);
+    params = opt.scaleParams();
+    for(int dim = 0; dim < (int)N; ++dim, ++params)
+    {
+        derivative_kernels[dim][dim].initGaussianDerivative(params.sigma_scaled(), 1, 1.0, opt.window_ratio);
+        detail::scaleKernel(derivative_kernels[dim][dim], 1.0 / params.step_size());
+    }
+
+    detail::ConvolutionThreadPool pool(opt.num_threads);
+
+    // Compute one derivative at a time into a single scalar buffer and
+    // accumulate its square, instead of materialising the N-dimensional
+    // gradient vector. This needs N times less temporary memory.
+    MultiArray<N, TmpType> derivative(dest.shape());
+
     using namespace multi_math;
-    
+
     for(int k=0; k<src.shape(N); ++k)
     {
-        gaussianGradientMultiArray(src.bindOuter(k), grad, opt);
-        
-        dest += squaredNorm(grad);
+        MultiArrayView<N, T1, StridedArrayTag> band = src.bindOuter(k);
+        for(int dim = 0; dim < (int)N; ++dim)
+        {
+            detail::gaussianDerivativeMultiArrayImpl(band.traverser_begin(), shape, 
+                                                     typename AccessorTraits<T1>::default_const_accessor(),
+                                                     derivative.traverser_begin(), 
+                                                     typename AccessorTraits<TmpType>::default_accessor(),
+                                                     derivative_kernels[dim].begin(), opt, 
+                                                     MultiArrayShape<N>::type::unitVector(dim), 
+                                                     function_name, pool.get());
+            dest += sq(derivative);
+        }
     }
     dest = sqrt(dest);
 }
@@ -1686,7 +2268,7 @@ gaussianGradientMagnitude(MultiArrayView<N+1, Multiband<T1>, S1> const & src,
                                   class T2, class S2>
         void
         symmetricGradientMultiArray(MultiArrayView<N, T1, S1> const & source,
-                                    MultiArrayView<N, TinyVector<T2, N>, S2> dest,
+                                    MultiArrayView<N, TinyVector<T2, int(N)>, S2> dest,
                                     ConvolutionOptions<N> opt = ConvolutionOptions<N>());
     }
     \endcode
@@ -1801,7 +2383,7 @@ template <unsigned int N, class T1, class S1,
                           class T2, class S2>
 inline void
 symmetricGradientMultiArray(MultiArrayView<N, T1, S1> const & source,
-                            MultiArrayView<N, TinyVector<T2, N>, S2> dest,
+                            MultiArrayView<N, TinyVector<T2, int(N)>, S2> dest,
                             ConvolutionOptions<N> opt = ConvolutionOptions<N>())
 {
     if(opt.to_point != typename MultiArrayShape<N>::type())
@@ -1953,6 +2535,8 @@ laplacianOfGaussianMultiArray(SrcIterator si, SrcShape const & shape, SrcAccesso
     
     MultiArray<N, KernelType> derivative(dshape);
 
+    detail::ConvolutionThreadPool pool(opt.num_threads);
+
     // compute 2nd derivatives and sum them up
     for (int dim = 0; dim < N; ++dim, ++params2)
     {
@@ -1962,14 +2546,14 @@ laplacianOfGaussianMultiArray(SrcIterator si, SrcShape const & shape, SrcAccesso
 
         if (dim == 0)
         {
-            separableConvolveMultiArray( si, shape, src, 
-                                         di, dest, kernels.begin(), opt.from_point, opt.to_point);
+            detail::gaussianDerivativeMultiArrayImpl( si, shape, src, di, dest, kernels.begin(), opt, 
+                                         SrcShape::unitVector(dim) + SrcShape::unitVector(dim), "laplacianOfGaussianMultiArray", pool.get());
         }
         else
         {
-            separableConvolveMultiArray( si, shape, src, 
-                                         derivative.traverser_begin(), DerivativeAccessor(), 
-                                         kernels.begin(), opt.from_point, opt.to_point);
+            detail::gaussianDerivativeMultiArrayImpl( si, shape, src, 
+                                         derivative.traverser_begin(), DerivativeAccessor(), kernels.begin(), opt, 
+                                         SrcShape::unitVector(dim) + SrcShape::unitVector(dim), "laplacianOfGaussianMultiArray", pool.get());
             combineTwoMultiArrays(di, dshape, dest, derivative.traverser_begin(), DerivativeAccessor(), 
                                   di, dest, Arg1() + Arg2() );
         }
@@ -2089,14 +2673,14 @@ laplacianOfGaussianMultiArray(MultiArrayView<N, T1, S1> const & source,
         template <unsigned int N, class T1, class S1,
                                   class T2, class S2>
         void 
-        gaussianDivergenceMultiArray(MultiArrayView<N, TinyVector<T1, N>, S1> const & vectorField,
+        gaussianDivergenceMultiArray(MultiArrayView<N, TinyVector<T1, int(N)>, S1> const & vectorField,
                                      MultiArrayView<N, T2, S2> divergence,
                                      ConvolutionOptions<N> const & opt);
                                      
         template <unsigned int N, class T1, class S1,
                                   class T2, class S2>
         void 
-        gaussianDivergenceMultiArray(MultiArrayView<N, TinyVector<T1, N>, S1> const & vectorField,
+        gaussianDivergenceMultiArray(MultiArrayView<N, TinyVector<T1, int(N)>, S1> const & vectorField,
                                      MultiArrayView<N, T2, S2> divergence,
                                      double sigma,
                                      ConvolutionOptions<N> opt = ConvolutionOptions<N>());
@@ -2158,17 +2742,20 @@ gaussianDivergenceMultiArray(Iterator vectorField, Iterator vectorFieldEnd,
     }
     
     MultiArray<N, TmpType> tmpDeriv(divergence.shape());
+    detail::ConvolutionThreadPool pool(opt.num_threads);
     
     for(unsigned int k=0; k < N; ++k, ++vectorField)
     {
         kernels[k].initGaussianDerivative(sigmas[k], 1, 1.0, opt.window_ratio);
         if(k == 0)
         {
-            separableConvolveMultiArray(*vectorField, divergence, kernels.begin(), opt.from_point, opt.to_point);
+            detail::separableConvolveMultiArrayImpl(*vectorField, divergence, kernels.begin(), 
+                                                    opt.from_point, opt.to_point, pool.get());
         }
         else
         {
-            separableConvolveMultiArray(*vectorField, tmpDeriv, kernels.begin(), opt.from_point, opt.to_point);
+            detail::separableConvolveMultiArrayImpl(*vectorField, tmpDeriv, kernels.begin(), 
+                                                    opt.from_point, opt.to_point, pool.get());
             divergence += tmpDeriv;
         }
         kernels[k].initGaussian(sigmas[k], 1.0, opt.window_ratio);
@@ -2189,7 +2776,7 @@ gaussianDivergenceMultiArray(Iterator vectorField, Iterator vectorFieldEnd,
 template <unsigned int N, class T1, class S1,
                           class T2, class S2>
 inline void 
-gaussianDivergenceMultiArray(MultiArrayView<N, TinyVector<T1, N>, S1> const & vectorField,
+gaussianDivergenceMultiArray(MultiArrayView<N, TinyVector<T1, int(N)>, S1> const & vectorField,
                              MultiArrayView<N, T2, S2> divergence,
                              ConvolutionOptions<N> const & opt)
 {
@@ -2203,7 +2790,7 @@ gaussianDivergenceMultiArray(MultiArrayView<N, TinyVector<T1, N>, S1> const & ve
 template <unsigned int N, class T1, class S1,
                           class T2, class S2>
 inline void 
-gaussianDivergenceMultiArray(MultiArrayView<N, TinyVector<T1, N>, S1> const & vectorField,
+gaussianDivergenceMultiArray(MultiArrayView<N, TinyVector<T1, int(N)>, S1> const & vectorField,
                              MultiArrayView<N, T2, S2> divergence,
                              double sigma,
                              ConvolutionOptions<N> opt = ConvolutionOptions<N>())
@@ -2347,6 +2934,8 @@ hessianOfGaussianMultiArray(SrcIterator si, SrcShape const & shape, SrcAccessor
 
     typedef VectorElementAccessor<DestAccessor> ElementAccessor;
 
+    detail::ConvolutionThreadPool pool(opt.num_threads);
+
     // compute elements of the Hessian matrix
     ParamType params_i(params_init);
     for (int b=0, i=0; i<N; ++i, ++params_i)
@@ -2366,8 +2955,9 @@ hessianOfGaussianMultiArray(SrcIterator si, SrcShape const & shape, SrcAccessor
             }
             detail::scaleKernel(kernels[i], 1 / params_i.step_size());
             detail::scaleKernel(kernels[j], 1 / params_j.step_size());
-            separableConvolveMultiArray(si, shape, src, di, ElementAccessor(b, dest),
-                                        kernels.begin(), opt.from_point, opt.to_point);
+            detail::gaussianDerivativeMultiArrayImpl(si, shape, src, di, ElementAccessor(b, dest), kernels.begin(), 
+                                                     opt, SrcShape::unitVector(i) + SrcShape::unitVector(j),
+                                                     "hessianOfGaussianMultiArray", pool.get());
         }
     }
 }
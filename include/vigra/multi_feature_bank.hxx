@@ -0,0 +1,535 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2015 by Ullrich Koethe                       */
+/*                                                                      */
+/*    This file is part of the VIGRA computer vision library.           */
+/*    The VIGRA Website is                                              */
+/*        http://hci.iwr.uni-heidelberg.de/vigra/                       */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef VIGRA_MULTI_FEATURE_BANK_HXX
+#define VIGRA_MULTI_FEATURE_BANK_HXX
+
+#include "multi_array.hxx"
+#include "multi_math.hxx"
+#include "multi_convolution.hxx"
+#include "multi_tensorutilities.hxx"
+
+namespace vigra {
+
+/** \addtogroup MultiArrayConvolutionFilters
+*/
+//@{
+
+/********************************************************/
+/*                                                      */
+/*                  FeatureBankOptions                  */
+/*                                                      */
+/********************************************************/
+
+/** \brief List of Gaussian features to be computed by \ref featureBankMultiArray().
+
+    Each feature is added with its scale by one of the member functions below,
+    which can be chained:
+
+    \code
+    FeatureBankOptions features = FeatureBankOptions()
+                                     .gaussianSmoothing(1.0)
+                                     .gaussianGradientMagnitude(1.0)
+                                     .hessianOfGaussianEigenvalues(1.0)
+                                     .gaussianSmoothing(3.5)
+                                     .structureTensorEigenvalues(3.5, 1.75);
+    \endcode
+
+    The features are written to consecutive channels of the output in the
+    order in which they were added. Scalar features (smoothing, gradient magnitude,
+    Laplacian of Gaussian) occupy one channel, eigenvalue features occupy
+    <tt>N</tt> channels (sorted in descending order) for <tt>N</tt>-dimensional data.
+
+    <b>\#include</b> \<vigra/multi_feature_bank.hxx\><br/>
+    Namespace: vigra
+*/
+class FeatureBankOptions
+{
+  public:
+    enum Feature { GaussianSmoothing,
+                   GaussianGradientMagnitude,
+                   LaplacianOfGaussian,
+                   HessianOfGaussianEigenvalues,
+                   StructureTensorEigenvalues };
+
+    struct Entry
+    {
+        Feature feature;
+        double scale, outer_scale;
+    };
+
+    ArrayVector<Entry> features;
+
+        /** Add Gaussian smoothing at scale <tt>sigma</tt>.
+        */
+    FeatureBankOptions & gaussianSmoothing(double sigma)
+    {
+        return add(GaussianSmoothing, sigma);
+    }
+
+        /** Add the Gaussian gradient magnitude at scale <tt>sigma</tt>.
+        */
+    FeatureBankOptions & gaussianGradientMagnitude(double sigma)
+    {
+        return add(GaussianGradientMagnitude, sigma);
+    }
+
+        /** Add the Laplacian of Gaussian at scale <tt>sigma</tt>.
+        */
+    FeatureBankOptions & laplacianOfGaussian(double sigma)
+    {
+        return add(LaplacianOfGaussian, sigma);
+    }
+
+        /** Add the eigenvalues of the Hessian of Gaussian at scale <tt>sigma</tt>.
+        */
+    FeatureBankOptions & hessianOfGaussianEigenvalues(double sigma)
+    {
+        return add(HessianOfGaussianEigenvalues, sigma);
+    }
+
+        /** Add the eigenvalues of the structure tensor with the given inner and outer
+            scale. If the outer scale is zero, <tt>0.5*innerScale</tt> is used.
+        */
+    FeatureBankOptions & structureTensorEigenvalues(double innerScale, double outerScale = 0.0)
+    {
+        vigra_precondition(outerScale >= 0.0,
+            "FeatureBankOptions::structureTensorEigenvalues(): outer scale must not be negative.");
+        return add(StructureTensorEigenvalues, innerScale,
+                   outerScale == 0.0 ? 0.5*innerScale : outerScale);
+    }
+
+        /** Number of features added so far.
+        */
+    unsigned int size() const
+    {
+        return features.size();
+    }
+
+        /** Number of output channels of the given feature for <tt>ndim</tt>-dimensional data.
+        */
+    static unsigned int channelCount(Feature feature, unsigned int ndim)
+    {
+        return feature == HessianOfGaussianEigenvalues || feature == StructureTensorEigenvalues
+                    ? ndim
+                    : 1;
+    }
+
+        /** Total number of output channels for <tt>ndim</tt>-dimensional data.
+        */
+    unsigned int channelCount(unsigned int ndim) const
+    {
+        unsigned int res = 0;
+        for(unsigned int k=0; k<features.size(); ++k)
+            res += channelCount(features[k].feature, ndim);
+        return res;
+    }
+
+  private:
+    FeatureBankOptions & add(Feature feature, double scale, double outerScale = 0.0)
+    {
+        vigra_precondition(scale > 0.0,
+            "FeatureBankOptions: scale must be positive.");
+        Entry e = { feature, scale, outerScale };
+        features.push_back(e);
+        return *this;
+    }
+};
+
+namespace detail {
+
+template <int N, class ArgumentVector, class ResultVector>
+struct FeatureBankEigenvaluesFunctor
+: public EigenvaluesFunctor<N, ArgumentVector, ResultVector>
+{};
+
+template <class ArgumentVector, class ResultVector>
+struct FeatureBankEigenvaluesFunctor<1, ArgumentVector, ResultVector>
+{
+    typedef ArgumentVector argument_type;
+    typedef ResultVector result_type;
+
+    result_type operator()(argument_type const & a) const
+    {
+        return result_type(a[0]);
+    }
+};
+
+    // Is any of the required derivative orders equal to 'order' in the axes 0...dim ?
+template <class Shape>
+bool
+featureBankNeedsPrefix(ArrayVector<Shape> const & orders, Shape const & order, int dim)
+{
+    for(unsigned int i=0; i<orders.size(); ++i)
+    {
+        int k = 0;
+        while(k <= dim && orders[i][k] == order[k])
+            ++k;
+        if(k > dim)
+            return true;
+    }
+    return false;
+}
+
+    // Compute all derivatives in 'orders' by a depth-first traversal of the
+    // separable passes: the result of the passes along axes 0...dim is computed
+    // once and shared by all derivatives with the same orders along these axes.
+    // 'kernels[3*d + o]' is the kernel of derivative order 'o' along axis 'd',
+    // 'buffers[d]' holds the result after the pass along axis 'd'.
+template <class SrcIterator, class SrcAccessor, class Shape, class TmpArray, class Sink>
+void
+featureBankPasses(SrcIterator s, SrcAccessor src, Shape const & shape, int dim,
+                  Shape & order, ArrayVector<Shape> const & orders,
+                  ArrayVector<Kernel1D<double> > const & kernels,
+                  ArrayVector<TmpArray> & buffers, ThreadPool * pool, Sink & sink)
+{
+    typedef typename AccessorTraits<typename TmpArray::value_type>::default_accessor TmpAccessor;
+
+    Shape zero;
+    for(int o = 0; o < 3; ++o)
+    {
+        order[dim] = o;
+        if(!featureBankNeedsPrefix(orders, order, dim))
+            continue;
+        internalConvolveLinesParallel(pool, s, zero, shape, src,
+                                      buffers[dim].traverser_begin(), zero, shape, TmpAccessor(),
+                                      dim, kernels[3*dim + o]);
+        if(dim == Shape::static_size - 1)
+            sink(order, buffers[dim]);
+        else
+            featureBankPasses(buffers[dim].traverser_begin(), TmpAccessor(), shape, dim + 1,
+                              order, orders, kernels, buffers, pool, sink);
+    }
+    order[dim] = 0;
+}
+
+    // Distributes the derivatives of one scale to the features that need them.
+template <unsigned int N, class TmpType, class DestArray>
+struct FeatureBankSink
+{
+    typedef typename MultiArrayShape<N>::type Shape;
+
+    DestArray & dest;
+    ArrayVector<int> smoothing_channels;
+    MultiArray<N, TinyVector<TmpType, N> > gradient;
+    MultiArray<N, TinyVector<TmpType, N*(N+1)/2> > hessian;
+    MultiArray<N, TmpType> laplacian;
+    int laplacian_terms;
+
+    FeatureBankSink(DestArray & d)
+    : dest(d),
+      laplacian_terms(0)
+    {}
+
+    void operator()(Shape const & order, MultiArray<N, TmpType> const & derivative)
+    {
+        int i = -1, j = -1;
+        for(int k=0; k<(int)N; ++k)
+        {
+            for(int o=0; o<order[k]; ++o)
+            {
+                if(i < 0)
+                    i = k;
+                else
+                    j = k;
+            }
+        }
+
+        if(i < 0)
+        {
+            for(unsigned int c=0; c<smoothing_channels.size(); ++c)
+                dest.bindOuter(smoothing_channels[c]) = derivative;
+        }
+        else if(j < 0)
+        {
+            gradient.bindElementChannel(i) = derivative;
+        }
+        else
+        {
+            if(hessian.size() > 0)
+            {
+                // index of element (i, j) in the upper triangular part of the tensor
+                int b = i*(int)N - i*(i-1)/2 + j - i;
+                hessian.bindElementChannel(b) = derivative;
+            }
+            if(i == j && laplacian.size() > 0)
+            {
+                if(laplacian_terms++ == 0)
+                    laplacian = derivative;
+                else
+                    laplacian += derivative;
+            }
+        }
+    }
+};
+
+} // namespace detail
+
+/********************************************************/
+/*                                                      */
+/*                 featureBankMultiArray                */
+/*                                                      */
+/********************************************************/
+
+/** \brief Compute a bank of Gaussian features at several scales in a single call.
+
+    The features requested by the \ref vigra::FeatureBankOptions object are written to
+    consecutive channels of the multiband array <tt>dest</tt>, whose last axis is the
+    channel axis. The result of each feature is the same as if the corresponding
+    function (\ref gaussianSmoothMultiArray(), \ref gaussianGradientMagnitude(),
+    \ref laplacianOfGaussianMultiArray(), \ref hessianOfGaussianMultiArray() followed
+    by \ref tensorEigenvaluesMultiArray(), or \ref structureTensorMultiArray() followed
+    by \ref tensorEigenvaluesMultiArray()) had been called separately, but far fewer
+    convolution passes are needed:
+
+    <ul>
+    <li> All features at the same scale share their derivative filters, e.g. the
+         smoothed image and the gradient used by the gradient magnitude and the
+         structure tensor are computed only once.
+    <li> The required derivatives of one scale are computed axis by axis in a depth-first
+         manner, so that the intermediate result after the passes along the first
+         axes is reused by all derivatives that agree in these axes. For example, all
+         ten derivatives up to order two of a 3D volume (as needed by smoothing, gradient
+         and Hessian) take 19 instead of 30 passes.
+    <li> The temporary arrays are allocated once and reused for all scales.
+    </ul>
+
+    The options object <tt>opt</tt> may specify step size, resolution standard deviation,
+    filter window size and number of threads (see \ref vigra::ConvolutionOptions), its
+    scale parameter is ignored. Subarrays and recursive filters are not supported.
+    Eigenvalue features are only available for <tt>N <= 3</tt>.
+
+    <b> Declaration:</b>
+
+    \code
+    namespace vigra {
+        template <unsigned int N, class T1, class S1,
+                                  class T2, class S2>
+        void
+        featureBankMultiArray(MultiArrayView<N, T1, S1> const & source,
+                              MultiArrayView<N+1, T2, S2> dest,
+                              FeatureBankOptions const & features,
+                              ConvolutionOptions<N> opt = ConvolutionOptions<N>());
+    }
+    \endcode
+
+    <b> Usage:</b>
+
+    <b>\#include</b> \<vigra/multi_feature_bank.hxx\><br/>
+    Namespace: vigra
+
+    \code
+    Shape3 shape(width, height, depth);
+    MultiArray<3, float> source(shape);
+    ...
+    FeatureBankOptions features;
+    for(double sigma = 1.0; sigma <= 4.0; sigma *= 2.0)
+        features.gaussianSmoothing(sigma)
+                .gaussianGradientMagnitude(sigma)
+                .laplacianOfGaussian(sigma)
+                .hessianOfGaussianEigenvalues(sigma)
+                .structureTensorEigenvalues(sigma);
+
+    MultiArray<4, float> dest(Shape4(width, height, depth, features.channelCount(3)));
+    featureBankMultiArray(source, dest, features, ConvolutionOptions<3>().numThreads(4));
+    \endcode
+
+    \see vigra::FeatureBankOptions, vigra::ConvolutionOptions
+*/
+template <unsigned int N, class T1, class S1,
+                          class T2, class S2>
+void
+featureBankMultiArray(MultiArrayView<N, T1, S1> const & source,
+                      MultiArrayView<N+1, T2, S2> dest,
+                      FeatureBankOptions const & features,
+                      ConvolutionOptions<N> opt = ConvolutionOptions<N>())
+{
+    typedef typename MultiArrayShape<N>::type Shape;
+    typedef typename NumericTraits<T2>::RealPromote TmpType;
+    typedef MultiArray<N, TmpType> TmpArray;
+    typedef MultiArrayView<N+1, T2, S2> DestArray;
+    typedef FeatureBankOptions FBO;
+    static const int M = N*(N+1)/2;
+
+    Shape shape(source.shape());
+    vigra_precondition(shape == (dest.shape().template subarray<0, N>()),
+        "featureBankMultiArray(): shape mismatch between input and output.");
+    vigra_precondition(features.channelCount(N) == (unsigned int)dest.shape(N),
+        "featureBankMultiArray(): wrong number of channels in output array.");
+    vigra_precondition(opt.to_point == Shape(),
+        "featureBankMultiArray(): subarray option is not supported.");
+    vigra_precondition(!opt.recursive_filter,
+        "featureBankMultiArray(): recursive filter option is not supported.");
+
+    if(features.size() == 0 || source.size() == 0)
+        return;
+
+    ArrayVector<int> channelOffsets(features.size());
+    ArrayVector<double> scales;
+    for(unsigned int k=0, c=0; k<features.size(); ++k)
+    {
+        channelOffsets[k] = c;
+        c += FBO::channelCount(features.features[k].feature, N);
+        vigra_precondition(N <= 3 || FBO::channelCount(features.features[k].feature, N) == 1,
+            "featureBankMultiArray(): eigenvalue features require N <= 3.");
+        if(std::find(scales.begin(), scales.end(), features.features[k].scale) == scales.end())
+            scales.push_back(features.features[k].scale);
+    }
+
+    detail::ConvolutionThreadPool pool(opt.num_threads);
+    ArrayVector<TmpArray> buffers(N, TmpArray(shape));
+
+    using namespace multi_math;
+
+    for(unsigned int s=0; s<scales.size(); ++s)
+    {
+        detail::FeatureBankSink<N, TmpType, DestArray> sink(dest);
+        bool needGradient = false, needHessian = false, needLaplacian = false;
+        for(unsigned int k=0; k<features.size(); ++k)
+        {
+            if(features.features[k].scale != scales[s])
+                continue;
+            switch(features.features[k].feature)
+            {
+              case FBO::GaussianSmoothing:
+                sink.smoothing_channels.push_back(channelOffsets[k]);
+                break;
+              case FBO::GaussianGradientMagnitude:
+              case FBO::StructureTensorEigenvalues:
+                needGradient = true;
+                break;
+              case FBO::LaplacianOfGaussian:
+                needLaplacian = true;
+                break;
+              case FBO::HessianOfGaussianEigenvalues:
+                needHessian = true;
+                break;
+            }
+        }
+
+        // collect the required derivative orders and the corresponding kernels
+        ArrayVector<Shape> orders;
+        if(sink.smoothing_channels.size() > 0)
+            orders.push_back(Shape());
+        if(needGradient)
+        {
+            sink.gradient.reshape(shape);
+            for(int i=0; i<(int)N; ++i)
+                orders.push_back(Shape::unitVector(i));
+        }
+        if(needHessian || needLaplacian)
+        {
+            if(needHessian)
+                sink.hessian.reshape(shape);
+            if(needLaplacian)
+                sink.laplacian.reshape(shape);
+            for(int i=0; i<(int)N; ++i)
+                for(int j=i; j<(int)N; ++j)
+                    if(needHessian || i == j)
+                        orders.push_back(Shape::unitVector(i) + Shape::unitVector(j));
+        }
+
+        ConvolutionOptions<N> scaleOptions(opt);
+        typename ConvolutionOptions<N>::ScaleIterator params = scaleOptions.stdDev(scales[s]).scaleParams();
+        ArrayVector<Kernel1D<double> > kernels(3*N);
+        for(int d=0; d<(int)N; ++d, ++params)
+        {
+            double sigma = params.sigma_scaled("featureBankMultiArray");
+            kernels[3*d].initGaussian(sigma, 1.0, opt.window_ratio);
+            for(int o=1; o<3; ++o)
+            {
+                kernels[3*d+o].initGaussianDerivative(sigma, o, 1.0, opt.window_ratio);
+                detail::scaleKernel(kernels[3*d+o], 1.0 / std::pow(params.step_size(), o));
+            }
+        }
+
+        Shape order;
+        detail::featureBankPasses(source.traverser_begin(),
+                                  typename AccessorTraits<T1>::default_const_accessor(),
+                                  shape, 0, order, orders, kernels, buffers, pool.get(), sink);
+
+        // assemble the features from the derivatives
+        for(unsigned int k=0; k<features.size(); ++k)
+        {
+            FBO::Entry const & e = features.features[k];
+            if(e.scale != scales[s])
+                continue;
+            switch(e.feature)
+            {
+              case FBO::GaussianSmoothing:
+                break;
+              case FBO::GaussianGradientMagnitude:
+              {
+                dest.bindOuter(channelOffsets[k]) = sqrt(squaredNorm(sink.gradient));
+                break;
+              }
+              case FBO::LaplacianOfGaussian:
+              {
+                dest.bindOuter(channelOffsets[k]) = sink.laplacian;
+                break;
+              }
+              case FBO::HessianOfGaussianEigenvalues:
+              {
+                MultiArray<N, TinyVector<TmpType, N> > eigenvalues(shape);
+                transformMultiArray(sink.hessian, eigenvalues,
+                    detail::FeatureBankEigenvaluesFunctor<N, TinyVector<TmpType, M>, TinyVector<TmpType, N> >());
+                for(int i=0; i<(int)N; ++i)
+                    dest.bindOuter(channelOffsets[k] + i) = eigenvalues.bindElementChannel(i);
+                break;
+              }
+              case FBO::StructureTensorEigenvalues:
+              {
+                MultiArray<N, TinyVector<TmpType, M> > tensor(shape);
+                vectorToTensorMultiArray(sink.gradient, tensor);
+                ConvolutionOptions<N> outerOptions(opt);
+                gaussianSmoothMultiArray(tensor, tensor,
+                                         outerOptions.stdDev(e.outer_scale).resolutionStdDev(0.0));
+                MultiArray<N, TinyVector<TmpType, N> > eigenvalues(shape);
+                transformMultiArray(tensor, eigenvalues,
+                    detail::FeatureBankEigenvaluesFunctor<N, TinyVector<TmpType, M>, TinyVector<TmpType, N> >());
+                for(int i=0; i<(int)N; ++i)
+                    dest.bindOuter(channelOffsets[k] + i) = eigenvalues.bindElementChannel(i);
+                break;
+              }
+            }
+        }
+    }
+}
+
+//@}
+
+} // namespace vigra
+
+#endif /* VIGRA_MULTI_FEATURE_BANK_HXX */
@@ -42,6 +42,12 @@
 #include "navigator.hxx"
 #include "copyimage.hxx"
 #include "threading.hxx"
+#include "multi_convolution.hxx"
+#include <ctime>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
 
 namespace vigra {
 
@@ -397,6 +403,251 @@ fftwPlanExecute(fftwl_plan plan, FFTWComplex<long double> * in,  long double * o
     fftwl_execute_dft_c2r(plan, (fftwl_complex *)in, out);
 }
 
+inline int fftwAlignmentOf(double * p)
+{
+    return fftw_alignment_of(p);
+}
+
+inline int fftwAlignmentOf(float * p)
+{
+    return fftwf_alignment_of(p);
+}
+
+inline int fftwAlignmentOf(long double * p)
+{
+    return fftwl_alignment_of(p);
+}
+
+inline int fftwImportWisdom(double, char const * filename)
+{
+    return fftw_import_wisdom_from_filename(filename);
+}
+
+inline int fftwImportWisdom(float, char const * filename)
+{
+    return fftwf_import_wisdom_from_filename(filename);
+}
+
+inline int fftwImportWisdom(long double, char const * filename)
+{
+    return fftwl_import_wisdom_from_filename(filename);
+}
+
+inline int fftwExportWisdom(double, char const * filename)
+{
+    return fftw_export_wisdom_to_filename(filename);
+}
+
+inline int fftwExportWisdom(float, char const * filename)
+{
+    return fftwf_export_wisdom_to_filename(filename);
+}
+
+inline int fftwExportWisdom(long double, char const * filename)
+{
+    return fftwl_export_wisdom_to_filename(filename);
+}
+
+#ifdef VIGRA_FFTW_THREADS
+
+inline void fftwPlanWithNThreads(double, int n)
+{
+    static bool initialized = fftw_init_threads() != 0;
+    if(initialized)
+        fftw_plan_with_nthreads(n);
+}
+
+inline void fftwPlanWithNThreads(float, int n)
+{
+    static bool initialized = fftwf_init_threads() != 0;
+    if(initialized)
+        fftwf_plan_with_nthreads(n);
+}
+
+inline void fftwPlanWithNThreads(long double, int n)
+{
+    static bool initialized = fftwl_init_threads() != 0;
+    if(initialized)
+        fftwl_plan_with_nthreads(n);
+}
+
+#else // VIGRA_FFTW_THREADS
+
+template <class Real>
+inline void fftwPlanWithNThreads(Real, int)
+{}
+
+#endif // VIGRA_FFTW_THREADS
+
+    // Process-wide settings shared by all precisions. Must only be 
+    // accessed while holding an FFTWLock.
+template <int DUMMY=0>
+struct FFTWSettings
+{
+    static bool cache_plans;
+    static std::size_t cache_max_size;
+    static int num_threads;
+    static std::vector<void (*)()> cache_cleaners;
+    static std::vector<void (*)()> cache_shrinkers;
+};
+
+template <int DUMMY>
+bool FFTWSettings<DUMMY>::cache_plans = true;
+
+template <int DUMMY>
+std::size_t FFTWSettings<DUMMY>::cache_max_size = 64;
+
+template <int DUMMY>
+int FFTWSettings<DUMMY>::num_threads = 1;
+
+template <int DUMMY>
+std::vector<void (*)()> FFTWSettings<DUMMY>::cache_cleaners;
+
+template <int DUMMY>
+std::vector<void (*)()> FFTWSettings<DUMMY>::cache_shrinkers;
+
+    // Process-wide cache of FFTW plans for precision 'Real'. The key encodes
+    // everything FFTW requires to be identical when a plan is re-executed on
+    // new arrays (see fftw_execute_dft() etc.): transform kind and direction,
+    // logical shape, memory layout, in-place-ness and SIMD alignment, plus the 
+    // planner flags and thread count the plan was created with. Cached plans
+    // are owned by the cache. find() and insert() register the calling FFTWPlan
+    // as a user of the plan, and release() unregisters it. When the cache holds 
+    // more than FFTWSettings<>::cache_max_size plans, the least recently used 
+    // plans without users are destroyed. All plans are destroyed by clear().
+    // Must only be accessed while holding an FFTWLock.
+template <class Real>
+class FFTWPlanCache
+{
+  public:
+    typedef typename FFTWReal2Complex<Real>::plan_type PlanType;
+    typedef std::vector<std::ptrdiff_t> Key;
+
+    struct Entry
+    {
+        PlanType plan;
+        std::size_t users;
+        typename std::list<Key>::iterator lru;
+    };
+
+    typedef std::map<Key, Entry> Map;
+
+    static PlanType find(Key const & key)
+    {
+        typename Map::iterator i = plans().find(key);
+        if(i == plans().end())
+            return 0;
+        ++i->second.users;
+        lru().splice(lru().begin(), lru(), i->second.lru);
+        return i->second.plan;
+    }
+
+    static void insert(Key const & key, PlanType plan)
+    {
+        if(plans().empty())
+        {
+            registerCallback(FFTWSettings<>::cache_cleaners, &FFTWPlanCache::clear);
+            registerCallback(FFTWSettings<>::cache_shrinkers, &FFTWPlanCache::shrink);
+        }
+        lru().push_front(key);
+        Entry & entry = plans()[key];
+        entry.plan = plan;
+        entry.users = 1;
+        entry.lru = lru().begin();
+        users()[plan] = plans().find(key);
+        shrink();
+    }
+
+    static void release(PlanType plan)
+    {
+        typename std::map<PlanType, typename Map::iterator>::iterator i = users().find(plan);
+        if(i != users().end())
+        {
+            if(--i->second->second.users == 0)
+                shrink();
+            return;
+        }
+        typename std::map<PlanType, std::size_t>::iterator d = detached().find(plan);
+        if(d != detached().end() && --d->second == 0)
+        {
+            fftwPlanDestroy(plan);
+            detached().erase(d);
+        }
+    }
+
+    static void shrink()
+    {
+        std::size_t maxSize = FFTWSettings<>::cache_max_size;
+        typename std::list<Key>::iterator k = lru().end();
+        while(plans().size() > maxSize && k != lru().begin())
+        {
+            --k;
+            typename Map::iterator i = plans().find(*k);
+            if(i->second.users > 0)
+                continue;
+            fftwPlanDestroy(i->second.plan);
+            users().erase(i->second.plan);
+            plans().erase(i);
+            k = lru().erase(k);
+        }
+    }
+
+        // Plans still held by FFTWPlan objects are only removed from the cache.
+        // They are destroyed when their last user releases them.
+    static void clear()
+    {
+        for(typename Map::iterator i = plans().begin(); i != plans().end(); ++i)
+        {
+            if(i->second.users == 0)
+                fftwPlanDestroy(i->second.plan);
+            else
+                detached()[i->second.plan] = i->second.users;
+        }
+        plans().clear();
+        users().clear();
+        lru().clear();
+    }
+
+    static std::size_t size()
+    {
+        return plans().size();
+    }
+
+  private:
+    static void registerCallback(std::vector<void (*)()> & callbacks, void (*f)())
+    {
+        if(std::find(callbacks.begin(), callbacks.end(), f) == callbacks.end())
+            callbacks.push_back(f);
+    }
+
+    static Map & plans()
+    {
+        static Map map;
+        return map;
+    }
+
+        // most recently used first
+    static std::list<Key> & lru()
+    {
+        static std::list<Key> list;
+        return list;
+    }
+
+    static std::map<PlanType, typename Map::iterator> & users()
+    {
+        static std::map<PlanType, typename Map::iterator> map;
+        return map;
+    }
+
+        // plans removed by clear() while in use, with their remaining user count
+    static std::map<PlanType, std::size_t> & detached()
+    {
+        static std::map<PlanType, std::size_t> map;
+        return map;
+    }
+};
+
+
 template <int DUMMY>
 struct FFTWPaddingSize
 {
@@ -814,6 +1065,173 @@ fftwCorrespondingShapeC2R(TinyVector<T, N> shape, bool oddDimension0 = false)
     return shape;
 }
 
+/********************************************************/
+/*                                                      */
+/*                  FFTW global settings                */
+/*                                                      */
+/********************************************************/
+
+/** \brief Enable or disable the process-wide FFTW plan cache.
+
+    By default, \ref FFTWPlan (and thus \ref FFTWConvolvePlan, \ref FFTWCorrelatePlan and 
+    all functions based on them, such as \ref fourierTransform() and \ref convolveFFT())
+    stores every plan it creates in a process-wide cache. When a plan with the same 
+    transform type, shape, memory layout, alignment, planner flags and thread count is 
+    requested again, the cached plan is re-used, so that repeated transforms of the same 
+    size (e.g. in a registration loop) pay the planning cost only once. 
+    
+    The cache holds at most \ref fftwPlanCacheSize() plans per precision (default: 64). 
+    When this limit is exceeded, the least recently used plans that are not currently 
+    held by an \ref FFTWPlan object are destroyed (plans in use are never destroyed, so 
+    the cache may temporarily grow beyond the limit). All cached plans are released by 
+    \ref fftwClearPlanCache(), but plans in use are only destroyed when they are no 
+    longer needed. Disabling the cache does not release existing plans, 
+    but subsequently created plans are owned by their \ref FFTWPlan object as before.
+    Applications that create plans for many different shapes should either lower
+    the limit by \ref fftwSetPlanCacheSize() or disable the cache.
+
+    <b>\#include</b> \<vigra/multi_fft.hxx\><br>
+    Namespace: vigra
+*/
+inline void fftwSetPlanCaching(bool enable)
+{
+    detail::FFTWLock<> lock;
+    detail::FFTWSettings<>::cache_plans = enable;
+}
+
+/** \brief Query if the FFTW plan cache is enabled.
+
+    See \ref fftwSetPlanCaching().
+*/
+inline bool fftwPlanCaching()
+{
+    detail::FFTWLock<> lock;
+    return detail::FFTWSettings<>::cache_plans;
+}
+
+/** \brief Set the maximum number of plans in the FFTW plan cache.
+
+    The limit applies to each precision (<tt>double</tt>, <tt>float</tt>, 
+    <tt>long double</tt>) separately. If the cache currently holds more plans,
+    the least recently used plans not held by an \ref FFTWPlan object are 
+    destroyed immediately. A limit of zero keeps only the plans in use.
+
+    See \ref fftwSetPlanCaching().
+*/
+inline void fftwSetPlanCacheSize(std::size_t n)
+{
+    detail::FFTWLock<> lock;
+    detail::FFTWSettings<>::cache_max_size = n;
+    std::vector<void (*)()> & shrinkers = detail::FFTWSettings<>::cache_shrinkers;
+    for(unsigned int k=0; k<shrinkers.size(); ++k)
+        shrinkers[k]();
+}
+
+/** \brief Query the maximum number of plans in the FFTW plan cache.
+
+    See \ref fftwSetPlanCacheSize().
+*/
+inline std::size_t fftwPlanCacheSize()
+{
+    detail::FFTWLock<> lock;
+    return detail::FFTWSettings<>::cache_max_size;
+}
+
+/** \brief Destroy all plans in the FFTW plan cache.
+
+    The plans of all precisions (<tt>double</tt>, <tt>float</tt>, <tt>long double</tt>)
+    are removed from the cache. Plans that are still held by \ref FFTWPlan objects 
+    remain valid and are destroyed when the last of these objects releases them.
+
+    See \ref fftwSetPlanCaching().
+*/
+inline void fftwClearPlanCache()
+{
+    detail::FFTWLock<> lock;
+    std::vector<void (*)()> & cleaners = detail::FFTWSettings<>::cache_cleaners;
+    for(unsigned int k=0; k<cleaners.size(); ++k)
+        cleaners[k]();
+}
+
+/** \brief Set the number of threads used by plans created from now on.
+
+    This calls <tt>fftw_init_threads()</tt> and <tt>fftw_plan_with_nthreads()</tt>
+    (or their <tt>float</tt> and <tt>long double</tt> counterparts) before each
+    planning step. <tt>n</tt> is interpreted as in \ref ParallelOptions::numThreads(), 
+    i.e. <tt>ParallelOptions::Auto</tt> selects the number of hardware threads, and 
+    <tt>ParallelOptions::NoThreads</tt> means single-threaded execution. 
+
+    Threaded FFTW is opt-in: the program must be compiled with <tt>VIGRA_FFTW_THREADS</tt>
+    defined and linked against <tt>libfftw3_threads</tt> (or <tt>libfftw3_omp</tt>), and 
+    against the corresponding <tt>float</tt> and <tt>long double</tt> libraries when 
+    transforms of these types are used. When VIGRA's CMake configuration finds the threaded 
+    library, <tt>VigraConfig.cmake</tt> sets <tt>VIGRA_FFTW_THREADS</tt> to true and provides 
+    the libraries in <tt>Vigra_FFTW3_THREADS_LIBRARY</tt> and <tt>Vigra_FFTW3F_THREADS_LIBRARY</tt>, 
+    and <tt>vigra-config --fftw-threads-lib</tt> outputs the corresponding linker flags.
+    Without <tt>VIGRA_FFTW_THREADS</tt>, the setting is recorded but has no effect on the transforms.
+
+    <b>\#include</b> \<vigra/multi_fft.hxx\><br>
+    Namespace: vigra
+*/
+inline void fftwSetNumThreads(int n)
+{
+    n = ParallelOptions().numThreads(n).getActualNumThreads();
+    detail::FFTWLock<> lock;
+    detail::FFTWSettings<>::num_threads = std::max(n, 1);
+}
+
+/** \brief Query the number of threads used for new FFTW plans.
+
+    See \ref fftwSetNumThreads().
+*/
+inline int fftwNumThreads()
+{
+    detail::FFTWLock<> lock;
+    return detail::FFTWSettings<>::num_threads;
+}
+
+/** \brief Load FFTW <a href="http://www.fftw.org/doc/Wisdom.html">wisdom</a> from a file.
+
+    Wisdom records the results of expensive planning with <tt>FFTW_MEASURE</tt> or 
+    <tt>FFTW_PATIENT</tt>. When it is loaded at program start-up, subsequent planning
+    with these flags is almost free. Since FFTW keeps separate wisdom for each precision,
+    the template parameter selects the library (<tt>double</tt>: <tt>libfftw3</tt>, 
+    <tt>float</tt>: <tt>libfftw3f</tt>, <tt>long double</tt>: <tt>libfftw3l</tt>).
+    Returns <tt>false</tt> if the file could not be read.
+
+    <b> Usage:</b>
+
+    <b>\#include</b> \<vigra/multi_fft.hxx\><br>
+    Namespace: vigra
+
+    \code
+    fftwImportWisdom("fftw.wisdom");          // double precision
+    fftwImportWisdom<float>("fftwf.wisdom");  // single precision
+
+    ... // plan with FFTW_MEASURE and transform
+
+    fftwExportWisdom("fftw.wisdom");
+    fftwExportWisdom<float>("fftwf.wisdom");
+    \endcode
+*/
+template <class Real = double>
+bool fftwImportWisdom(std::string const & filename)
+{
+    detail::FFTWLock<> lock;
+    return detail::fftwImportWisdom(Real(), filename.c_str()) != 0;
+}
+
+/** \brief Save the accumulated FFTW wisdom to a file.
+
+    See \ref fftwImportWisdom(). Returns <tt>false</tt> if the file could not be written.
+*/
+template <class Real = double>
+bool fftwExportWisdom(std::string const & filename)
+{
+    detail::FFTWLock<> lock;
+    return detail::fftwExportWisdom(Real(), filename.c_str()) != 0;
+}
+
 /********************************************************/
 /*                                                      */
 /*                       FFTWPlan                       */
@@ -831,6 +1249,11 @@ fftwCorrespondingShapeC2R(TinyVector<T, N> shape, bool oddDimension0 = false)
     about FFTW's planning process (by providing non-default planning flags) and/or want to re-use
     plans for several transformations.
     
+    Plans are looked up in (and added to) a process-wide cache, so that creating an 
+    FFTWPlan for a transform that has been planned before is cheap. See 
+    \ref fftwSetPlanCaching() for details, and \ref fftwSetNumThreads() and 
+    \ref fftwImportWisdom() for other global FFTW settings.
+    
     <b> Usage:</b>
 
     <b>\#include</b> \<vigra/multi_fft.hxx\><br>
@@ -857,6 +1280,7 @@ class FFTWPlan
     PlanType plan;
     Shape shape, instrides, outstrides;
     int sign;
+    bool cached;
     
   public:
         /** \brief Create an empty plan.
@@ -864,7 +1288,8 @@ class FFTWPlan
             The plan can be initialized later by one of the init() functions.
         */
     FFTWPlan()
-    : plan(0)
+    : plan(0),
+      cached(false)
     {}
     
         /** \brief Create a plan for a complex-to-complex transform.
@@ -879,7 +1304,8 @@ class FFTWPlan
     FFTWPlan(MultiArrayView<N, FFTWComplex<Real>, C1> in, 
              MultiArrayView<N, FFTWComplex<Real>, C2> out,
              int SIGN, unsigned int planner_flags = FFTW_ESTIMATE)
-    : plan(0)
+    : plan(0),
+      cached(false)
     {
         init(in, out, SIGN, planner_flags);
     }
@@ -899,7 +1325,8 @@ class FFTWPlan
     FFTWPlan(MultiArrayView<N, Real, C1> in, 
              MultiArrayView<N, FFTWComplex<Real>, C2> out,
              unsigned int planner_flags = FFTW_ESTIMATE)
-    : plan(0)
+    : plan(0),
+      cached(false)
     {
         init(in, out, planner_flags);
     }
@@ -919,7 +1346,8 @@ class FFTWPlan
     FFTWPlan(MultiArrayView<N, FFTWComplex<Real>, C1> in, 
              MultiArrayView<N, Real, C2> out,
              unsigned int planner_flags = FFTW_ESTIMATE)
-    : plan(0)
+    : plan(0),
+      cached(false)
     {
         init(in, out, planner_flags);
     }
@@ -928,7 +1356,8 @@ class FFTWPlan
         */
     FFTWPlan(FFTWPlan const & other)
     : plan(other.plan),
-      sign(other.sign)
+      sign(other.sign),
+      cached(other.cached)
     {
         FFTWPlan & o = const_cast<FFTWPlan &>(other);
         shape.swap(o.shape);
@@ -944,11 +1373,13 @@ class FFTWPlan
         if(this != &other)
         {
             FFTWPlan & o = const_cast<FFTWPlan &>(other);
+            releasePlan();
             plan = o.plan;
             shape.swap(o.shape);
             instrides.swap(o.instrides);
             outstrides.swap(o.outstrides);
             sign = o.sign;
+            cached = o.cached;
             o.plan = 0; // act like std::auto_ptr
         }
         return *this;
@@ -958,8 +1389,7 @@ class FFTWPlan
         */
     ~FFTWPlan()
     {
-        detail::FFTWLock<> lock;
-        detail::fftwPlanDestroy(plan);
+        releasePlan();
     }
 
         /** \brief Init a complex-to-complex transform.
@@ -1057,6 +1487,19 @@ class FFTWPlan
     template <class MI, class MO>
     void initImpl(MI ins, MO outs, int SIGN, unsigned int planner_flags);
     
+        // destroy the plan, or give it back to the cache
+    void releasePlan()
+    {
+        if(plan == 0)
+            return;
+        detail::FFTWLock<> lock;
+        if(cached)
+            detail::FFTWPlanCache<Real>::release(plan);
+        else
+            detail::fftwPlanDestroy(plan);
+        plan = 0;
+    }
+    
     template <class MI, class MO>
     void executeImpl(MI ins, MO outs) const;
     
@@ -1113,12 +1556,46 @@ FFTWPlan<N, Real>::initImpl(MI ins, MO outs, int SIGN, unsigned int planner_flag
     
     {
         detail::FFTWLock<> lock;
-        PlanType newPlan = detail::fftwPlanCreate(N, newShape.begin(), 
+        
+        typedef detail::FFTWPlanCache<Real> Cache;
+        bool useCache = detail::FFTWSettings<>::cache_plans;
+        int numThreads = detail::FFTWSettings<>::num_threads;
+        
+        typename Cache::Key key;
+        PlanType newPlan = 0;
+        if(useCache)
+        {
+            key.push_back(sizeof(typename MI::value_type));
+            key.push_back(sizeof(typename MO::value_type));
+            key.push_back(SIGN);
+            key.push_back(planner_flags);
+            key.push_back(numThreads);
+            key.push_back((void*)ins.data() == (void*)outs.data());
+            key.push_back(detail::fftwAlignmentOf((Real*)ins.data()));
+            key.push_back(detail::fftwAlignmentOf((Real*)outs.data()));
+            key.push_back(ins.stride(N-1));
+            key.push_back(outs.stride(N-1));
+            key.insert(key.end(), newShape.begin(), newShape.end());
+            key.insert(key.end(), itotal.begin(), itotal.end());
+            key.insert(key.end(), ototal.begin(), ototal.end());
+            newPlan = Cache::find(key);
+        }
+        if(newPlan == 0)
+        {
+            detail::fftwPlanWithNThreads(Real(), numThreads);
+            newPlan = detail::fftwPlanCreate(N, newShape.begin(), 
                                       ins.data(), itotal.begin(), ins.stride(N-1),
                                       outs.data(), ototal.begin(), outs.stride(N-1),
                                       SIGN, planner_flags);
-        detail::fftwPlanDestroy(plan);
+            if(useCache && newPlan != 0)
+                Cache::insert(key, newPlan);
+        }
+        if(!cached)
+            detail::fftwPlanDestroy(plan);
+        else
+            Cache::release(plan);
         plan = newPlan;
+        cached = useCache;
     }
     
     shape.swap(newShape);
@@ -1491,11 +1968,17 @@ class FFTWConvolvePlan
             or constructor. However, executeMany() can be called several times on
             the same plan, even with different arrays, as long as they have the appropriate 
             shapes.
+            
+            After the forward transform of the input, the per-kernel multiplications 
+            and inverse transforms are distributed over the threads given in 
+            <tt>options</tt>, each thread working in its own kernel buffer. By default, 
+            everything is executed in the calling thread.
         */
     template <class C1, class KernelIterator, class OutIterator>
     void executeMany(MultiArrayView<N, FFTWComplex<Real>, C1> in, 
                      KernelIterator kernels, KernelIterator kernelsEnd,
-                     OutIterator outs);
+                     OutIterator outs,
+                     ParallelOptions const & options = ParallelOptions().numThreads(ParallelOptions::NoThreads));
                      
         /** \brief Execute a plan to convolve a real array with a sequence of kernels.
          
@@ -1503,11 +1986,17 @@ class FFTWConvolvePlan
             or constructor. However, executeMany() can be called several times on
             the same plan, even with different arrays, as long as they have the appropriate 
             shapes.
+            
+            After the forward transform of the input, the per-kernel multiplications 
+            and inverse transforms are distributed over the threads given in 
+            <tt>options</tt>, each thread working in its own kernel buffer. By default, 
+            everything is executed in the calling thread.
         */
     template <class C1, class KernelIterator, class OutIterator>
     void executeMany(MultiArrayView<N, Real, C1> in, 
                      KernelIterator kernels, KernelIterator kernelsEnd,
-                     OutIterator outs)
+                     OutIterator outs,
+                     ParallelOptions const & options = ParallelOptions().numThreads(ParallelOptions::NoThreads))
     {
         typedef typename std::iterator_traits<KernelIterator>::value_type KernelArray;
         typedef typename KernelArray::value_type KernelValue;
@@ -1523,7 +2012,7 @@ class FFTWConvolvePlan
         vigra_precondition((IsSameType<OutValue, Real>::value),
              "FFTWConvolvePlan::executeMany(): outputs have unsuitable value_type.");
 
-        executeManyImpl(in, kernels, kernelsEnd, outs, UseFourierKernel());
+        executeManyImpl(in, kernels, kernelsEnd, outs, options, UseFourierKernel());
     }
 
   protected:
@@ -1553,13 +2042,24 @@ class FFTWConvolvePlan
     void 
     executeManyImpl(MultiArrayView<N, Real, C1> in, 
                     KernelIterator kernels, KernelIterator kernelsEnd,
-                    OutIterator outs, VigraFalseType /* useFourierKernel*/);
+                    OutIterator outs, ParallelOptions const & options,
+                    VigraFalseType /* useFourierKernel*/);
     
     template <class C1, class KernelIterator, class OutIterator>
     void 
     executeManyImpl(MultiArrayView<N, Real, C1> in, 
                     KernelIterator kernels, KernelIterator kernelsEnd,
-                    OutIterator outs, VigraTrueType /* useFourierKernel*/);
+                    OutIterator outs, ParallelOptions const & options,
+                    VigraTrueType /* useFourierKernel*/);
+    
+        // Call f(kernel, out, realBuffer, fourierBuffer) for all kernels, where
+        // the buffers have the layout of realKernel and fourierKernel. Each 
+        // thread gets its own pair of buffers (thread 0 uses the members). 
+    template <class KernelIterator, class OutIterator, class Functor>
+    void 
+    executeManyParallel(KernelIterator kernels, KernelIterator kernelsEnd,
+                        OutIterator outs, ParallelOptions const & options,
+                        Functor f);
     
 };    
     
@@ -1778,7 +2278,8 @@ template <class C1, class KernelIterator, class OutIterator>
 void 
 FFTWConvolvePlan<N, Real>::executeManyImpl(MultiArrayView<N, Real, C1> in, 
                                            KernelIterator kernels, KernelIterator kernelsEnd,
-                                           OutIterator outs, VigraFalseType /*useFourierKernel*/)
+                                           OutIterator outs, ParallelOptions const & options,
+                                           VigraFalseType /*useFourierKernel*/)
 {
     vigra_precondition(!useFourierKernel,
        "FFTWConvolvePlan::execute(): plan was generated for Fourier kernel, got spatial kernel.");
@@ -1795,17 +2296,19 @@ FFTWConvolvePlan<N, Real>::executeManyImpl(MultiArrayView<N, Real, C1> in,
     detail::fftEmbedArray(in, realArray);
     forward_plan.execute(realArray, fourierArray);
 
-    for(; kernels != kernelsEnd; ++kernels, ++outs)
-    {
-        detail::fftEmbedKernel(*kernels, realKernel);
-        forward_plan.execute(realKernel, fourierKernel);
-        
-        fourierKernel *= fourierArray;
-        
-        backward_plan.execute(fourierKernel, realKernel);
-        
-        *outs = realKernel.subarray(left, right);
-    }
+    executeManyParallel(kernels, kernelsEnd, outs, options,
+        [&](KernelIterator kernel, OutIterator out,
+            RArray realBuffer, MultiArrayView<N, Complex> fourierBuffer)
+        {
+            detail::fftEmbedKernel(*kernel, realBuffer);
+            forward_plan.execute(realBuffer, fourierBuffer);
+            
+            fourierBuffer *= fourierArray;
+            
+            backward_plan.execute(fourierBuffer, realBuffer);
+            
+            *out = realBuffer.subarray(left, right);
+        });
 }
 
 template <unsigned int N, class Real>
@@ -1813,7 +2316,8 @@ template <class C1, class KernelIterator, class OutIterator>
 void 
 FFTWConvolvePlan<N, Real>::executeManyImpl(MultiArrayView<N, Real, C1> in, 
                                            KernelIterator kernels, KernelIterator kernelsEnd,
-                                           OutIterator outs, VigraTrueType /*useFourierKernel*/)
+                                           OutIterator outs, ParallelOptions const & options,
+                                           VigraTrueType /*useFourierKernel*/)
 {
     vigra_precondition(useFourierKernel,
        "FFTWConvolvePlan::execute(): plan was generated for spatial kernel, got Fourier kernel.");
@@ -1833,16 +2337,18 @@ FFTWConvolvePlan<N, Real>::executeManyImpl(MultiArrayView<N, Real, C1> in,
     detail::fftEmbedArray(in, realArray);
     forward_plan.execute(realArray, fourierArray);
 
-    for(; kernels != kernelsEnd; ++kernels, ++outs)
-    {
-        fourierKernel = *kernels;
-        moveDCToHalfspaceUpperLeft(fourierKernel);
-        fourierKernel *= fourierArray;
-        
-        backward_plan.execute(fourierKernel, realKernel);
-        
-        *outs = realKernel.subarray(left, right);
-    }
+    executeManyParallel(kernels, kernelsEnd, outs, options,
+        [&](KernelIterator kernel, OutIterator out,
+            RArray realBuffer, MultiArrayView<N, Complex> fourierBuffer)
+        {
+            fourierBuffer = *kernel;
+            moveDCToHalfspaceUpperLeft(fourierBuffer);
+            fourierBuffer *= fourierArray;
+            
+            backward_plan.execute(fourierBuffer, realBuffer);
+            
+            *out = realBuffer.subarray(left, right);
+        });
 }
 
 template <unsigned int N, class Real>
@@ -1850,7 +2356,7 @@ template <class C1, class KernelIterator, class OutIterator>
 void 
 FFTWConvolvePlan<N, Real>::executeMany(MultiArrayView<N, FFTWComplex<Real>, C1> in, 
                                        KernelIterator kernels, KernelIterator kernelsEnd,
-                                       OutIterator outs)
+                                       OutIterator outs, ParallelOptions const & options)
 {
     typedef typename std::iterator_traits<KernelIterator>::value_type KernelArray;
     typedef typename KernelArray::value_type KernelValue;
@@ -1870,25 +2376,67 @@ FFTWConvolvePlan<N, Real>::executeMany(MultiArrayView<N, FFTWComplex<Real>, C1>
     detail::fftEmbedArray(in, fourierArray);
     forward_plan.execute(fourierArray, fourierArray);
 
-    for(; kernels != kernelsEnd; ++kernels, ++outs)
-    {
-        if(useFourierKernel)
+    executeManyParallel(kernels, kernelsEnd, outs, options,
+        [&](KernelIterator kernel, OutIterator out,
+            RArray, MultiArrayView<N, Complex> fourierBuffer)
         {
-            fourierKernel = *kernels;
-            moveDCToUpperLeft(fourierKernel);
-        }
-        else
-        {
-            detail::fftEmbedKernel(*kernels, fourierKernel);
-            forward_plan.execute(fourierKernel, fourierKernel);
-        }
+            if(useFourierKernel)
+            {
+                fourierBuffer = *kernel;
+                moveDCToUpperLeft(fourierBuffer);
+            }
+            else
+            {
+                detail::fftEmbedKernel(*kernel, fourierBuffer);
+                forward_plan.execute(fourierBuffer, fourierBuffer);
+            }
 
-        fourierKernel *= fourierArray;
-        
-        backward_plan.execute(fourierKernel, fourierKernel);
-        
-        *outs = fourierKernel.subarray(left, right);
+            fourierBuffer *= fourierArray;
+            
+            backward_plan.execute(fourierBuffer, fourierBuffer);
+            
+            *out = fourierBuffer.subarray(left, right);
+        });
+}
+
+template <unsigned int N, class Real>
+template <class KernelIterator, class OutIterator, class Functor>
+void 
+FFTWConvolvePlan<N, Real>::executeManyParallel(KernelIterator kernels, KernelIterator kernelsEnd,
+                                               OutIterator outs, ParallelOptions const & options,
+                                               Functor f)
+{
+    std::vector<KernelIterator> kernelList;
+    std::vector<OutIterator> outList;
+    for(; kernels != kernelsEnd; ++kernels, ++outs)
+    {
+        kernelList.push_back(kernels);
+        outList.push_back(outs);
+    }
+    
+    int count = (int)kernelList.size(),
+        nThreads = std::min(options.getNumThreads(), count);
+    ThreadPool pool(nThreads > 1 ? nThreads : (int)ParallelOptions::NoThreads);
+    int nBuffers = std::max(1, (int)pool.nThreads());
+
+    // FFTWAllocator ensures that the additional buffers have the alignment
+    // the plans were created with
+    ArrayVector<CArray> fourierBuffers(nBuffers - 1);
+    ArrayVector<MultiArrayView<N, Complex> > fourierViews(1, fourierKernel);
+    ArrayVector<RArray> realViews(1, realKernel);
+    for(int k=1; k<nBuffers; ++k)
+    {
+        fourierBuffers[k-1].reshape(fourierKernel.shape());
+        fourierViews.push_back(fourierBuffers[k-1]);
+        realViews.push_back(RArray(realKernel.shape(), realKernel.stride(), 
+                                   (Real*)fourierBuffers[k-1].data()));
     }
+    
+    parallel_foreach(pool, count,
+        [&](int threadIndex, std::ptrdiff_t k)
+        {
+            f(kernelList[k], outList[k], realViews[threadIndex], fourierViews[threadIndex]);
+        });
 }
 
 #endif // DOXYGEN
@@ -2186,7 +2734,9 @@ fourierTransformInverse(MultiArrayView<N, FFTWComplex<Real>, C1> in,
     <DT><b>convolveFFTMany</b><DD> Like <tt>convolveFFT</tt>, but you may provide many kernels at once 
                         (using an iterator pair specifying the kernel sequence). 
                         This has the advantage that the forward transform of the input array needs 
-                        to be executed only once.
+                        to be executed only once. The per-kernel products and inverse transforms 
+                        can be distributed over several threads via a \ref ParallelOptions argument,
+                        and the results can be written into the bands of a single multiband array.
     <DT><b>convolveFFTComplex</b><DD> Convolve a complex-valued input array with a complex-valued kernel, 
                         resulting in a complex-valued output array. An additional flag is used to 
                         specify whether the kernel is defined in the spatial or frequency domain.
@@ -2279,7 +2829,17 @@ fourierTransformInverse(MultiArrayView<N, FFTWComplex<Real>, C1> in,
         void 
         convolveFFTMany(MultiArrayView<N, Real, C1> in, 
                         KernelIterator kernels, KernelIterator kernelsEnd,
-                        OutIterator outs);
+                        OutIterator outs,
+                        ParallelOptions const & options = ParallelOptions().numThreads(ParallelOptions::NoThreads));
+
+        // likewise, but write the result of kernel k into band out.bindOuter(k)
+        template <unsigned int N, class Real, class C1, 
+                  class KernelIterator, class C2>
+        void 
+        convolveFFTMany(MultiArrayView<N, Real, C1> in, 
+                        KernelIterator kernels, KernelIterator kernelsEnd,
+                        MultiArrayView<N+1, Real, C2> out,
+                        ParallelOptions const & options = ParallelOptions().numThreads(ParallelOptions::NoThreads));
     }
     \endcode
 
@@ -2307,7 +2867,8 @@ fourierTransformInverse(MultiArrayView<N, FFTWComplex<Real>, C1> in,
         convolveFFTComplexMany(MultiArrayView<N, FFTWComplex<Real>, C1> in, 
                                KernelIterator kernels, KernelIterator kernelsEnd,
                                OutIterator outs,
-                               bool fourierDomainKernel);
+                               bool fourierDomainKernel,
+                               ParallelOptions const & options = ParallelOptions().numThreads(ParallelOptions::NoThreads));
     }
     \endcode
 
@@ -2340,6 +2901,13 @@ fourierTransformInverse(MultiArrayView<N, FFTWComplex<Real>, C1> in,
             fourier_kernel(x, y) = exp(-0.5*sq(x / double(w))) * exp(-0.5*sq((y-y0)/double(h)));
 
     convolveFFT(src, fourier_kernel, dest);
+    
+    // apply a filter bank, using all cores for the per-kernel inverse transforms 
+    // and writing the response of kernel k into band k of a multiband array
+    std::vector<MultiArray<2, double> > bank = ...;
+    MultiArray<3, double> responses(Shape3(w, h, bank.size()));
+    
+    convolveFFTMany(src, bank.begin(), bank.end(), responses, ParallelOptions());
     \endcode
 */
 doxygen_overloaded_function(template <...> void convolveFFT)
@@ -2389,11 +2957,39 @@ template <unsigned int N, class Real, class C1,
 void 
 convolveFFTMany(MultiArrayView<N, Real, C1> in, 
                 KernelIterator kernels, KernelIterator kernelsEnd,
-                OutIterator outs)
+                OutIterator outs,
+                ParallelOptions const & options = ParallelOptions().numThreads(ParallelOptions::NoThreads))
 {
     FFTWConvolvePlan<N, Real> plan;
     plan.initMany(in, kernels, kernelsEnd, outs);
-    plan.executeMany(in, kernels, kernelsEnd, outs);
+    plan.executeMany(in, kernels, kernelsEnd, outs, options);
+}
+
+template <unsigned int N, class Real, class C1, 
+          class KernelIterator, class C2>
+void 
+convolveFFTMany(MultiArrayView<N, Real, C1> in, 
+                KernelIterator kernels, KernelIterator kernelsEnd,
+                MultiArrayView<N+1, Real, C2> out,
+                ParallelOptions const & options = ParallelOptions().numThreads(ParallelOptions::NoThreads))
+{
+    vigra_precondition(out.shape(N) == std::distance(kernels, kernelsEnd),
+        "convolveFFTMany(): output must have one band per kernel.");
+    ArrayVector<MultiArrayView<N, Real, StridedArrayTag> > outs;
+    for(MultiArrayIndex k=0; k<out.shape(N); ++k)
+        outs.push_back(out.bindOuter(k));
+    convolveFFTMany(in, kernels, kernelsEnd, outs.begin(), options);
+}
+
+template <unsigned int N, class Real, class C1, 
+          class KernelIterator, class A>
+inline void 
+convolveFFTMany(MultiArrayView<N, Real, C1> in, 
+                KernelIterator kernels, KernelIterator kernelsEnd,
+                MultiArray<N+1, Real, A> & out,
+                ParallelOptions const & options = ParallelOptions().numThreads(ParallelOptions::NoThreads))
+{
+    convolveFFTMany(in, kernels, kernelsEnd, MultiArrayView<N+1, Real>(out), options);
 }
 
 /** \brief Convolve a complex-valued array with a sequence of kernels by means of the Fourier transform.
@@ -2408,13 +3004,364 @@ void
 convolveFFTComplexMany(MultiArrayView<N, FFTWComplex<Real>, C1> in, 
                 KernelIterator kernels, KernelIterator kernelsEnd,
                 OutIterator outs,
-                bool fourierDomainKernel)
+                bool fourierDomainKernel,
+                ParallelOptions const & options = ParallelOptions().numThreads(ParallelOptions::NoThreads))
 {
     FFTWConvolvePlan<N, Real> plan;
     plan.initMany(in, kernels, kernelsEnd, outs, fourierDomainKernel);
-    plan.executeMany(in, kernels, kernelsEnd, outs);
+    plan.executeMany(in, kernels, kernelsEnd, outs, options);
+}
+    
+/********************************************************/
+/*                                                      */
+/*                  convolveMultiArray                  */
+/*                                                      */
+/********************************************************/
+
+/** \brief Algorithms available to \ref convolveMultiArray().
+*/
+enum ConvolutionMethod
+{
+    ConvolutionAuto,       ///< choose the cheapest method according to a \ref ConvolutionCostModel
+    ConvolutionDirect,     ///< accumulate shifted copies of the input in the spatial domain
+    ConvolutionSeparable,  ///< factor the kernel and call \ref separableConvolveMultiArray()
+    ConvolutionFFT         ///< multiply in the frequency domain, see \ref convolveFFT()
+};
+
+/** \brief Runtime estimates used by \ref convolveMultiArray() to choose an algorithm.
+
+    The model predicts the run time (in seconds) of each \ref ConvolutionMethod from
+    the array shape and the kernel shape:
+
+    <ul>
+    <li> <b>direct:</b> <tt>directCost * prod(shape) * prod(kernelShape)</tt>
+    <li> <b>separable:</b> <tt>separableCost * prod(shape) * sum(kernelShape)</tt>
+    <li> <b>FFT:</b> <tt>fftCost * M * log2(M)</tt>, where
+         <tt>M = prod(fftwBestPaddedShapeR2C(shape + kernelShape - 1))</tt> is the size
+         of the padded array actually transformed by \ref convolveFFT().
+    </ul>
+
+    The default constants were measured with <tt>double</tt> arrays on a
+    current x86-64 machine. Since the crossover points depend on the CPU, the
+    memory system, and the FFTW build, you may either set the public members
+    directly or call \ref calibrate() once at program start-up and reuse the result.
+
+    <b>\#include</b> \<vigra/multi_fft.hxx\><br/>
+    Namespace: vigra
+*/
+class ConvolutionCostModel
+{
+  public:
+        /** Seconds per multiply-add of the direct method.
+        */
+    double directCost;
+
+        /** Seconds per multiply-add of the separable method.
+        */
+    double separableCost;
+
+        /** Seconds per <tt>M log2(M)</tt> unit of the FFT method, including
+            padding, planning and the spectrum multiplication.
+        */
+    double fftCost;
+
+        /** Create a model with the default constants.
+        */
+    ConvolutionCostModel()
+    : directCost(1.3e-9),
+      separableCost(0.4e-9),
+      fftCost(3.0e-9)
+    {}
+
+        /** Predicted run time of the given method.
+        
+            <tt>ConvolutionSeparable</tt> assumes that the kernel is in fact
+            separable, <tt>ConvolutionAuto</tt> returns the cost of the method
+            chosen by \ref select().
+        */
+    template <int N>
+    double cost(ConvolutionMethod method,
+                TinyVector<MultiArrayIndex, N> const & shape,
+                TinyVector<MultiArrayIndex, N> const & kernelShape,
+                bool separable = false) const
+    {
+        double size = (double)prod(shape);
+        switch(method)
+        {
+          case ConvolutionDirect:
+            return directCost * size * (double)prod(kernelShape);
+          case ConvolutionSeparable:
+            return separableCost * size * (double)sum(kernelShape);
+          case ConvolutionFFT:
+          {
+            double padded = (double)prod(fftwBestPaddedShapeR2C(shape + kernelShape - 
+                                                                TinyVector<MultiArrayIndex, N>(1)));
+            return fftCost * padded * std::log(padded) / std::log(2.0);
+          }
+          default:
+            return cost(select(shape, kernelShape, separable), shape, kernelShape, separable);
+        }
+    }
+
+        /** Return the method with the smallest predicted run time. 
+        
+            <tt>ConvolutionSeparable</tt> is only considered when <tt>separable</tt> 
+            is <tt>true</tt>.
+        */
+    template <int N>
+    ConvolutionMethod select(TinyVector<MultiArrayIndex, N> const & shape,
+                             TinyVector<MultiArrayIndex, N> const & kernelShape,
+                             bool separable = false) const
+    {
+        ConvolutionMethod best = ConvolutionDirect;
+        double bestCost = cost(ConvolutionDirect, shape, kernelShape);
+        if(separable && cost(ConvolutionSeparable, shape, kernelShape) < bestCost)
+        {
+            best = ConvolutionSeparable;
+            bestCost = cost(ConvolutionSeparable, shape, kernelShape);
+        }
+        if(cost(ConvolutionFFT, shape, kernelShape) < bestCost)
+            best = ConvolutionFFT;
+        return best;
+    }
+
+        /** Measure the constants on the current machine.
+        
+            Each method is timed on a <tt>size x size</tt> image of type 
+            <tt>Real</tt> with a 9x9 kernel, and the constants are set from the 
+            observed run times. This takes a fraction of a second with the 
+            default <tt>size</tt>.
+        */
+    template <class Real>
+    static ConvolutionCostModel calibrate(MultiArrayIndex size = 256);
+};
+
+namespace detail {
+
+template <class Functor>
+double convolutionCalibrationTime(Functor f)
+{
+    int repetitions = 0;
+    std::clock_t start = std::clock(), stop;
+    do
+    {
+        f();
+        ++repetitions;
+        stop = std::clock();
+    }
+    while(stop - start < CLOCKS_PER_SEC / 20);
+    return double(stop - start) / CLOCKS_PER_SEC / repetitions;
+}
+
+    // Check whether 'kernel' is an outer product of 1D kernels and compute
+    // the factors if so. Each factor is a line through the largest kernel
+    // coefficient, and the first factor carries the normalization.
+template <unsigned int N, class Real, class C>
+bool
+separableKernelFactors(MultiArrayView<N, Real, C> const & kernel,
+                       ArrayVector<Kernel1D<Real> > & factors)
+{
+    typedef typename MultiArrayShape<N>::type Shape;
+
+    Shape peak;
+    Real peakValue = 0.0;
+    for(MultiCoordinateIterator<N> k(kernel.shape()), end = k.getEndIterator(); k != end; ++k)
+    {
+        if(std::abs(kernel[*k]) > std::abs(peakValue))
+        {
+            peak = *k;
+            peakValue = kernel[*k];
+        }
+    }
+    if(peakValue == 0.0)
+        return false;
+
+    factors.resize(N);
+    Real norm = 1.0;
+    for(unsigned int d=1; d<N; ++d)
+        norm *= peakValue;
+    for(unsigned int d=0; d<N; ++d)
+    {
+        int center = (int)(kernel.shape(d) / 2);
+        factors[d].initExplicitly(-center, (int)kernel.shape(d) - 1 - center);
+        factors[d].setBorderTreatment(BORDER_TREATMENT_REFLECT);
+        Shape p(peak);
+        for(p[d]=0; p[d]<kernel.shape(d); ++p[d])
+            factors[d][(int)p[d] - center] = d == 0
+                                                 ? Real(kernel[p] / norm)
+                                                 : kernel[p];
+    }
+
+    Real tolerance = Real(100.0) * NumericTraits<Real>::epsilon() * std::abs(peakValue);
+    for(MultiCoordinateIterator<N> k(kernel.shape()), end = k.getEndIterator(); k != end; ++k)
+    {
+        Real product = 1.0;
+        for(unsigned int d=0; d<N; ++d)
+            product *= factors[d][(int)(*k)[d] - (int)(kernel.shape(d) / 2)];
+        if(std::abs(product - kernel[*k]) > tolerance)
+            return false;
+    }
+    return true;
 }
+
+    // Spatial domain convolution with the same conventions as convolveFFT():
+    // the input is padded reflectively by the kernel size, and the kernel
+    // origin is at floor(kernel.shape() / 2).
+template <unsigned int N, class Real, class C1, class C2, class C3>
+void
+convolveMultiArrayDirect(MultiArrayView<N, Real, C1> const & in,
+                         MultiArrayView<N, Real, C2> const & kernel,
+                         MultiArrayView<N, Real, C3> out)
+{
+    typedef typename MultiArrayShape<N>::type Shape;
+    using namespace multi_math;
+
+    Shape kernelShape = kernel.shape();
+    MultiArray<N, Real> padded(in.shape() + kernelShape - Shape(1));
+    fftEmbedArray(in, padded);
+
+    out.init(0.0);
+    for(MultiCoordinateIterator<N> k(kernelShape), end = k.getEndIterator(); k != end; ++k)
+    {
+        Real w = kernel[*k];
+        if(w == 0.0)
+            continue;
+        Shape start = kernelShape - Shape(1) - *k;
+        out += w * padded.subarray(start, start + in.shape());
+    }
+}
+
+} // namespace detail
+
+template <class Real>
+ConvolutionCostModel
+ConvolutionCostModel::calibrate(MultiArrayIndex size)
+{
+    typedef MultiArrayShape<2>::type Shape;
+
+    Shape shape(size), small(9);
+    MultiArray<2, Real> in(shape), out(shape), kernel(small, Real(1.0 / prod(small)));
+    for(MultiArrayIndex k=0; k<in.size(); ++k)
+        in[k] = Real(k % 17);
+
+    ArrayVector<Kernel1D<Real> > factors;
+    detail::separableKernelFactors(kernel, factors);
+
+    ConvolutionCostModel model;
+    double n = (double)prod(shape),
+           m = (double)prod(fftwBestPaddedShapeR2C(shape + small - Shape(1)));
     
+    model.directCost = detail::convolutionCalibrationTime(
+        [&]() { detail::convolveMultiArrayDirect(in, kernel, out); }) / (n * prod(small));
+    model.separableCost = detail::convolutionCalibrationTime(
+        [&]() { separableConvolveMultiArray(in, out, factors.begin()); }) / (n * sum(small));
+    model.fftCost = detail::convolutionCalibrationTime(
+        [&]() { convolveFFT(in, kernel, out); }) / (m * std::log(m) / std::log(2.0));
+    return model;
+}
+
+/** \brief Convolve an array with an arbitrary kernel, choosing the fastest algorithm.
+
+    <b> Declaration:</b>
+
+    \code
+    namespace vigra {
+        template <unsigned int N, class Real, class C1, class C2, class C3>
+        ConvolutionMethod
+        convolveMultiArray(MultiArrayView<N, Real, C1> const & in,
+                           MultiArrayView<N, Real, C2> const & kernel,
+                           MultiArrayView<N, Real, C3> out,
+                           ConvolutionMethod method = ConvolutionAuto,
+                           ConvolutionCostModel const & model = ConvolutionCostModel());
+    }
+    \endcode
+
+    The kernel is given as an N-dimensional array in the spatial domain, with the same
+    conventions as in \ref convolveFFT(): its origin is at <tt>floor(kernel.shape() / 2)</tt>,
+    and the input is extended by reflective boundary conditions. Therefore, all methods
+    compute the same result up to round-off. By default (<tt>method = ConvolutionAuto</tt>),
+    the function proceeds as follows:
+
+    <ol>
+    <li> If the kernel is an outer product of 1D kernels (as, for example, 
+         a Gaussian built by <tt>Kernel2D::initGaussian()</tt>), its factors are extracted, and the 
+         separable method becomes a candidate.
+    <li> The <tt>model</tt> predicts the run times of the direct, separable (if applicable), 
+         and FFT methods from the array and kernel shapes, where the FFT estimate is based on the
+         padded shape <tt>fftwBestPaddedShapeR2C(in.shape() + kernel.shape() - 1)</tt>.
+    <li> The cheapest method is executed. Roughly speaking, small kernels are applied 
+         directly, separable kernels are applied line by line, and large 
+         non-separable kernels are applied via \ref convolveFFT().
+    </ol>
+
+    Passing any other <tt>method</tt> forces that algorithm. <tt>ConvolutionSeparable</tt> 
+    throws a <tt>PreconditionViolation</tt> if the kernel is not separable. The function 
+    returns the method that was actually used. Input and output may refer to the same array.
+
+    <b> Usage:</b>
+
+    <b>\#include</b> \<vigra/multi_fft.hxx\><br/>
+    Namespace: vigra
+
+    \code
+    MultiArray<3, float> volume(Shape3(200, 200, 100)), result(volume.shape());
+    MultiArray<3, float> kernel(Shape3(21, 21, 11));
+    ... // fill kernel
+
+    ConvolutionMethod used = convolveMultiArray(volume, kernel, result);
+
+    // measure the crossover points on this machine once, then reuse them
+    ConvolutionCostModel model = ConvolutionCostModel::calibrate<float>();
+    convolveMultiArray(volume, kernel, result, ConvolutionAuto, model);
+    \endcode
+
+    <b> Preconditions:</b>
+
+    <ul>
+    <li> <tt>in.shape() == out.shape()</tt>
+    <li> The kernel radius must be smaller than the array along each axis: 
+         <tt>kernel.shape(k) / 2 < in.shape(k)</tt>.
+    </ul>
+*/
+doxygen_overloaded_function(template <...> ConvolutionMethod convolveMultiArray)
+
+template <unsigned int N, class Real, class C1, class C2, class C3>
+ConvolutionMethod
+convolveMultiArray(MultiArrayView<N, Real, C1> const & in,
+                   MultiArrayView<N, Real, C2> const & kernel,
+                   MultiArrayView<N, Real, C3> out,
+                   ConvolutionMethod method = ConvolutionAuto,
+                   ConvolutionCostModel const & model = ConvolutionCostModel())
+{
+    vigra_precondition(in.shape() == out.shape(),
+        "convolveMultiArray(): shape mismatch between input and output.");
+    for(unsigned int k=0; k<N; ++k)
+        vigra_precondition(kernel.shape(k) > 0 && kernel.shape(k) / 2 < in.shape(k),
+            "convolveMultiArray(): kernel radius must be smaller than the array shape.");
+
+    ArrayVector<Kernel1D<Real> > factors;
+    bool separable = (method == ConvolutionAuto || method == ConvolutionSeparable) &&
+                     detail::separableKernelFactors(kernel, factors);
+
+    if(method == ConvolutionAuto)
+        method = model.select(in.shape(), kernel.shape(), separable);
+
+    switch(method)
+    {
+      case ConvolutionSeparable:
+        vigra_precondition(separable,
+            "convolveMultiArray(): kernel is not separable.");
+        separableConvolveMultiArray(in, out, factors.begin());
+        break;
+      case ConvolutionFFT:
+        convolveFFT(in, kernel, out);
+        break;
+      default:
+        detail::convolveMultiArrayDirect(in, kernel, out);
+    }
+    return method;
+}
+
 /********************************************************/
 /*                                                      */
 /*                     correlateFFT                     */
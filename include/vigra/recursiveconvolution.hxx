@@ -365,6 +365,25 @@ void recursiveFilterLine(SrcIterator is, SrcIterator isend, SrcAccessor as,
 /*                                                      */
 /********************************************************/
 
+namespace detail {
+
+    // coefficients of the Young/van Vliet filter for the given scale
+    // (taken out Luigi Rosa's implementation for Matlab)
+inline void
+recursiveGaussianCoefficients(double sigma, double & B, double & b1, double & b2, double & b3)
+{
+    double q = 1.31564 * (std::sqrt(1.0 + 0.490811 * sigma*sigma) - 1.0);
+    double qq = q*q;
+    double qqq = qq*q;
+    double b0 = 1.0/(1.57825 + 2.44413*q + 1.4281*qq + 0.422205*qqq);
+    b1 = (2.44413*q + 2.85619*qq + 1.26661*qqq)*b0;
+    b2 = (-1.4281*qq - 1.26661*qqq)*b0;
+    b3 = 0.422205*qqq*b0;
+    B = 1.0 - (b1 + b2 + b3);
+}
+
+} // namespace detail
+
 // AUTHOR: Sebastian Boppel
 
 /** \brief Compute a 1-dimensional recursive approximation of Gaussian smoothing.
@@ -448,15 +467,8 @@ recursiveGaussianFilterLine(SrcIterator is, SrcIterator isend, SrcAccessor as,
                             DestIterator id, DestAccessor ad, 
                             double sigma)
 {
-    //coefficients taken out Luigi Rosa's implementation for Matlab
-    double q = 1.31564 * (std::sqrt(1.0 + 0.490811 * sigma*sigma) - 1.0);
-    double qq = q*q;
-    double qqq = qq*q;
-    double b0 = 1.0/(1.57825 + 2.44413*q + 1.4281*qq + 0.422205*qqq);
-    double b1 = (2.44413*q + 2.85619*qq + 1.26661*qqq)*b0;
-    double b2 = (-1.4281*qq - 1.26661*qqq)*b0;
-    double b3 = 0.422205*qqq*b0;
-    double B = 1.0 - (b1 + b2 + b3);
+    double B, b1, b2, b3;
+    detail::recursiveGaussianCoefficients(sigma, B, b1, b2, b3);
     
     int w = isend - is;
     vigra_precondition(w >= 4,
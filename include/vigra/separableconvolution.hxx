@@ -38,6 +38,7 @@
 #define VIGRA_SEPARABLECONVOLUTION_HXX
 
 #include <cmath>
+#include <cstring>
 #include "utilities.hxx"
 #include "numerictraits.hxx"
 #include "imageiteratoradapter.hxx"
@@ -751,6 +752,321 @@ void internalConvolveLineAvoid(SrcIterator is, SrcIterator iend, SrcAccessor sa,
     }
 }
 
+/********************************************************/
+/*                                                      */
+/*              SIMD convolution of a line              */
+/*                                                      */
+/********************************************************/
+
+// convolveLine() has an explicitly vectorized code path for contiguous
+// lines (plain pointers with standard accessors) of float, double, UInt8 
+// and UInt16 pixels convolved with float or double kernels. The kernel loop 
+// is compiled for SSE2, AVX2 and AVX-512 via GCC/Clang vector extensions, 
+// and the best variant supported by the CPU is chosen at runtime. 
+// Define VIGRA_NO_SIMD to disable this code path. On 32-bit x86, it is 
+// only enabled when the baseline already includes SSE2, because the 
+// "+v" register constraints of the generic code need vector registers.
+#if !defined(VIGRA_NO_SIMD) && \
+    (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 9))
+#  define VIGRA_CONVOLVE_LINE_SIMD
+#endif
+
+namespace detail {
+
+    // the value type of a contiguous line, or void
+template <class Iterator, class Accessor>
+struct ContiguousLineValue
+{
+    typedef void type;
+};
+
+#define VIGRA_CONTIGUOUS_LINE_VALUE(ACCESSOR) \
+template <class T> \
+struct ContiguousLineValue<T *, ACCESSOR<T> > \
+{ \
+    typedef T type; \
+}; \
+template <class T> \
+struct ContiguousLineValue<T const *, ACCESSOR<T> > \
+{ \
+    typedef T type; \
+};
+
+VIGRA_CONTIGUOUS_LINE_VALUE(StandardAccessor)
+VIGRA_CONTIGUOUS_LINE_VALUE(StandardConstAccessor)
+VIGRA_CONTIGUOUS_LINE_VALUE(StandardValueAccessor)
+VIGRA_CONTIGUOUS_LINE_VALUE(StandardConstValueAccessor)
+
+#undef VIGRA_CONTIGUOUS_LINE_VALUE
+
+template <class SrcType, class KernelType>
+struct ConvolveLineSimdTypes
+{
+    typedef VigraFalseType type;
+};
+
+#ifdef VIGRA_CONVOLVE_LINE_SIMD
+
+template <> struct ConvolveLineSimdTypes<float, float>   { typedef VigraTrueType type; };
+template <> struct ConvolveLineSimdTypes<float, double>  { typedef VigraTrueType type; };
+template <> struct ConvolveLineSimdTypes<double, float>  { typedef VigraTrueType type; };
+template <> struct ConvolveLineSimdTypes<double, double> { typedef VigraTrueType type; };
+template <> struct ConvolveLineSimdTypes<UInt8, float>   { typedef VigraTrueType type; };
+template <> struct ConvolveLineSimdTypes<UInt8, double>  { typedef VigraTrueType type; };
+template <> struct ConvolveLineSimdTypes<UInt16, float>  { typedef VigraTrueType type; };
+template <> struct ConvolveLineSimdTypes<UInt16, double> { typedef VigraTrueType type; };
+
+#endif // VIGRA_CONVOLVE_LINE_SIMD
+
+    // VigraTrueType if convolveLine() can use the SIMD code path
+template <class SrcIterator, class SrcAccessor,
+          class KernelIterator, class KernelAccessor>
+struct ConvolveLineSimd
+: public ConvolveLineSimdTypes<typename ContiguousLineValue<SrcIterator, SrcAccessor>::type,
+                               typename ContiguousLineValue<KernelIterator, KernelAccessor>::type>
+{};
+
+    // lines whose interior is shorter than this are processed by the scalar code
+static const int convolveLineSimdMinimumLength = 16;
+
+#ifdef VIGRA_CONVOLVE_LINE_SIMD
+
+    // Compute d[x] = sum_k kernel[k]*s[x-k*stride] for 0 <= x < n with vectors 
+    // of BYTES bytes. The summation order is the same as in the scalar code.
+    // A stride > 1 convolves 'stride' interleaved lines at once.
+template <int BYTES, class S, class K, class Sum>
+inline __attribute__((always_inline)) void 
+convolveLineSimdKernel(S const * s, K const * kernel, int kleft, int kright, 
+                       Sum * d, int n, int stride)
+{
+    enum { M = BYTES / sizeof(Sum) };
+    typedef Sum SumVector __attribute__((vector_size(BYTES)));
+    typedef S SrcVector __attribute__((vector_size(M*sizeof(S))));
+
+    int x = 0;
+    for(; x + 2*M <= n; x += 2*M)
+    {
+        SumVector sum0 = SumVector(), sum1 = SumVector();
+        for(int k = kright; k >= kleft; --k)
+        {
+            SumVector kv = SumVector() + static_cast<Sum>(kernel[k]);
+            SrcVector s0, s1;
+            std::memcpy(&s0, s + x - k*stride, sizeof(SrcVector));
+            std::memcpy(&s1, s + x + M - k*stride, sizeof(SrcVector));
+            SumVector p0 = kv * __builtin_convertvector(s0, SumVector),
+                      p1 = kv * __builtin_convertvector(s1, SumVector);
+#ifndef __FMA__
+            // AVX-512 implies FMA, but the generic code is compiled without it:
+            // prevent contraction into fused multiply-adds to get identical results
+            __asm__("" : "+v"(p0), "+v"(p1));
+#endif
+            sum0 += p0;
+            sum1 += p1;
+        }
+        std::memcpy(d + x, &sum0, sizeof(SumVector));
+        std::memcpy(d + x + M, &sum1, sizeof(SumVector));
+    }
+    for(; x < n; ++x)
+    {
+        Sum sum = Sum();
+        for(int k = kright; k >= kleft; --k)
+        {
+            Sum p = static_cast<Sum>(kernel[k]) * static_cast<Sum>(s[x - k*stride]);
+#ifndef __FMA__
+            __asm__("" : "+v"(p));
+#endif
+            sum += p;
+        }
+        d[x] = sum;
+    }
+}
+
+template <class S, class K, class Sum>
+__attribute__((target("avx512f"))) void 
+convolveLineAVX512(S const * s, K const * kernel, int kleft, int kright, Sum * d, int n,
+                   int stride)
+{
+    convolveLineSimdKernel<64>(s, kernel, kleft, kright, d, n, stride);
+}
+
+template <class S, class K, class Sum>
+__attribute__((target("avx2"))) void 
+convolveLineAVX2(S const * s, K const * kernel, int kleft, int kright, Sum * d, int n,
+                 int stride)
+{
+    convolveLineSimdKernel<32>(s, kernel, kleft, kright, d, n, stride);
+}
+
+template <class S, class K, class Sum>
+void 
+convolveLineSSE2(S const * s, K const * kernel, int kleft, int kright, Sum * d, int n,
+                 int stride)
+{
+    convolveLineSimdKernel<16>(s, kernel, kleft, kright, d, n, stride);
+}
+
+    // 2: AVX-512, 1: AVX2, 0: SSE2
+inline int convolveLineSimdLevel()
+{
+    static const int level = __builtin_cpu_supports("avx512f")
+                                  ? 2
+                                  : __builtin_cpu_supports("avx2")
+                                       ? 1
+                                       : 0;
+    return level;
+}
+
+template <class S, class K, class Sum>
+inline void 
+convolveLineSimd(S const * s, K const * kernel, int kleft, int kright, Sum * d, int n,
+                 int stride = 1)
+{
+    switch(convolveLineSimdLevel())
+    {
+      case 2:
+        convolveLineAVX512(s, kernel, kleft, kright, d, n, stride);
+        break;
+      case 1:
+        convolveLineAVX2(s, kernel, kleft, kright, d, n, stride);
+        break;
+      default:
+        convolveLineSSE2(s, kernel, kleft, kright, d, n, stride);
+    }
+}
+
+#endif // VIGRA_CONVOLVE_LINE_SIMD
+
+template <class SrcIterator, class SrcAccessor,
+          class DestIterator, class DestAccessor,
+          class KernelIterator, class KernelAccessor>
+void convolveLineSwitch(SrcIterator is, SrcIterator iend, SrcAccessor sa,
+                        DestIterator id, DestAccessor da,
+                        KernelIterator ik, KernelAccessor ka,
+                        int kleft, int kright, BorderTreatmentMode border,
+                        int start, int stop)
+{
+    switch(border)
+    {
+      case BORDER_TREATMENT_WRAP:
+      {
+        internalConvolveLineWrap(is, iend, sa, id, da, ik, ka, kleft, kright, start, stop);
+        break;
+      }
+      case BORDER_TREATMENT_AVOID:
+      {
+        internalConvolveLineAvoid(is, iend, sa, id, da, ik, ka, kleft, kright, start, stop);
+        break;
+      }
+      case BORDER_TREATMENT_REFLECT:
+      {
+        internalConvolveLineReflect(is, iend, sa, id, da, ik, ka, kleft, kright, start, stop);
+        break;
+      }
+      case BORDER_TREATMENT_REPEAT:
+      {
+        internalConvolveLineRepeat(is, iend, sa, id, da, ik, ka, kleft, kright, start, stop);
+        break;
+      }
+      case BORDER_TREATMENT_CLIP:
+      {
+        // find norm of kernel
+        typedef typename KernelAccessor::value_type KT;
+        KT norm = NumericTraits<KT>::zero();
+        KernelIterator iik = ik + kleft;
+        for(int i=kleft; i<=kright; ++i, ++iik)
+            norm += ka(iik);
+
+        vigra_precondition(norm != NumericTraits<KT>::zero(),
+                     "convolveLine(): Norm of kernel must be != 0"
+                     " in mode BORDER_TREATMENT_CLIP.\n");
+
+        internalConvolveLineClip(is, iend, sa, id, da, ik, ka, kleft, kright, norm, start, stop);
+        break;
+      }
+      case BORDER_TREATMENT_ZEROPAD:
+      {
+        internalConvolveLineZeropad(is, iend, sa, id, da, ik, ka, kleft, kright, start, stop);
+        break;
+      }
+      default:
+      {
+        vigra_precondition(0,
+                     "convolveLine(): Unknown border treatment mode.\n");
+      }
+    }
+}
+
+template <class SrcIterator, class SrcAccessor,
+          class DestIterator, class DestAccessor,
+          class KernelIterator, class KernelAccessor>
+inline void 
+convolveLineImpl(SrcIterator is, SrcIterator iend, SrcAccessor sa,
+                 DestIterator id, DestAccessor da,
+                 KernelIterator ik, KernelAccessor ka,
+                 int kleft, int kright, BorderTreatmentMode border,
+                 int start, int stop, VigraFalseType)
+{
+    convolveLineSwitch(is, iend, sa, id, da, ik, ka, kleft, kright, border, start, stop);
+}
+
+#ifdef VIGRA_CONVOLVE_LINE_SIMD
+
+    // The interior of the line, where the kernel fits completely, is computed 
+    // by the SIMD kernel, the borders by the scalar code.
+template <class SrcIterator, class SrcAccessor,
+          class DestIterator, class DestAccessor,
+          class KernelIterator, class KernelAccessor>
+void 
+convolveLineImpl(SrcIterator is, SrcIterator iend, SrcAccessor sa,
+                 DestIterator id, DestAccessor da,
+                 KernelIterator ik, KernelAccessor ka,
+                 int kleft, int kright, BorderTreatmentMode border,
+                 int start, int stop, VigraTrueType)
+{
+    typedef typename PromoteTraits<
+            typename SrcAccessor::value_type,
+            typename KernelAccessor::value_type>::Promote SumType;
+    typedef typename DestAccessor::value_type DestType;
+
+    int w = std::distance( is, iend );
+    if(stop == 0)
+    {
+        start = 0;
+        stop = w;
+    }
+    int interiorBegin = std::max(start, kright),
+        interiorEnd   = std::min(stop, w + kleft);
+    if(interiorEnd - interiorBegin < convolveLineSimdMinimumLength)
+    {
+        convolveLineSwitch(is, iend, sa, id, da, ik, ka, kleft, kright, border, start, stop);
+        return;
+    }
+
+    if(border != BORDER_TREATMENT_AVOID && start < interiorBegin)
+        convolveLineSwitch(is, iend, sa, id, da, ik, ka, kleft, kright, border, 
+                           start, interiorBegin);
+
+    enum { BufferSize = 256 };
+    SumType buffer[BufferSize];
+    DestIterator d = id + (interiorBegin - start);
+    for(int x = interiorBegin; x < interiorEnd; x += BufferSize)
+    {
+        int n = std::min<int>(BufferSize, interiorEnd - x);
+        convolveLineSimd(&*(is + x), &*ik, kleft, kright, buffer, n);
+        for(int k = 0; k < n; ++k, ++d)
+            da.set(RequiresExplicitCast<DestType>::cast(buffer[k]), d);
+    }
+
+    if(border != BORDER_TREATMENT_AVOID && interiorEnd < stop)
+        convolveLineSwitch(is, iend, sa, id + (interiorEnd - start), da, ik, ka, 
+                           kleft, kright, border, interiorEnd, stop);
+}
+
+#endif // VIGRA_CONVOLVE_LINE_SIMD
+
+} // namespace detail
+
 /********************************************************/
 /*                                                      */
 /*         Separable convolution functions              */
@@ -794,6 +1110,14 @@ void internalConvolveLineAvoid(SrcIterator is, SrcIterator iend, SrcAccessor sa,
     <tt>start</tt>). If <tt>start</tt> and <tt>stop</tt> are both zero 
     (the default), the entire array is convolved.
 
+    When the signal is a contiguous array of <tt>float</tt>, <tt>double</tt>, 
+    <tt>UInt8</tt> or <tt>UInt16</tt> (i.e. the iterators are plain pointers and 
+    the accessors are standard accessors), and the kernel is a <tt>float</tt> or 
+    <tt>double</tt> array (e.g. a \ref vigra::Kernel1D), the part of the line where 
+    the kernel fits completely is computed with SIMD instructions (SSE2, AVX2 or 
+    AVX-512, whichever the CPU supports). Define <tt>VIGRA_NO_SIMD</tt> to disable
+    this code path.
+
     <b> Declarations:</b>
 
     pass \ref ImageIterators and \ref DataAccessors :
@@ -917,59 +1241,9 @@ void convolveLine(SrcIterator is, SrcIterator iend, SrcAccessor sa,
         vigra_precondition(0 <= start && start < stop && stop <= w,
                         "convolveLine(): invalid subrange (start, stop).\n");
 
-    typedef typename PromoteTraits<
-            typename SrcAccessor::value_type,
-            typename KernelAccessor::value_type>::Promote SumType;
-    ArrayVector<SumType> a(iend - is); 
-    switch(border)
-    {
-      case BORDER_TREATMENT_WRAP:
-      {
-        internalConvolveLineWrap(is, iend, sa, id, da, ik, ka, kleft, kright, start, stop);
-        break;
-      }
-      case BORDER_TREATMENT_AVOID:
-      {
-        internalConvolveLineAvoid(is, iend, sa, id, da, ik, ka, kleft, kright, start, stop);
-        break;
-      }
-      case BORDER_TREATMENT_REFLECT:
-      {
-        internalConvolveLineReflect(is, iend, sa, id, da, ik, ka, kleft, kright, start, stop);
-        break;
-      }
-      case BORDER_TREATMENT_REPEAT:
-      {
-        internalConvolveLineRepeat(is, iend, sa, id, da, ik, ka, kleft, kright, start, stop);
-        break;
-      }
-      case BORDER_TREATMENT_CLIP:
-      {
-        // find norm of kernel
-        typedef typename KernelAccessor::value_type KT;
-        KT norm = NumericTraits<KT>::zero();
-        KernelIterator iik = ik + kleft;
-        for(int i=kleft; i<=kright; ++i, ++iik)
-            norm += ka(iik);
-
-        vigra_precondition(norm != NumericTraits<KT>::zero(),
-                     "convolveLine(): Norm of kernel must be != 0"
-                     " in mode BORDER_TREATMENT_CLIP.\n");
-
-        internalConvolveLineClip(is, iend, sa, id, da, ik, ka, kleft, kright, norm, start, stop);
-        break;
-      }
-      case BORDER_TREATMENT_ZEROPAD:
-      {
-        internalConvolveLineZeropad(is, iend, sa, id, da, ik, ka, kleft, kright, start, stop);
-        break;
-      }
-      default:
-      {
-        vigra_precondition(0,
-                     "convolveLine(): Unknown border treatment mode.\n");
-      }
-    }
+    detail::convolveLineImpl(is, iend, sa, id, da, ik, ka, kleft, kright, border, start, stop,
+                             typename detail::ConvolveLineSimd<SrcIterator, SrcAccessor,
+                                                               KernelIterator, KernelAccessor>::type());
 }
 
 template <class SrcIterator, class SrcAccessor,
@@ -1409,7 +1683,9 @@ class Kernel1D
         {}
 
         ~InitProxy() 
-#ifndef _MSC_VER
+#if __cplusplus >= 201103L
+             noexcept(false)
+#elif !defined(_MSC_VER)
              throw(PreconditionViolation)
 #endif
         {
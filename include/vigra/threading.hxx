@@ -40,26 +40,15 @@
    when the compiler doesn't yet support C++11.
 */
 
+#include "config.hxx"
+
     // ignore all threading if VIGRA_SINGLE_THREADED is defined
 #ifndef VIGRA_SINGLE_THREADED
 
-#ifndef VIGRA_NO_STD_THREADING 
-# if defined(__clang__)
-#  if (!__has_include(<thread>) || !__has_include(<mutex>) || !__has_include(<atomic>))
-#    define VIGRA_NO_STD_THREADING
-#  endif
-# else
-#  if defined(__GNUC__) && (!defined(_GLIBCXX_HAS_GTHREADS) || !defined(_GLIBCXX_USE_C99_STDINT_TR1) || !defined(_GLIBCXX_USE_SCHED_YIELD))
-#    define VIGRA_NO_STD_THREADING
-#  endif
-# endif
-
-# if defined(_MSC_VER) && _MSC_VER <= 1600
-#  define VIGRA_NO_STD_THREADING
-# endif
-#endif
-
 #ifdef USE_BOOST_THREAD
+#  ifndef BOOST_THREAD_PROVIDES_FUTURE
+#    define BOOST_THREAD_PROVIDES_FUTURE
+#  endif
 #  include <boost/thread.hpp>
 #  if BOOST_VERSION >= 105300
 #    include <boost/atomic.hpp>
@@ -71,6 +60,8 @@
 #else
 #  include <thread>
 #  include <mutex>
+#  include <condition_variable>
+#  include <future>
 // #  include <shared_mutex>  // C++14
 #  include <atomic>
 #  define VIGRA_HAS_ATOMIC 1
@@ -120,6 +111,21 @@ using VIGRA_THREADING_NAMESPACE::lock;
 using VIGRA_THREADING_NAMESPACE::once_flag;
 using VIGRA_THREADING_NAMESPACE::call_once;
 
+// contents of <condition_variable>
+
+using VIGRA_THREADING_NAMESPACE::condition_variable;
+using VIGRA_THREADING_NAMESPACE::condition_variable_any;
+using VIGRA_THREADING_NAMESPACE::cv_status;
+
+// contents of <future>
+
+using VIGRA_THREADING_NAMESPACE::future;
+using VIGRA_THREADING_NAMESPACE::shared_future;
+using VIGRA_THREADING_NAMESPACE::promise;
+using VIGRA_THREADING_NAMESPACE::packaged_task;
+using VIGRA_THREADING_NAMESPACE::future_error;
+using VIGRA_THREADING_NAMESPACE::future_status;
+
 // contents of <shared_mutex>
 
 // using VIGRA_THREADING_NAMESPACE::shared_mutex;   // C++14
@@ -0,0 +1,692 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2014-2015 by Ullrich Koethe                  */
+/*                                                                      */
+/*    This file is part of the VIGRA computer vision library.           */
+/*    The VIGRA Website is                                              */
+/*        http://hci.iwr.uni-heidelberg.de/vigra/                       */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef VIGRA_THREADPOOL_HXX
+#define VIGRA_THREADPOOL_HXX
+
+#include <vector>
+#include <deque>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include "error.hxx"
+#include "threading.hxx"
+
+namespace vigra {
+
+/** \addtogroup ParallelProcessing Parallel Processing
+
+    Thread pool and parallel loops shared by VIGRA's multi-threaded algorithms.
+*/
+//@{
+
+/********************************************************/
+/*                                                      */
+/*                    ParallelOptions                   */
+/*                                                      */
+/********************************************************/
+
+    /** \brief Option object for parallel algorithms.
+
+        Determines how many threads a \ref vigra::ThreadPool (and the algorithms
+        using it) shall start.
+
+        <b>\#include</b> \<vigra/threadpool.hxx\><br/>
+        Namespace: vigra
+    */
+class ParallelOptions
+{
+  public:
+
+        /** Special values for \ref numThreads():
+            <ul>
+            <li> <tt>Auto</tt>: one thread per core (as reported by <tt>hardware_concurrency()</tt>)
+            <li> <tt>Nice</tt>: half as many threads as there are cores
+            <li> <tt>NoThreads</tt>: execute everything in the calling thread
+            </ul>
+        */
+    enum {
+        Auto       = -1,
+        Nice       = -2,
+        NoThreads  =  0
+    };
+
+        /** Create options with <tt>numThreads(Auto)</tt>.
+        */
+    ParallelOptions()
+    : numThreads_(actualNumThreads(Auto))
+    {}
+
+        /** Get the desired number of worker threads (0 means: no threading).
+        */
+    int getNumThreads() const
+    {
+        return numThreads_;
+    }
+
+        /** Get the number of threads that will actually execute work
+            (at least 1, because the calling thread is used when
+            <tt>getNumThreads() == 0</tt>).
+        */
+    int getActualNumThreads() const
+    {
+        return std::max(1, numThreads_);
+    }
+
+        /** Set the number of threads, or one of the special values <tt>Auto</tt>,
+            <tt>Nice</tt>, <tt>NoThreads</tt>.
+
+            Default: <tt>Auto</tt>
+        */
+    ParallelOptions & numThreads(const int n)
+    {
+        numThreads_ = actualNumThreads(n);
+        return *this;
+    }
+
+  private:
+
+    static int actualNumThreads(const int userNThreads)
+    {
+    #ifdef VIGRA_SINGLE_THREADED
+        return 0;
+    #else
+        if(userNThreads >= 0)
+            return userNThreads;
+        int cores = (int)threading::thread::hardware_concurrency();
+        return userNThreads == Nice
+                   ? std::max(1, cores / 2)
+                   : std::max(1, cores);
+    #endif
+    }
+
+    int numThreads_;
+};
+
+#ifndef VIGRA_SINGLE_THREADED
+
+/********************************************************/
+/*                                                      */
+/*                      ThreadPool                      */
+/*                                                      */
+/********************************************************/
+
+    /** \brief Work-stealing thread pool.
+
+        Every worker thread owns a task queue. Tasks enqueued by a worker (e.g. by
+        a nested \ref parallel_foreach()) go to the worker's own queue and are
+        executed in LIFO order for cache locality. Tasks enqueued from outside the pool
+        are distributed round-robin over the queues. Idle workers steal the oldest
+        tasks from the other queues, so that uneven workloads are balanced automatically.
+
+        Tasks are functors with signature <tt>R f(int threadIndex)</tt>, where
+        <tt>threadIndex</tt> is the index of the executing worker in
+        <tt>[0, nThreads())</tt>. It can be used to address per-thread buffers.
+        When the pool has no worker threads (<tt>ParallelOptions::NoThreads</tt>),
+        tasks are executed immediately in the calling thread with index 0.
+
+        <b>Usage:</b>
+
+        \code
+        ThreadPool pool(ParallelOptions().numThreads(4));
+
+        threading::future<int> f = pool.enqueueReturning([](int threadIndex)
+        {
+            return 42;
+        });
+        std::cout << f.get() << "\n";
+
+        pool.waitFinished(); // wait until all enqueued tasks are done
+        \endcode
+
+        <b>\#include</b> \<vigra/threadpool.hxx\><br/>
+        Namespace: vigra
+    */
+class ThreadPool
+{
+    typedef std::function<void(int)> Task;
+
+    struct TaskQueue
+    {
+        threading::mutex mutex_;
+        std::deque<Task> tasks_;
+    };
+
+  public:
+
+        /** Create a pool with <tt>options.getNumThreads()</tt> worker threads.
+        */
+    explicit ThreadPool(ParallelOptions const & options)
+    : stop_(false),
+      pending_(0),
+      busy_(0),
+      next_queue_(0)
+    {
+        init(options);
+    }
+
+        /** Create a pool with <tt>n</tt> worker threads (or one of the special values
+            defined in \ref ParallelOptions).
+        */
+    explicit ThreadPool(const int n)
+    : stop_(false),
+      pending_(0),
+      busy_(0),
+      next_queue_(0)
+    {
+        init(ParallelOptions().numThreads(n));
+    }
+
+        /** Execute the remaining tasks and join all worker threads.
+        */
+    ~ThreadPool()
+    {
+        {
+            threading::lock_guard<threading::mutex> lock(sleep_mutex_);
+            stop_ = true;
+        }
+        worker_condition_.notify_all();
+        for(std::size_t k = 0; k < workers_.size(); ++k)
+            workers_[k].join();
+    }
+
+        /** Enqueue a task whose result shall be retrieved via the returned future.
+            Exceptions thrown by the task are rethrown by <tt>future::get()</tt>.
+        */
+    template <class F>
+    auto enqueueReturning(F && f) -> threading::future<decltype(f(0))>
+    {
+        typedef decltype(f(0)) result_type;
+        typedef threading::packaged_task<result_type(int)> PackagedTask;
+
+        std::shared_ptr<PackagedTask> task = std::make_shared<PackagedTask>(std::forward<F>(f));
+        threading::future<result_type> res = task->get_future();
+
+        if(workers_.size() == 0)
+            (*task)(0);
+        else
+            push([task](int threadIndex) { (*task)(threadIndex); });
+        return res;
+    }
+
+        /** Enqueue a task without result. The returned future can be used to wait for
+            completion of this particular task and to catch its exceptions.
+        */
+    template <class F>
+    threading::future<void> enqueue(F && f)
+    {
+        typedef threading::packaged_task<void(int)> PackagedTask;
+
+        std::shared_ptr<PackagedTask> task = std::make_shared<PackagedTask>(std::forward<F>(f));
+        threading::future<void> res = task->get_future();
+
+        if(workers_.size() == 0)
+            (*task)(0);
+        else
+            push([task](int threadIndex) { (*task)(threadIndex); });
+        return res;
+    }
+
+        /** Block until all tasks enqueued so far are finished.
+
+            Must not be called from a worker thread of this pool (it would wait for itself).
+        */
+    void waitFinished()
+    {
+        vigra_precondition(currentThreadIndex() < 0,
+            "ThreadPool::waitFinished(): must not be called from a worker thread of the same pool.");
+        threading::unique_lock<threading::mutex> lock(sleep_mutex_);
+        while(busy_.load() > 0)
+            finish_condition_.wait(lock);
+    }
+
+        /** If called from a worker thread of this pool, execute one pending task
+            (from the own queue or stolen from another worker) and return <tt>true</tt>.
+            Otherwise, return <tt>false</tt>.
+
+            This allows workers to help with the work instead of blocking while
+            they wait for nested tasks.
+        */
+    bool runPendingTask()
+    {
+        int threadIndex = currentThreadIndex();
+        if(threadIndex < 0)
+            return false;
+        Task task;
+        if(!popTask(threadIndex, task))
+            return false;
+        runTask(threadIndex, task);
+        return true;
+    }
+
+        /** Index of the calling thread in <tt>[0, nThreads())</tt> if it is a worker
+            thread of this pool, -1 otherwise.
+        */
+    int currentThreadIndex() const
+    {
+        threading::thread::id self = threading::this_thread::get_id();
+        for(std::size_t k = 0; k < worker_ids_.size(); ++k)
+            if(worker_ids_[k] == self)
+                return (int)k;
+        return -1;
+    }
+
+        /** Number of worker threads (0 means that tasks are executed in the calling thread).
+        */
+    std::size_t nThreads() const
+    {
+        return workers_.size();
+    }
+
+  private:
+
+    ThreadPool(ThreadPool const &);               // forbidden
+    ThreadPool & operator=(ThreadPool const &);   // forbidden
+
+    void init(ParallelOptions const & options)
+    {
+        const int n = options.getNumThreads();
+        for(int k = 0; k < n; ++k)
+            queues_.push_back(std::unique_ptr<TaskQueue>(new TaskQueue));
+        for(int k = 0; k < n; ++k)
+            workers_.push_back(threading::thread(&ThreadPool::workerLoop, this, k));
+        // workers only look up their index while executing tasks, which
+        // cannot be enqueued before the constructor has returned
+        for(int k = 0; k < n; ++k)
+            worker_ids_.push_back(workers_[k].get_id());
+    }
+
+    void push(Task && task)
+    {
+        int threadIndex = currentThreadIndex();
+        std::size_t q = threadIndex >= 0
+                            ? (std::size_t)threadIndex
+                            : (std::size_t)next_queue_.fetch_add(1) % queues_.size();
+        busy_.fetch_add(1);
+        {
+            threading::lock_guard<threading::mutex> lock(queues_[q]->mutex_);
+            queues_[q]->tasks_.push_back(std::move(task));
+        }
+        pending_.fetch_add(1);
+        {
+            // acquire the mutex so that the notification cannot get lost between
+            // a worker's predicate check and its call to wait()
+            threading::lock_guard<threading::mutex> lock(sleep_mutex_);
+        }
+        worker_condition_.notify_one();
+    }
+
+    bool popTask(int threadIndex, Task & task)
+    {
+        // own queue: newest task first
+        {
+            TaskQueue & queue = *queues_[threadIndex];
+            threading::lock_guard<threading::mutex> lock(queue.mutex_);
+            if(!queue.tasks_.empty())
+            {
+                task = std::move(queue.tasks_.back());
+                queue.tasks_.pop_back();
+                pending_.fetch_sub(1);
+                return true;
+            }
+        }
+        // steal the oldest task from another queue
+        const std::size_t n = queues_.size();
+        for(std::size_t k = 1; k < n; ++k)
+        {
+            TaskQueue & queue = *queues_[(threadIndex + k) % n];
+            threading::lock_guard<threading::mutex> lock(queue.mutex_);
+            if(!queue.tasks_.empty())
+            {
+                task = std::move(queue.tasks_.front());
+                queue.tasks_.pop_front();
+                pending_.fetch_sub(1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void runTask(int threadIndex, Task & task)
+    {
+        // packaged_task stores exceptions in the future, so 'task' doesn't throw
+        task(threadIndex);
+        if(busy_.fetch_sub(1) == 1)
+        {
+            threading::lock_guard<threading::mutex> lock(sleep_mutex_);
+            finish_condition_.notify_all();
+        }
+    }
+
+    void workerLoop(int threadIndex)
+    {
+        for(;;)
+        {
+            Task task;
+            if(popTask(threadIndex, task))
+            {
+                runTask(threadIndex, task);
+                continue;
+            }
+            threading::unique_lock<threading::mutex> lock(sleep_mutex_);
+            while(!stop_ && pending_.load() <= 0)
+                worker_condition_.wait(lock);
+            if(stop_ && pending_.load() <= 0)
+                return;
+        }
+    }
+
+    std::vector<threading::thread> workers_;
+    std::vector<threading::thread::id> worker_ids_;
+    std::vector<std::unique_ptr<TaskQueue> > queues_;
+
+    threading::mutex sleep_mutex_;
+    threading::condition_variable worker_condition_;
+    threading::condition_variable finish_condition_;
+    bool stop_;
+
+    threading::atomic_long pending_;     // tasks waiting in a queue
+    threading::atomic_long busy_;        // tasks waiting or running
+    threading::atomic_long next_queue_;  // round-robin counter for external tasks
+};
+
+namespace detail {
+
+    // About four chunks per thread, so that work stealing can balance
+    // chunks that take different amounts of time.
+inline std::ptrdiff_t
+parallelChunkSize(std::size_t nThreads, std::ptrdiff_t nItems)
+{
+    return std::max<std::ptrdiff_t>(1, nItems / (4 * (std::ptrdiff_t)std::max<std::size_t>(1, nThreads)));
+}
+
+template <class FUTURES>
+void
+parallelWait(ThreadPool & pool, FUTURES & futures, threading::atomic_long & remaining)
+{
+    if(pool.currentThreadIndex() >= 0)
+    {
+        // nested call from a worker: help instead of blocking the worker
+        while(remaining.load() > 0)
+            if(!pool.runPendingTask())
+                threading::this_thread::yield();
+    }
+    // The tasks refer to the caller's functor and counter, so all of them
+    // must have finished before an exception may leave this scope.
+    for(std::size_t k = 0; k < futures.size(); ++k)
+        futures[k].wait();
+    for(std::size_t k = 0; k < futures.size(); ++k)
+        futures[k].get();  // rethrows the first exception
+}
+
+} // namespace detail
+
+/********************************************************/
+/*                                                      */
+/*                   parallel_foreach                   */
+/*                                                      */
+/********************************************************/
+
+    /** \brief Apply a functor to all items of a range in parallel.
+
+        <b> Declarations:</b>
+
+        \code
+        namespace vigra {
+            // call f(threadIndex, *iter) for all iter in [begin, end)
+            template <class ITER, class F>
+            void parallel_foreach(ThreadPool & pool, ITER begin, ITER end, F && f,
+                                  std::ptrdiff_t nItems = 0);
+
+            // likewise, but create a temporary pool with the given number of threads
+            template <class ITER, class F>
+            void parallel_foreach(int nThreads, ITER begin, ITER end, F && f,
+                                  std::ptrdiff_t nItems = 0);
+
+            // call f(threadIndex, i) for all i in [0, nItems)
+            template <class F>
+            void parallel_foreach(ThreadPool & pool, std::ptrdiff_t nItems, F && f);
+
+            template <class F>
+            void parallel_foreach(int nThreads, std::ptrdiff_t nItems, F && f);
+        }
+        \endcode
+
+        The range is split into contiguous chunks which are enqueued into the pool.
+        The functor receives the index of the executing thread in
+        <tt>[0, ParallelOptions::getActualNumThreads())</tt> as its first argument,
+        so that it can write into per-thread buffers without locking. If <tt>nItems</tt>
+        is zero, it is determined by <tt>std::distance(begin, end)</tt>. The function
+        returns when all items have been processed. If any call of <tt>f</tt> throws,
+        the exception is rethrown in the calling thread.
+
+        <tt>parallel_foreach()</tt> may be called from within a task of the same pool.
+        The calling worker then executes pending tasks while it waits.
+
+        <b> Usage:</b>
+
+        <b>\#include</b> \<vigra/threadpool.hxx\><br/>
+        Namespace: vigra
+
+        \code
+        std::vector<double> data(1000000);
+        ...
+        ThreadPool pool(ParallelOptions().numThreads(ParallelOptions::Auto));
+        std::vector<double> sums(std::max<std::size_t>(1, pool.nThreads()), 0.0);
+
+        parallel_foreach(pool, data.begin(), data.end(),
+            [&sums](int threadIndex, double v)
+            {
+                sums[threadIndex] += v;
+            });
+        \endcode
+    */
+doxygen_overloaded_function(template <...> void parallel_foreach)
+
+template <class ITER, class F>
+void
+parallel_foreach(ThreadPool & pool, ITER begin, ITER end, F && f,
+                 std::ptrdiff_t nItems = 0)
+{
+    if(nItems == 0)
+        nItems = std::distance(begin, end);
+    if(nItems <= 0)
+        return;
+
+    if(pool.nThreads() == 0)
+    {
+        for(std::ptrdiff_t k = 0; k < nItems; ++k, ++begin)
+            f(0, *begin);
+        return;
+    }
+
+    const std::ptrdiff_t chunkSize = detail::parallelChunkSize(pool.nThreads(), nItems);
+    threading::atomic_long remaining((nItems + chunkSize - 1) / chunkSize);
+    std::vector<threading::future<void> > futures;
+
+    for(std::ptrdiff_t start = 0; start < nItems; start += chunkSize)
+    {
+        const std::ptrdiff_t size = std::min(chunkSize, nItems - start);
+        ITER chunkBegin = begin;
+        futures.push_back(pool.enqueue(
+            [&f, &remaining, chunkBegin, size](int threadIndex)
+            {
+                ITER iter = chunkBegin;
+                try
+                {
+                    for(std::ptrdiff_t k = 0; k < size; ++k, ++iter)
+                        f(threadIndex, *iter);
+                }
+                catch(...)
+                {
+                    remaining.fetch_sub(1);
+                    throw;
+                }
+                remaining.fetch_sub(1);
+            }));
+        if(start + size < nItems)
+            std::advance(begin, size);
+    }
+    detail::parallelWait(pool, futures, remaining);
+}
+
+template <class ITER, class F>
+inline void
+parallel_foreach(int nThreads, ITER begin, ITER end, F && f,
+                 std::ptrdiff_t nItems = 0)
+{
+    ThreadPool pool(nThreads);
+    parallel_foreach(pool, begin, end, std::forward<F>(f), nItems);
+}
+
+template <class F>
+void
+parallel_foreach(ThreadPool & pool, std::ptrdiff_t nItems, F && f)
+{
+    if(nItems <= 0)
+        return;
+
+    if(pool.nThreads() == 0)
+    {
+        for(std::ptrdiff_t k = 0; k < nItems; ++k)
+            f(0, k);
+        return;
+    }
+
+    const std::ptrdiff_t chunkSize = detail::parallelChunkSize(pool.nThreads(), nItems);
+    threading::atomic_long remaining((nItems + chunkSize - 1) / chunkSize);
+    std::vector<threading::future<void> > futures;
+
+    for(std::ptrdiff_t start = 0; start < nItems; start += chunkSize)
+    {
+        const std::ptrdiff_t stop = std::min(start + chunkSize, nItems);
+        futures.push_back(pool.enqueue(
+            [&f, &remaining, start, stop](int threadIndex)
+            {
+                try
+                {
+                    for(std::ptrdiff_t k = start; k < stop; ++k)
+                        f(threadIndex, k);
+                }
+                catch(...)
+                {
+                    remaining.fetch_sub(1);
+                    throw;
+                }
+                remaining.fetch_sub(1);
+            }));
+    }
+    detail::parallelWait(pool, futures, remaining);
+}
+
+template <class F>
+inline void
+parallel_foreach(int nThreads, std::ptrdiff_t nItems, F && f)
+{
+    ThreadPool pool(nThreads);
+    parallel_foreach(pool, nItems, std::forward<F>(f));
+}
+
+#else // VIGRA_SINGLE_THREADED
+
+    // Without threading support, the pool has no workers and
+    // parallel_foreach() executes everything in the calling thread.
+class ThreadPool
+{
+  public:
+    explicit ThreadPool(ParallelOptions const &)
+    {}
+
+    explicit ThreadPool(const int)
+    {}
+
+    void waitFinished()
+    {}
+
+    int currentThreadIndex() const
+    {
+        return -1;
+    }
+
+    std::size_t nThreads() const
+    {
+        return 0;
+    }
+};
+
+template <class ITER, class F>
+void
+parallel_foreach(ThreadPool &, ITER begin, ITER end, F && f,
+                 std::ptrdiff_t nItems = 0)
+{
+    if(nItems == 0)
+        nItems = std::distance(begin, end);
+    for(std::ptrdiff_t k = 0; k < nItems; ++k, ++begin)
+        f(0, *begin);
+}
+
+template <class ITER, class F>
+inline void
+parallel_foreach(int nThreads, ITER begin, ITER end, F && f,
+                 std::ptrdiff_t nItems = 0)
+{
+    ThreadPool pool(nThreads);
+    parallel_foreach(pool, begin, end, std::forward<F>(f), nItems);
+}
+
+template <class F>
+void
+parallel_foreach(ThreadPool &, std::ptrdiff_t nItems, F && f)
+{
+    for(std::ptrdiff_t k = 0; k < nItems; ++k)
+        f(0, k);
+}
+
+template <class F>
+inline void
+parallel_foreach(int nThreads, std::ptrdiff_t nItems, F && f)
+{
+    ThreadPool pool(nThreads);
+    parallel_foreach(pool, nItems, std::forward<F>(f));
+}
+
+#endif // VIGRA_SINGLE_THREADED
+
+//@}
+
+} // namespace vigra
+
+#endif // VIGRA_THREADPOOL_HXX
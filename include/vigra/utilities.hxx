@@ -239,6 +239,8 @@ ostream & operator<<(ostream & s, std::pair<T1, T2> const & p)
          <BR>&nbsp;&nbsp;&nbsp;<em>Macros for taking execution speed measurements</em>
     <LI> \ref VIGRA_FINALLY
          <BR>&nbsp;&nbsp;&nbsp;<em>Emulation of the 'finally' keyword from Python</em>
+    <LI> \ref ParallelProcessing
+         <BR>&nbsp;&nbsp;&nbsp;<em>Thread pool and parallel_foreach()</em>
     </UL>
 */
 
@@ -41,6 +41,10 @@
 #include <zlib.h>
 #endif
 
+#ifdef HasZSTD
+#include <zstd.h>
+#endif
+
 namespace vigra {
 
 std::size_t compressImpl(char const * source, std::size_t srcSize, 
@@ -79,6 +83,22 @@ std::size_t compressImpl(char const * source, std::size_t srcSize,
         vigra_postcondition(destSize > 0, "compress(): lz4 compression failed.");
         return destSize;
       }
+      case ZSTD_FAST:
+      case ZSTD:
+      case ZSTD_BEST:
+      {
+    #ifdef HasZSTD
+        std::size_t destSize = ::ZSTD_compressBound(srcSize);
+        buffer.resize(destSize);
+        destSize = ::ZSTD_compress(buffer.data(), destSize, source, srcSize, 
+                                   detail::zstdCompressionLevel(method));
+        vigra_postcondition(!::ZSTD_isError(destSize), "compress(): zstd compression failed.");
+        return destSize;
+    #else
+        vigra_precondition(false, "compress(): VIGRA was compiled without ZSTD compression.");
+        return 0;
+    #endif
+      }
 
 #if 0  // currently unsupported
       case SNAPPY:
@@ -118,23 +138,60 @@ std::size_t compressImpl(char const * source, std::size_t srcSize,
     return 0;
 }
 
-void compress(char const * source, std::size_t size, ArrayVector<char> & dest, CompressionMethod method)
+void byteShuffle(char const * source, char * dest, std::size_t size, std::size_t typeSize)
+{
+    std::size_t count = size / typeSize;
+    for(std::size_t b = 0; b < typeSize; ++b, dest += count)
+    {
+        char const * s = source + b;
+        for(std::size_t k = 0; k < count; ++k, s += typeSize)
+            dest[k] = *s;
+    }
+    std::copy(source + count*typeSize, source + size, dest);
+}
+
+void byteUnshuffle(char const * source, char * dest, std::size_t size, std::size_t typeSize)
+{
+    std::size_t count = size / typeSize;
+    for(std::size_t b = 0; b < typeSize; ++b, source += count)
+    {
+        char * d = dest + b;
+        for(std::size_t k = 0; k < count; ++k, d += typeSize)
+            *d = source[k];
+    }
+    std::copy(source, source + size - count*typeSize, dest + count*typeSize);
+}
+
+std::size_t compressShuffled(char const * source, std::size_t size, 
+                             ArrayVector<char> & buffer,
+                             CompressionMethod method, std::size_t shuffleTypeSize)
+{
+    if(shuffleTypeSize <= 1)
+        return compressImpl(source, size, buffer, method);
+    ArrayVector<char> shuffled(size);
+    byteShuffle(source, shuffled.data(), size, shuffleTypeSize);
+    return compressImpl(shuffled.data(), size, buffer, method);
+}
+
+void compress(char const * source, std::size_t size, ArrayVector<char> & dest, CompressionMethod method,
+              std::size_t shuffleTypeSize)
 {
     ArrayVector<char> buffer;
-    std::size_t destSize = compressImpl(source, size, buffer, method);
+    std::size_t destSize = compressShuffled(source, size, buffer, method, shuffleTypeSize);
     dest.resize(destSize);
     std::copy(buffer.data(), buffer.data() + destSize, dest.begin());
 }
 
-void compress(char const * source, std::size_t size, std::vector<char> & dest, CompressionMethod method)
+void compress(char const * source, std::size_t size, std::vector<char> & dest, CompressionMethod method,
+              std::size_t shuffleTypeSize)
 {
     ArrayVector<char> buffer;
-    std::size_t destSize = compressImpl(source, size, buffer, method);
+    std::size_t destSize = compressShuffled(source, size, buffer, method, shuffleTypeSize);
     dest.insert(dest.begin(), buffer.data(), buffer.data() + destSize);
 }
 
-void uncompress(char const * source, std::size_t srcSize, 
-                char * dest, std::size_t destSize, CompressionMethod method)
+void uncompressImpl(char const * source, std::size_t srcSize, 
+                    char * dest, std::size_t destSize, CompressionMethod method)
 {
     switch(method)
     {
@@ -164,6 +221,19 @@ void uncompress(char const * source, std::size_t srcSize,
         vigra_postcondition(sourceLen == srcSize, "uncompress(): lz4 decompression failed.");
         break;
       }
+      case ZSTD_FAST:
+      case ZSTD:
+      case ZSTD_BEST:
+      {
+    #ifdef HasZSTD
+        std::size_t res = ::ZSTD_decompress(dest, destSize, source, srcSize);
+        vigra_postcondition(!::ZSTD_isError(res) && res == destSize, 
+                            "uncompress(): zstd decompression failed.");
+    #else
+        vigra_precondition(false, "uncompress(): VIGRA was compiled without ZSTD compression.");
+    #endif
+        break;
+      }
       
 #if 0 // currently unsupported
       case SNAPPY:
@@ -193,6 +263,20 @@ void uncompress(char const * source, std::size_t srcSize,
     }
 }
 
+void uncompress(char const * source, std::size_t srcSize, 
+                char * dest, std::size_t destSize, CompressionMethod method,
+                std::size_t shuffleTypeSize)
+{
+    if(shuffleTypeSize <= 1)
+    {
+        uncompressImpl(source, srcSize, dest, destSize, method);
+        return;
+    }
+    ArrayVector<char> shuffled(destSize);
+    uncompressImpl(source, srcSize, shuffled.data(), destSize, method);
+    byteUnshuffle(shuffled.data(), dest, destSize, shuffleTypeSize);
+}
+
 /** Uncompress a data buffer when the uncompressed size is unknown.
 
     The destination array will be resized as required.
@@ -67,6 +67,163 @@ struct BlockwiseConvolutionTest
             shouldEqual(data[i], checked_out_data[i]);
         }
     }
+
+    void parallelTest()
+    {
+        typedef MultiArray<3, float> Array;
+        typedef Array::difference_type Shape;
+
+        Shape shape(50, 41, 37);
+        Shape block_shape(16);
+
+        Array data(shape);
+        fillRandom(data.begin(), data.end(), 2000);
+
+        Kernel1D<double> kernel;
+        kernel.initGaussian(2.0);
+
+        Array serial_output(shape);
+        separableConvolveBlockwise(data, serial_output, kernel, block_shape,
+                                   ParallelOptions().numThreads(ParallelOptions::NoThreads));
+
+        for(int threads = 1; threads <= 8; threads *= 2)
+        {
+            Array parallel_output(shape);
+            separableConvolveBlockwise(data, parallel_output, kernel, block_shape,
+                                       ParallelOptions().numThreads(threads));
+            should(parallel_output == serial_output);
+        }
+    }
+
+    void parallelChunkedTest()
+    {
+        static const int N = 3;
+
+        typedef MultiArray<N, float> NormalArray;
+        typedef NormalArray::difference_type Shape;
+
+        Shape shape(70, 50, 40);
+        Shape chunk_shape(16);
+
+        NormalArray data(shape);
+        fillRandom(data.begin(), data.end(), 2000);
+        ChunkedArrayLazy<N, float> chunked_data(shape, chunk_shape);
+        chunked_data.commitSubarray(Shape(0), data);
+
+        Kernel1D<double> kernel;
+        kernel.initGaussian(1.5);
+
+        ChunkedArrayLazy<N, float> serial_output(shape, chunk_shape);
+        separableConvolveBlockwise(chunked_data, serial_output, kernel,
+                                   ParallelOptions().numThreads(ParallelOptions::NoThreads));
+        NormalArray serial_data(shape);
+        serial_output.checkoutSubarray(Shape(0), serial_data);
+
+        NormalArray reference(shape);
+        separableConvolveMultiArray(data, reference, kernel);
+        shouldEqualSequenceTolerance(reference.begin(), reference.end(), serial_data.begin(), 1e-5);
+
+        for(int threads = 2; threads <= 8; threads *= 2)
+        {
+            ChunkedArrayCompressed<N, float> parallel_output(shape, chunk_shape,
+                                                             ChunkedArrayOptions().cacheMax(4));
+            separableConvolveBlockwise(chunked_data, parallel_output, kernel,
+                                       ParallelOptions().numThreads(threads));
+            NormalArray parallel_data(shape);
+            parallel_output.checkoutSubarray(Shape(0), parallel_data);
+            should(parallel_data == serial_data);
+        }
+    }
+
+    void streamingTest()
+    {
+        static const int N = 3;
+
+        typedef MultiArray<N, float> NormalArray;
+        typedef NormalArray::difference_type Shape;
+
+        Shape shape(70, 50, 40);
+        Shape chunk_shape(16);
+
+        NormalArray data(shape);
+        fillRandom(data.begin(), data.end(), 2000);
+        ChunkedArrayCompressed<N, float> source(shape, Shape(32, 16, 8),
+                                                ChunkedArrayOptions().cacheMax(3));
+        source.commitSubarray(Shape(0), data);
+
+        Kernel1D<double> kernel;
+        kernel.initGaussian(1.5);
+
+        // reference from the non-streaming version, which needs equal chunk shapes
+        ChunkedArrayLazy<N, float> reference_source(shape, chunk_shape),
+                                   reference_output(shape, chunk_shape);
+        reference_source.commitSubarray(Shape(0), data);
+        separableConvolveBlockwise(reference_source, reference_output, kernel,
+                                   ParallelOptions().numThreads(ParallelOptions::NoThreads));
+        NormalArray reference(shape);
+        reference_output.checkoutSubarray(Shape(0), reference);
+
+        std::size_t block_bytes = prod(chunk_shape + Shape(2*kernel.right())) * (sizeof(float) + sizeof(double));
+        std::size_t budgets[] = { 0, 100000000, 4*block_bytes, 12*block_bytes };
+        for(int b = 0; b < 4; ++b)
+        {
+            for(int threads = 1; threads <= 4; threads *= 2)
+            {
+                ChunkedArrayCompressed<N, float> output(shape, chunk_shape,
+                                                        ChunkedArrayOptions().cacheMax(5));
+                separableConvolveBlockwise(source, output, kernel,
+                                           BlockwiseConvolutionOptions().memoryBudget(budgets[b])
+                                                                        .numThreads(threads));
+                NormalArray result(shape);
+                output.checkoutSubarray(Shape(0), result);
+                should(result == reference);
+
+                // cache limits are restored
+                shouldEqual(source.cacheMaxSize(), 3u);
+                shouldEqual(source.cacheMaxBytes(), 0u);
+                shouldEqual(output.cacheMaxSize(), 5u);
+            }
+        }
+
+        // the plan respects the budget and prefers cubic tiles
+        using namespace blockwise_convolution_detail;
+        Shape big(1024), block(64), before(4), after(4);
+        std::size_t chunk_bytes = prod(block) * sizeof(float),
+                    budget = 200 * chunk_bytes;
+        StreamingPlan<N> plan = planStreaming(big, block, block, before, after,
+                                              sizeof(float), sizeof(float), chunk_bytes, 4, budget);
+        shouldEqual(plan.num_threads, 4);
+        should(plan.peak_bytes <= budget);
+        should(plan.source_cache_bytes > 0);
+        shouldEqual(plan.dest_cache_chunks, 4u);
+        should(allLess(plan.tile_shape, Shape(16)));
+        should(max(plan.tile_shape) - min(plan.tile_shape) <= 1);
+
+        plan = planStreaming(big, block, block, before, after,
+                             sizeof(float), sizeof(float), chunk_bytes, 4, std::size_t(0));
+        shouldEqual(plan.tile_shape, Shape(16));
+        shouldEqual(plan.peak_bytes, 0u);
+
+        // fewer threads when the budget is tight
+        plan = planStreaming(big, block, block, before, after,
+                             sizeof(float), sizeof(float), chunk_bytes, 16, 40 * chunk_bytes);
+        should(plan.num_threads < 16);
+        should(plan.peak_bytes <= 40 * chunk_bytes);
+
+        try
+        {
+            ChunkedArrayLazy<N, float> output(shape, chunk_shape);
+            separableConvolveBlockwise(source, output, kernel,
+                                       BlockwiseConvolutionOptions().memoryBudget(1000));
+            failTest("no exception thrown");
+        }
+        catch(vigra::ContractViolation & c)
+        {
+            std::string expected("\nPrecondition violation!\nseparableConvolveBlockwise(): memory budget too small for a single block.");
+            std::string message(c.what());
+            should(0 == expected.compare(message.substr(0,expected.size())));
+        }
+    }
 };
 
 struct BlockwiseConvolutionTestSuite
@@ -77,6 +234,9 @@ struct BlockwiseConvolutionTestSuite
     {
         add(testCase(&BlockwiseConvolutionTest::simpleTest));
         add(testCase(&BlockwiseConvolutionTest::chunkedTest));
+        add(testCase(&BlockwiseConvolutionTest::parallelTest));
+        add(testCase(&BlockwiseConvolutionTest::parallelChunkedTest));
+        add(testCase(&BlockwiseConvolutionTest::streamingTest));
     }
 };
 
@@ -0,0 +1,247 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2015 by Ullrich Koethe                       */
+/*                                                                      */
+/*    This file is part of the VIGRA computer vision library.           */
+/*    The VIGRA Website is                                              */
+/*        http://hci.iwr.uni-heidelberg.de/vigra/                       */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#include <vigra/blockwise_features.hxx>
+
+#include <vigra/multi_array.hxx>
+#include <vigra/multi_array_chunked.hxx>
+#include <vigra/unittest.hxx>
+
+#include <iostream>
+
+#include "utils.hxx"
+
+using namespace std;
+using namespace vigra;
+using namespace vigra::acc;
+
+struct BlockwiseFeaturesTest
+{
+    typedef MultiArrayShape<3>::type Shape;
+
+    Shape shape;
+    MultiArray<3, float> data;
+    MultiArray<3, unsigned int> labels;
+
+    BlockwiseFeaturesTest()
+    : shape(37, 50, 23),
+      data(shape),
+      labels(shape)
+    {
+        fillRandom(data.begin(), data.end(), 2000);
+        fillRandom(labels.begin(), labels.end(), 10);
+    }
+
+    template <class A, class B>
+    void compareRegions(A const & a, B const & b, MultiArrayIndex label, MultiArrayIndex refLabel)
+    {
+        shouldEqual(get<Count>(a, label), get<Count>(b, refLabel));
+        shouldEqual(get<Minimum>(a, label), get<Minimum>(b, refLabel));
+        shouldEqual(get<Maximum>(a, label), get<Maximum>(b, refLabel));
+        shouldEqualTolerance(get<Mean>(a, label), get<Mean>(b, refLabel), 1e-10);
+        shouldEqualTolerance(get<Variance>(a, label), get<Variance>(b, refLabel), 1e-10);
+        shouldEqualTolerance(get<Skewness>(a, label), get<Skewness>(b, refLabel), 1e-6);
+        TinyVector<double, 3> c1 = get<RegionCenter>(a, label), c2 = get<RegionCenter>(b, refLabel),
+                              r1 = get<RegionRadii>(a, label),  r2 = get<RegionRadii>(b, refLabel);
+        shouldEqualSequenceTolerance(c1.begin(), c1.end(), c2.begin(), 1e-10);
+        shouldEqualSequenceTolerance(r1.begin(), r1.end(), r2.begin(), 1e-8);
+    }
+
+    void denseTest()
+    {
+        typedef AccumulatorChainArray<CoupledArrays<3, float, unsigned int>,
+                                      Select<DataArg<1>, LabelArg<2>, Count, Minimum, Maximum,
+                                             Mean, Variance, Skewness, RegionCenter, RegionRadii,
+                                             Global<Mean>, Global<Maximum> > > Chain;
+
+        Chain ref;
+        extractFeatures(data, labels, ref);
+
+        ChunkedArrayLazy<3, float> chunkedData(shape, Shape(8));
+        ChunkedArrayLazy<3, unsigned int> chunkedLabels(shape, Shape(8));
+        chunkedData.commitSubarray(Shape(), data);
+        chunkedLabels.commitSubarray(Shape(), labels);
+
+        for(int threads = 0; threads <= 4; threads += 4)
+        {
+            Chain a;
+            extractFeatures(chunkedData, chunkedLabels, a, ParallelOptions().numThreads(threads));
+
+            shouldEqual(a.maxRegionLabel(), ref.maxRegionLabel());
+            for(int k=0; k<=ref.maxRegionLabel(); ++k)
+                compareRegions(a, ref, k, k);
+            shouldEqualTolerance(get<Global<Mean> >(a), get<Global<Mean> >(ref), 1e-10);
+            shouldEqual(get<Global<Maximum> >(a), get<Global<Maximum> >(ref));
+        }
+
+        // label chunks differ from the data chunks (blocks must be copied)
+        ChunkedArrayLazy<3, unsigned int> coarseLabels(shape, Shape(16));
+        coarseLabels.commitSubarray(Shape(), labels);
+        Chain a;
+        extractFeatures(chunkedData, coarseLabels, a, ParallelOptions().numThreads(4));
+        for(int k=0; k<=ref.maxRegionLabel(); ++k)
+            compareRegions(a, ref, k, k);
+    }
+
+    void sparseTest()
+    {
+        typedef AccumulatorChainArray<CoupledArrays<3, unsigned int, unsigned int>,
+                                      Select<DataArg<1>, LabelArg<2>, Count, Minimum, Maximum,
+                                             Mean, Variance, Skewness, RegionCenter, RegionRadii> > Chain;
+
+        MultiArray<3, unsigned int> intData(data), sparseLabels(shape);
+        for(int k=0; k<labels.size(); ++k)
+            sparseLabels[k] = labels[k]*100003;
+
+        Chain ref;
+        extractFeatures(intData, labels, ref);
+
+        ChunkedArrayLazy<3, unsigned int> chunkedData(shape, Shape(16, 8, 8)),
+                                          chunkedLabels(shape, Shape(16, 8, 8));
+        chunkedData.commitSubarray(Shape(), intData);
+        chunkedLabels.commitSubarray(Shape(), sparseLabels);
+
+        Chain a;
+        a.setSparseRegionStorage();
+        a.ignoreLabel(0);
+        extractFeatures(chunkedData, chunkedLabels, a, ParallelOptions().numThreads(4));
+
+        shouldEqual(a.regionCount(), 9u);
+        should(!a.hasRegion(0));
+        for(int k=1; k<=ref.maxRegionLabel(); ++k)
+            compareRegions(a, ref, k*100003, k);
+    }
+
+    void singleArrayTest()
+    {
+        typedef AccumulatorChain<CoupledArrays<3, float>,
+                                 Select<Count, Mean, Variance, Minimum, Maximum,
+                                        Coord<Mean>, Weighted<Coord<Mean> > > > Chain;
+
+        Chain ref;
+        extractFeatures(data, ref);
+
+        ChunkedArrayLazy<3, float> chunkedData(shape, Shape(8, 16, 4));
+        chunkedData.commitSubarray(Shape(), data);
+
+        Chain a;
+        extractFeatures(chunkedData, a, ParallelOptions().numThreads(4));
+
+        shouldEqual(get<Count>(a), get<Count>(ref));
+        shouldEqual(get<Minimum>(a), get<Minimum>(ref));
+        shouldEqual(get<Maximum>(a), get<Maximum>(ref));
+        shouldEqualTolerance(get<Mean>(a), get<Mean>(ref), 1e-10);
+        shouldEqualTolerance(get<Variance>(a), get<Variance>(ref), 1e-10);
+        TinyVector<double, 3> c1 = get<Coord<Mean> >(a), c2 = get<Coord<Mean> >(ref),
+                              w1 = get<Weighted<Coord<Mean> > >(a), w2 = get<Weighted<Coord<Mean> > >(ref);
+        shouldEqualSequenceTolerance(c1.begin(), c1.end(), c2.begin(), 1e-10);
+        shouldEqualSequenceTolerance(w1.begin(), w1.end(), w2.begin(), 1e-10);
+    }
+
+    void repeatedCallTest()
+    {
+        // repeated calls accumulate all data, as in the sequential version
+        typedef AccumulatorChainArray<CoupledArrays<3, float, unsigned int>,
+                                      Select<DataArg<1>, LabelArg<2>, Count, Minimum, Maximum,
+                                             Mean, Variance, RegionCenter, Global<Count> > > Chain;
+
+        ChunkedArrayLazy<3, float> chunkedData(shape, Shape(8));
+        ChunkedArrayLazy<3, unsigned int> chunkedLabels(shape, Shape(8));
+        chunkedData.commitSubarray(Shape(), data);
+        chunkedLabels.commitSubarray(Shape(), labels);
+
+        Chain ref, a;
+        shouldEqual(a.passesRequired(), 1u);
+        for(int k=0; k<2; ++k)
+        {
+            extractFeatures(data, labels, ref);
+            extractFeatures(chunkedData, chunkedLabels, a, ParallelOptions().numThreads(4));
+        }
+
+        shouldEqual(get<Global<Count> >(a), 2.0*data.size());
+        shouldEqual(a.maxRegionLabel(), ref.maxRegionLabel());
+        for(int k=0; k<=ref.maxRegionLabel(); ++k)
+        {
+            shouldEqual(get<Count>(a, k), get<Count>(ref, k));
+            shouldEqual(get<Minimum>(a, k), get<Minimum>(ref, k));
+            shouldEqual(get<Maximum>(a, k), get<Maximum>(ref, k));
+            shouldEqualTolerance(get<Mean>(a, k), get<Mean>(ref, k), 1e-10);
+            shouldEqualTolerance(get<Variance>(a, k), get<Variance>(ref, k), 1e-10);
+            TinyVector<double, 3> c1 = get<RegionCenter>(a, k), c2 = get<RegionCenter>(ref, k);
+            shouldEqualSequenceTolerance(c1.begin(), c1.end(), c2.begin(), 1e-10);
+        }
+    }
+
+    void unmergeableTest()
+    {
+        typedef AccumulatorChain<CoupledArrays<3, float>, Select<Count, SumOfAbsDifferences> > Chain;
+
+        ChunkedArrayLazy<3, float> chunkedData(shape, Shape(8));
+        chunkedData.commitSubarray(Shape(), data);
+
+        Chain a;
+        try
+        {
+            extractFeatures(chunkedData, a, ParallelOptions().numThreads(2));
+            failTest("extractFeatures() failed to throw exception");
+        }
+        catch(PreconditionViolation &)
+        {}
+    }
+};
+
+struct BlockwiseFeaturesTestSuite
+  : public test_suite
+{
+    BlockwiseFeaturesTestSuite()
+      : test_suite("blockwise features test")
+    {
+        add(testCase(&BlockwiseFeaturesTest::denseTest));
+        add(testCase(&BlockwiseFeaturesTest::sparseTest));
+        add(testCase(&BlockwiseFeaturesTest::singleArrayTest));
+        add(testCase(&BlockwiseFeaturesTest::repeatedCallTest));
+        add(testCase(&BlockwiseFeaturesTest::unmergeableTest));
+    }
+};
+
+int main(int argc, char** argv)
+{
+    BlockwiseFeaturesTestSuite test;
+    int failed = test.run(testsToBeExecuted(argc, argv));
+
+    cout << test.report() << endl;
+
+    return failed != 0;
+}
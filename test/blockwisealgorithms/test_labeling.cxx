@@ -262,6 +262,52 @@ struct BlockwiseLabelingTest
                                      oldschool_label_array.begin(), oldschool_label_array.end()), true);
     }
 
+    void parallelTest()
+    {
+        typedef MultiArray<3, unsigned int> Array;
+        typedef Array::difference_type Shape;
+
+        Shape shape(61, 47, 35);
+        Array data(shape);
+        fillRandom(data.begin(), data.end(), 3);
+
+        Array serial_labels(shape);
+        size_t serial_count = labelMultiArrayBlockwise(data, serial_labels, 
+                                  LabelOptions().neighborhood(IndirectNeighborhood).background(1u)
+                                                .blockShape(Shape(8)).numThreads(ParallelOptions::NoThreads));
+
+        Array labels(shape);
+        size_t count = labelMultiArrayWithBackground(data, labels, IndirectNeighborhood, 1u);
+        shouldEqual(serial_count, count);
+        should(equivalentLabels(labels.begin(), labels.end(), serial_labels.begin(), serial_labels.end()));
+
+        // the labels must not depend on the number of threads
+        for(int threads = 1; threads <= 8; threads *= 2)
+        {
+            Array parallel_labels(shape);
+            size_t parallel_count = labelMultiArrayBlockwise(data, parallel_labels, 
+                                        LabelOptions().neighborhood(IndirectNeighborhood).background(1u)
+                                                      .blockShape(Shape(8)).numThreads(threads));
+            shouldEqual(parallel_count, serial_count);
+            should(parallel_labels == serial_labels);
+        }
+
+        typedef ChunkedArrayLazy<3, unsigned int> ChunkedData;
+        ChunkedData chunked_data(shape, Shape(8));
+        chunked_data.commitSubarray(Shape(0), data);
+        for(int threads = 0; threads <= 4; threads += 2)
+        {
+            ChunkedArrayLazy<3, unsigned int> chunked_labels(shape, Shape(8));
+            size_t chunked_count = labelMultiArrayBlockwise(chunked_data, chunked_labels, 
+                                       LabelOptions().neighborhood(IndirectNeighborhood).background(1u)
+                                                     .numThreads(threads));
+            shouldEqual(chunked_count, serial_count);
+            Array checked_out_labels(shape);
+            chunked_labels.checkoutSubarray(Shape(0), checked_out_labels);
+            should(checked_out_labels == serial_labels);
+        }
+    }
+
     void fiveDimensionalRandomTest()
     {
         testOnData(array_fives.begin(), array_fives.end(),
@@ -290,6 +336,7 @@ struct BlockwiseLabelingTestSuite
         add(testCase(&BlockwiseLabelingTest::oneDimensionalRandomTest));
         add(testCase(&BlockwiseLabelingTest::debugTest));
         add(testCase(&BlockwiseLabelingTest::chunkedArrayTest));
+        add(testCase(&BlockwiseLabelingTest::parallelTest));
     }
 };
 
@@ -198,6 +198,53 @@ struct BlockwiseWatershedTest
                                      correct_labels.begin(), correct_labels.end()),
                     true);
     }
+    void parallelTest()
+    {
+        typedef MultiArray<3, int> OldschoolArray;
+        typedef MultiArray<3, size_t> OldschoolLabelArray;
+        typedef OldschoolArray::difference_type Shape;
+
+        Shape shape(45, 38, 29);
+        Shape block_shape(8);
+        NeighborhoodType neighborhood = IndirectNeighborhood;
+
+        OldschoolArray data(shape);
+        fillRandom(data.begin(), data.end(), 3);
+
+        OldschoolLabelArray correct_labels(shape);
+        size_t correct_label_number = watershedsMultiArray(data, correct_labels, neighborhood,
+                                                           WatershedOptions().unionFind());
+
+        OldschoolLabelArray serial_labels(shape);
+        size_t serial_label_number = unionFindWatershedsBlockwise(data, serial_labels, neighborhood, block_shape,
+                                                                  ParallelOptions().numThreads(ParallelOptions::NoThreads));
+        shouldEqual(correct_label_number, serial_label_number);
+        should(equivalentLabels(serial_labels.begin(), serial_labels.end(),
+                                correct_labels.begin(), correct_labels.end()));
+
+        // same labels for any number of threads
+        for(int threads = 1; threads <= 8; threads *= 2)
+        {
+            OldschoolLabelArray labels(shape);
+            size_t label_number = unionFindWatershedsBlockwise(data, labels, neighborhood, block_shape,
+                                                               ParallelOptions().numThreads(threads));
+            shouldEqual(label_number, serial_label_number);
+            should(labels == serial_labels);
+        }
+
+        ChunkedArrayLazy<3, int> chunked_data(shape, block_shape);
+        chunked_data.commitSubarray(Shape(0), data);
+        for(int threads = 0; threads <= 4; threads += 2)
+        {
+            ChunkedArrayLazy<3, size_t> chunked_labels(shape, block_shape);
+            size_t label_number = unionFindWatershedsBlockwise(chunked_data, chunked_labels, neighborhood,
+                                                               ParallelOptions().numThreads(threads));
+            shouldEqual(label_number, serial_label_number);
+            OldschoolLabelArray labels(shape);
+            chunked_labels.checkoutSubarray(Shape(0), labels);
+            should(labels == serial_labels);
+        }
+    }
 };
 
 struct BlockwiseWatershedTestSuite
@@ -209,6 +256,7 @@ struct BlockwiseWatershedTestSuite
         add(testCase(&BlockwiseWatershedTest::fourDimensionalRandomTest));
         add(testCase(&BlockwiseWatershedTest::oneDimensionalTest));
         add(testCase(&BlockwiseWatershedTest::chunkedTest));
+        add(testCase(&BlockwiseWatershedTest::parallelTest));
     }
 };
 
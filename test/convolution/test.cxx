@@ -740,6 +740,62 @@ struct ConvolutionTest
 
     }
 
+    // an accessor that disables the SIMD code path of convolveLine()
+    template <class T>
+    struct ScalarPathAccessor
+    : public StandardConstValueAccessor<T>
+    {};
+
+    template <class SrcType, class KernelType>
+    void convolveLineSimdTestImpl()
+    {
+        typedef typename PromoteTraits<SrcType, KernelType>::Promote SumType;
+        static const BorderTreatmentMode modes[] = {
+            BORDER_TREATMENT_AVOID, BORDER_TREATMENT_CLIP, BORDER_TREATMENT_REPEAT,
+            BORDER_TREATMENT_REFLECT, BORDER_TREATMENT_WRAP, BORDER_TREATMENT_ZEROPAD };
+
+        int w = 203;
+        ArrayVector<SrcType> src(w);
+        for(int x=0; x<w; ++x)
+            src[x] = SrcType((x*37) % 251);
+
+        Kernel1D<KernelType> kernel;
+        kernel.initExplicitly(-4, 3) = 0.1, -0.3, 0.25, 0.5, 1.0, -0.2, 0.15, 0.05;
+
+        for(int m=0; m<6; ++m)
+        {
+            for(int r=0; r<3; ++r)
+            {
+                int start = r == 1 ? 1 : r == 2 ? 20 : 0,
+                    stop  = r == 1 ? w : r == 2 ? 150 : 0;
+                int n = stop == 0 ? w : stop - start;
+                ArrayVector<SumType> res(n, SumType(-1)), ref(n, SumType(-1));
+
+                convolveLine(src.begin(), src.end(), StandardConstValueAccessor<SrcType>(),
+                             res.begin(), StandardValueAccessor<SumType>(),
+                             kernel.center(), kernel.accessor(),
+                             kernel.left(), kernel.right(), modes[m], start, stop);
+                convolveLine(src.begin(), src.end(), ScalarPathAccessor<SrcType>(),
+                             ref.begin(), StandardValueAccessor<SumType>(),
+                             kernel.center(), kernel.accessor(),
+                             kernel.left(), kernel.right(), modes[m], start, stop);
+                shouldEqualSequence(res.begin(), res.end(), ref.begin());
+            }
+        }
+    }
+
+    void convolveLineSimdTest()
+    {
+        convolveLineSimdTestImpl<float, float>();
+        convolveLineSimdTestImpl<float, double>();
+        convolveLineSimdTestImpl<double, float>();
+        convolveLineSimdTestImpl<double, double>();
+        convolveLineSimdTestImpl<UInt8, float>();
+        convolveLineSimdTestImpl<UInt8, double>();
+        convolveLineSimdTestImpl<UInt16, float>();
+        convolveLineSimdTestImpl<UInt16, double>();
+    }
+
     void separableConvolutionTest()
     {
         vigra::Kernel1D<double> binom;
@@ -2456,6 +2512,7 @@ struct ConvolutionTestSuite
         add( testCase( &ConvolutionTest::stdConvolutionTestFromRepeatWithAvoid));
         add( testCase( &ConvolutionTest::stdConvolutionTestOfAllTreatmentsRelatively));
 
+        add( testCase( &ConvolutionTest::convolveLineSimdTest));
         add( testCase( &ConvolutionTest::separableConvolutionTest));
         add( testCase( &ConvolutionTest::separableDerivativeRepeatTest));
         add( testCase( &ConvolutionTest::separableDerivativeReflectTest));
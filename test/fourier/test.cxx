@@ -37,6 +37,7 @@
 #include <stdlib.h>
 #include <algorithm>
 #include <functional>
+#include <cstdio>
 #include <vigra/stdimage.hxx>
 #include <vigra/stdimagefunctions.hxx>
 #include <vigra/functorexpression.hxx>
@@ -523,6 +524,252 @@ struct MultiFFTTest
                                      ref2.data(), 1e-14);
     }
 
+    void testConvolveFFTManyParallel()
+    {
+        typedef MultiArrayView<2, double> MV;
+        ImageImportInfo info("ghouse.gif");
+        Shape2 s(info.width(), info.height());
+        DArray2 in(s);
+        importImage(info, destImage(in));
+
+        const int count = 5;
+        ArrayVector<Kernel2D<double> > gauss(count);
+        std::vector<MV> kernels;
+        std::vector<DArray2> serial(count, DArray2(s)), parallel(count, DArray2(s));
+        for(int k=0; k<count; ++k)
+        {
+            gauss[k].initGaussian(1.0 + 0.5*k);
+            kernels.push_back(MV(Shape2(gauss[k].width(), gauss[k].height()), 
+                                 &gauss[k][gauss[k].upperLeft()]));
+        }
+
+        convolveFFTMany(in, kernels.begin(), kernels.end(), serial.begin());
+        convolveFFTMany(in, kernels.begin(), kernels.end(), parallel.begin(), 
+                        ParallelOptions().numThreads(4));
+        for(int k=0; k<count; ++k)
+            should(serial[k] == parallel[k]);
+
+        // stream into a multiband array
+        MultiArray<3, double> bands(Shape3(s[0], s[1], count));
+        convolveFFTMany(in, kernels.begin(), kernels.end(), bands, 
+                        ParallelOptions().numThreads(3));
+        for(int k=0; k<count; ++k)
+            should(serial[k] == bands.bindOuter(k));
+
+        try
+        {
+            convolveFFTMany(in, kernels.begin(), kernels.end()-1, bands);
+            failTest("no exception thrown");
+        }
+        catch(vigra::ContractViolation & c)
+        {
+            std::string expected("\nPrecondition violation!\nconvolveFFTMany(): output must have one band per kernel.");
+            std::string message(c.what());
+            should(0 == expected.compare(message.substr(0,expected.size())));
+        }
+
+        // complex input
+        CArray2 inc(s);
+        inc = in;
+        std::vector<CArray2> kernelsc, serialc(count, CArray2(s)), parallelc(count, CArray2(s));
+        for(int k=0; k<count; ++k)
+        {
+            kernelsc.push_back(CArray2(kernels[k].shape()));
+            kernelsc.back() = kernels[k];
+        }
+        convolveFFTComplexMany(inc, kernelsc.begin(), kernelsc.end(), serialc.begin(), false);
+        convolveFFTComplexMany(inc, kernelsc.begin(), kernelsc.end(), parallelc.begin(), false,
+                               ParallelOptions().numThreads(4));
+        for(int k=0; k<count; ++k)
+            should(serialc[k] == parallelc[k]);
+    }
+
+    void testPlanCache()
+    {
+        typedef detail::FFTWPlanCache<double> Cache;
+        typedef MultiArrayView<2, double> MV;
+
+        ImageImportInfo info("ghouse.gif");
+        Shape2 s(info.width(), info.height());
+        DArray2 in(s), out(s), ref(s);
+        importImage(info, destImage(in));
+
+        Kernel2D<double> gauss;
+        gauss.initGaussian(2.0);
+        MV kernel(Shape2(gauss.width(), gauss.height()), &gauss[gauss.upperLeft()]);
+
+        fftwClearPlanCache();
+        should(fftwPlanCaching());
+        shouldEqual(Cache::size(), 0u);
+
+        // repeated convolutions of the same size re-use the forward and backward plans
+        convolveFFT(in, kernel, ref);
+        shouldEqual(Cache::size(), 2u);
+        for(int k=0; k<3; ++k)
+        {
+            convolveFFT(in, kernel, out);
+            shouldEqual(Cache::size(), 2u);
+            should(out == ref);
+        }
+
+        // plans outlive the FFTWPlan objects that created them
+        FFTWConvolvePlan<2, double> plan(in, kernel, out);
+        shouldEqual(Cache::size(), 2u);
+        plan.execute(in, kernel, out);
+        should(out == ref);
+
+        // uncached plans give the same result
+        fftwSetPlanCaching(false);
+        convolveFFT(in, kernel, out);
+        fftwSetPlanCaching(true);
+        shouldEqual(Cache::size(), 2u);
+        should(out == ref);
+
+        // the thread count is part of the key
+        fftwSetNumThreads(2);
+        shouldEqual(fftwNumThreads(), 2);
+        convolveFFT(in, kernel, out);
+        fftwSetNumThreads(ParallelOptions::NoThreads);
+        shouldEqual(fftwNumThreads(), 1);
+        shouldEqual(Cache::size(), 4u);
+        shouldEqualSequenceTolerance(out.data(), out.data()+out.size(),
+                                     ref.data(), 1e-14);
+
+        // plans in use survive clearing the cache
+        fftwClearPlanCache();
+        shouldEqual(Cache::size(), 0u);
+        out.init(0.0);
+        plan.execute(in, kernel, out);
+        should(out == ref);
+        convolveFFT(in, kernel, out);
+        should(out == ref);
+
+        // the size limit only evicts plans that are not in use
+        shouldEqual(fftwPlanCacheSize(), 64u);
+        {
+            FFTWConvolvePlan<2, double> held(in, kernel, out);
+            fftwSetPlanCacheSize(0);
+            shouldEqual(Cache::size(), 2u);
+            held.execute(in, kernel, out);
+            should(out == ref);
+        }
+        shouldEqual(Cache::size(), 0u);
+        fftwSetPlanCacheSize(1);
+        convolveFFT(in, kernel, out);
+        shouldEqual(Cache::size(), 1u);
+        should(out == ref);
+        fftwSetPlanCacheSize(64);
+        shouldEqual(fftwPlanCacheSize(), 64u);
+
+        // wisdom round trip
+        FFTWPlan<2, double> measured(out, MultiArray<2, FFTWComplex<double> >(fftwCorrespondingShapeR2C(s)), FFTW_MEASURE);
+        should(fftwExportWisdom("fourier_test.wisdom"));
+        should(fftwImportWisdom("fourier_test.wisdom"));
+        should(!fftwImportWisdom("nonexistent_directory/fourier_test.wisdom"));
+        std::remove("fourier_test.wisdom");
+        fftwClearPlanCache();
+    }
+
+    void testConvolveMultiArray()
+    {
+        typedef MultiArrayView<2, double> MV;
+        ImageImportInfo info("ghouse.gif");
+        Shape2 s(info.width(), info.height());
+        DArray2 in(s), out(s), ref(s);
+        importImage(info, destImage(in));
+
+        // separable kernels are detected and factored
+        double scale = 2.0;
+        gaussianSmoothing(srcImageRange(in), destImage(ref), scale);
+
+        Kernel2D<double> gauss;
+        gauss.initGaussian(scale);
+        MV kernel(Shape2(gauss.width(), gauss.height()), &gauss[gauss.upperLeft()]);
+
+        shouldEqual(ConvolutionSeparable, convolveMultiArray(in, kernel, out));
+        shouldEqualSequenceTolerance(out.data(), out.data()+out.size(),
+                                     ref.data(), 1e-14);
+        shouldEqual(ConvolutionDirect, convolveMultiArray(in, kernel, out, ConvolutionDirect));
+        shouldEqualSequenceTolerance(out.data(), out.data()+out.size(),
+                                     ref.data(), 1e-12);
+
+        // non-separable kernels of odd and even size: all methods agree
+        Shape2 kernelShapes[] = { Shape2(5, 5), Shape2(4, 7) };
+        for(int k=0; k<2; ++k)
+        {
+            DArray2 nonsep(kernelShapes[k]), direct(s), fft(s);
+            for(int i=0; i<nonsep.size(); ++i)
+                nonsep[i] = (i*i) % 7 - 2.5;
+
+            shouldEqual(ConvolutionDirect, convolveMultiArray(in, nonsep, direct, ConvolutionDirect));
+            shouldEqual(ConvolutionFFT, convolveMultiArray(in, nonsep, fft, ConvolutionFFT));
+            shouldEqualSequenceTolerance(direct.data(), direct.data()+direct.size(),
+                                         fft.data(), 1e-10);
+            convolveFFT(in, nonsep, ref);
+            shouldEqualSequenceTolerance(fft.data(), fft.data()+fft.size(),
+                                         ref.data(), 1e-14);
+            convolveMultiArray(in, nonsep, out);
+            shouldEqualSequenceTolerance(out.data(), out.data()+out.size(),
+                                         direct.data(), 1e-10);
+
+            // input and output may be the same array
+            out = in;
+            convolveMultiArray(out, nonsep, out, ConvolutionDirect);
+            shouldEqualSequenceTolerance(out.data(), out.data()+out.size(),
+                                         direct.data(), 1e-10);
+
+            try
+            {
+                convolveMultiArray(in, nonsep, out, ConvolutionSeparable);
+                failTest("no exception thrown");
+            }
+            catch(vigra::ContractViolation & c)
+            {
+                std::string expected("\nPrecondition violation!\nconvolveMultiArray(): kernel is not separable.");
+                std::string message(c.what());
+                should(0 == expected.compare(message.substr(0,expected.size())));
+            }
+        }
+
+        // 3D
+        MultiArray<3, double> vol(Shape3(20, 17, 11)), vdirect(vol.shape()), vfft(vol.shape()),
+                              vkernel(Shape3(3, 5, 4));
+        for(int i=0; i<vol.size(); ++i)
+            vol[i] = (i*13) % 19;
+        for(int i=0; i<vkernel.size(); ++i)
+            vkernel[i] = (i*3) % 7 - 2.0;
+        convolveMultiArray(vol, vkernel, vdirect, ConvolutionDirect);
+        convolveMultiArray(vol, vkernel, vfft, ConvolutionFFT);
+        shouldEqualSequenceTolerance(vdirect.data(), vdirect.data()+vdirect.size(),
+                                     vfft.data(), 1e-10);
+
+        // method selection
+        ConvolutionCostModel model;
+        shouldEqual(ConvolutionDirect, model.select(Shape2(256), Shape2(3), false));
+        shouldEqual(ConvolutionFFT, model.select(Shape2(256), Shape2(65), false));
+        shouldEqual(ConvolutionSeparable, model.select(Shape2(256), Shape2(65), true));
+        shouldEqual(ConvolutionFFT, model.select(Shape3(64), Shape3(15), false));
+        should(model.cost(ConvolutionAuto, Shape2(256), Shape2(65), false) ==
+               model.cost(ConvolutionFFT, Shape2(256), Shape2(65)));
+
+        ConvolutionCostModel calibrated = ConvolutionCostModel::calibrate<double>(64);
+        should(calibrated.directCost > 0.0);
+        should(calibrated.separableCost > 0.0);
+        should(calibrated.fftCost > 0.0);
+
+        try
+        {
+            convolveMultiArray(in, MV(Shape2(2*s[0]+1, 3), ref.data()), out);
+            failTest("no exception thrown");
+        }
+        catch(vigra::ContractViolation & c)
+        {
+            std::string expected("\nPrecondition violation!\nconvolveMultiArray(): kernel radius must be smaller than the array shape.");
+            std::string message(c.what());
+            should(0 == expected.compare(message.substr(0,expected.size())));
+        }
+    }
+
     void testConvolveFFTComplex()
     {
         typedef MultiArrayView<2, double> MV;
@@ -714,6 +961,9 @@ struct FFTWTestSuite
         add( testCase(&MultiFFTTest::testPadding));
         add( testCase(&MultiFFTTest::testConvolveFFT));
         add( testCase(&MultiFFTTest::testConvolveFFTComplex));
+        add( testCase(&MultiFFTTest::testConvolveFFTManyParallel));
+        add( testCase(&MultiFFTTest::testConvolveMultiArray));
+        add( testCase(&MultiFFTTest::testPlanCache));
         add( testCase(&MultiFFTTest::testConvolveFourierKernel));
     }
 };
@@ -34,6 +34,10 @@
 /************************************************************************/
 
 #include <stdio.h>
+#include <cstdlib>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 
 #include "vigra/unittest.hxx"
 #include "vigra/multi_array.hxx"
@@ -46,6 +50,8 @@
 #include "vigra/algorithm.hxx"
 #include "vigra/random.hxx"
 #include "vigra/timing.hxx"
+#include "vigra/threadpool.hxx"
+#include <numeric>
 //#include "marray.hxx"
 
 using namespace vigra;
@@ -142,6 +148,16 @@ public:
                                                       ChunkedArrayOptions().fillValue(fill_value), ""));
     }
     
+    static ArrayPtr createArray(Shape3 const & shape, 
+                                Shape3 const & chunk_shape,
+                                ChunkedArrayMmap<3, T> *,
+                                std::string const & name = "chunked_test.h5")
+    {
+        return ArrayPtr(new ChunkedArrayMmap<3, T>(name.substr(0, name.rfind('.')) + ".vmap", 
+                                                   shape, chunk_shape, 
+                                                   ChunkedArrayOptions().fillValue(fill_value)));
+    }
+    
     void test_construction ()
     {
         bool isFullArray = IsSameType<Array, ChunkedArrayFull<3, T> >::value;
@@ -188,7 +204,8 @@ public:
             
         // non-const iterator should allocate the array and initialize with fill_value_
         shouldEqualSequence(empty_array->begin(), empty_array->end(), empty.begin());
-        if(IsSameType<Array, ChunkedArrayTmpFile<3, T> >::value)
+        if(IsSameType<Array, ChunkedArrayTmpFile<3, T> >::value ||
+           IsSameType<Array, ChunkedArrayMmap<3, T> >::value)
             should(empty_array->dataBytes() >= ref.size()*sizeof(T)); // must pad to a full memory page
         else
             shouldEqual(empty_array->dataBytes(), ref.size()*sizeof(T));
@@ -407,7 +424,8 @@ public:
             shouldEqualSequence(c.begin(), c.end(), empty.begin());
             
             MultiArrayView <3, T, ChunkedArrayTag> v(empty_array->subarray(start, stop));
-            if(IsSameType<Array, ChunkedArrayTmpFile<3, T> >::value)
+            if(IsSameType<Array, ChunkedArrayTmpFile<3, T> >::value ||
+               IsSameType<Array, ChunkedArrayMmap<3, T> >::value)
                 should(empty_array->dataBytes() >= ref.size()*sizeof(T)); // must pad to a full memory page
             else
                 shouldEqual(empty_array->dataBytes(), ref.size()*sizeof(T));
@@ -1346,6 +1364,397 @@ public:
     // }
 // };
 
+class ChunkedArrayCacheTest
+{
+  public:
+    typedef ChunkedArrayCompressed<2, int> Array;
+    
+    static Shape2 chunkShape()
+    {
+        return Shape2(4);
+    }
+    
+    static void touch(Array & array, int k)
+    {
+        // acquire and release chunk k
+        array.subarray(Shape2(4*k, 0), Shape2(4*k+4, 4));
+    }
+    
+    static bool isLoaded(Array & array, int k)
+    {
+        return array.lookupHandle(Shape2(k, 0))->chunk_state_.load() >= 0;
+    }
+    
+        // total memory of all chunks, which must agree with dataBytes()
+    static std::size_t chunkBytes(Array & array)
+    {
+        std::size_t res = 0;
+        for(int k=0; k<array.handle_array_.size(); ++k)
+            if(array.handle_array_[k].pointer_ != 0)
+                res += array.dataBytes(array.handle_array_[k].pointer_);
+        return res;
+    }
+    
+    void testPolicies()
+    {
+        ChunkCachePolicy policies[] = { CACHE_FIFO, CACHE_LRU, CACHE_CLOCK, CACHE_SLRU };
+        for(int p=0; p<4; ++p)
+        {
+            Array array(Shape2(32, 4), chunkShape(), 
+                        ChunkedArrayOptions().cacheMax(2).cachePolicy(policies[p]));
+            shouldEqual(array.cachePolicy(), policies[p]);
+            
+            touch(array, 0);
+            touch(array, 1);
+            touch(array, 0);
+            touch(array, 2);
+            
+            shouldEqual(array.cacheSize(), 2);
+            should(isLoaded(array, 2));
+            if(policies[p] == CACHE_FIFO)
+            {
+                // chunk 0 was loaded first
+                should(!isLoaded(array, 0));
+                should(isLoaded(array, 1));
+            }
+            else
+            {
+                // chunk 1 was used least recently
+                should(isLoaded(array, 0));
+                should(!isLoaded(array, 1));
+            }
+        }
+    }
+    
+    void testScanResistance()
+    {
+        ChunkedArrayOptions options = ChunkedArrayOptions().cacheMax(3);
+        Array lru(Shape2(32, 4), chunkShape(), options.cachePolicy(CACHE_LRU)),
+              slru(Shape2(32, 4), chunkShape(), options.cachePolicy(CACHE_SLRU));
+        
+        // hot chunks 0 and 1, followed by a sequential scan
+        int order[] = { 0, 0, 1, 1, 2, 3, 4, 5 };
+        for(int k=0; k<8; ++k)
+        {
+            touch(lru, order[k]);
+            touch(slru, order[k]);
+        }
+        
+        shouldEqual(lru.cacheSize(), 3);
+        should(!isLoaded(lru, 0));
+        should(!isLoaded(lru, 1));
+        
+        shouldEqual(slru.cacheSize(), 3);
+        should(isLoaded(slru, 0));
+        should(isLoaded(slru, 1));
+        should(isLoaded(slru, 5));
+        should(!isLoaded(slru, 4));
+    }
+    
+    void testStatistics()
+    {
+        Array array(Shape2(32, 4), chunkShape(), 
+                    ChunkedArrayOptions().cacheMax(2).cachePolicy(CACHE_LRU));
+        
+        touch(array, 0);
+        touch(array, 1);
+        touch(array, 0);
+        touch(array, 2);
+        
+        shouldEqual(array.cacheMisses(), 3u);
+        shouldEqual(array.cacheHits(), 1u);
+        shouldEqual(array.cacheEvictions(), 1u);
+        shouldEqual(array.cacheBytes(), 2*array.dataBytesPerChunk());
+        
+        array.resetCacheStatistics();
+        shouldEqual(array.cacheMisses(), 0u);
+        shouldEqual(array.cacheHits(), 0u);
+        shouldEqual(array.cacheEvictions(), 0u);
+        
+        touch(array, 2);
+        touch(array, 1);
+        shouldEqual(array.cacheMisses(), 1u);
+        shouldEqual(array.cacheHits(), 1u);
+        shouldEqual(array.cacheEvictions(), 1u);
+    }
+    
+    void testByteBudget()
+    {
+        ChunkCachePolicy policies[] = { CACHE_FIFO, CACHE_LRU, CACHE_CLOCK, CACHE_SLRU };
+        for(int p=0; p<4; ++p)
+        {
+            std::size_t budget = 3*sizeof(int)*prod(chunkShape());
+            Array array(Shape2(32, 8), chunkShape(), 
+                        ChunkedArrayOptions().cacheMaxBytes(budget).cachePolicy(policies[p]));
+            shouldEqual(array.cacheMaxBytes(), budget);
+            
+            MultiArray<2, int> ref(array.shape());
+            linearSequence(ref.begin(), ref.end());
+            array.commitSubarray(Shape2(), ref);
+            
+            shouldEqual(array.cacheSize(), 3);
+            should(array.cacheBytes() <= budget);
+            shouldEqual(array.cacheEvictions(), 13u);
+            
+            MultiArray<2, int> res(array.shape());
+            array.checkoutSubarray(Shape2(), res);
+            should(array.cacheBytes() <= budget);
+            shouldEqualSequence(res.begin(), res.end(), ref.begin());
+            
+            // shrinking the budget evicts immediately
+            array.setCacheMaxBytes(budget / 3);
+            shouldEqual(array.cacheSize(), 1);
+        }
+    }
+    
+    void testPrefetch()
+    {
+        Array array(Shape2(32, 4), chunkShape(), 
+                    ChunkedArrayOptions().cacheMax(4).prefetch(2));
+        shouldEqual(array.prefetchSize(), 2);
+        
+        MultiArray<2, int> ref(array.shape());
+        linearSequence(ref.begin(), ref.end());
+        array.commitSubarray(Shape2(), ref);
+        array.releaseChunks(Shape2(), array.shape());
+        for(int k=0; k<8; ++k)
+            should(!isLoaded(array, k));
+        
+        {
+            Array::chunk_const_iterator i = array.chunk_cbegin(Shape2(), array.shape());
+            ++i;
+            array.finishPrefetching();
+            should(isLoaded(array, 2));
+            should(isLoaded(array, 3));
+            should(!isLoaded(array, 4));
+        }
+        
+        Array::chunk_const_iterator i = array.chunk_cbegin(Shape2(), array.shape());
+        for(; i.isValid(); ++i)
+        {
+            shouldEqual(i->shape(), chunkShape());
+            should(*i == ref.subarray(i.chunkStart(), i.chunkStop()));
+        }
+        array.finishPrefetching();
+        should(array.cacheSize() <= 4);
+        
+        array.setPrefetchSize(0);
+        shouldEqual(array.prefetchSize(), 0);
+    }
+    
+    void testCompressionThreads()
+    {
+        Array array(Shape2(32, 8), chunkShape(), 
+                    ChunkedArrayOptions().cacheMax(2).compressionThreads(2));
+        shouldEqual(array.compressionThreads(), 2);
+        
+        MultiArray<2, int> ref(array.shape());
+        linearSequence(ref.begin(), ref.end());
+        array.commitSubarray(Shape2(), ref);
+        
+        // all but two chunks are compressed in the background
+        array.finishCompression();
+        shouldEqual(array.cacheSize(), 2);
+        int compressed = 0;
+        for(int k=0; k<16; ++k)
+        {
+            SharedChunkHandle<2, int> * handle = array.lookupHandle(Shape2(k % 8, k / 8));
+            if(handle->chunk_state_.load() == Array::chunk_asleep)
+            {
+                should(handle->pointer_->pointer_ == 0);
+                ++compressed;
+            }
+        }
+        shouldEqual(compressed, 14);
+        shouldEqual((array.ChunkedArray<2, int>::dataBytes()), chunkBytes(array));
+        
+        // parallel checkout, also at an offset not aligned with the chunks
+        MultiArray<2, int> res(array.shape());
+        array.checkoutSubarray(Shape2(), res);
+        shouldEqualSequence(res.begin(), res.end(), ref.begin());
+        
+        res.reshape(Shape2(21, 5));
+        array.checkoutSubarray(Shape2(3, 2), res);
+        should(res == ref.subarray(Shape2(3, 2), Shape2(24, 7)));
+        
+        // chunks reloaded before or after their compression are counted once
+        res.reshape(array.shape());
+        for(int k=0; k<4; ++k)
+            array.checkoutSubarray(Shape2(), res);
+        array.finishCompression();
+        shouldEqual((array.ChunkedArray<2, int>::dataBytes()), chunkBytes(array));
+        
+        // uninitialized chunks return the fill value
+        Array empty(Shape2(32, 8), chunkShape(), 
+                    ChunkedArrayOptions().fillValue(3).compressionThreads(2));
+        res.reshape(empty.shape());
+        empty.checkoutSubarray(Shape2(), res);
+        should(res == (MultiArray<2, int>(res.shape(), 3)));
+        shouldEqual(empty.cacheSize(), 0);
+    }
+    
+    void testShuffle()
+    {
+        Array array(Shape2(32, 8), chunkShape(), 
+                    ChunkedArrayOptions().cacheMax(2).shuffle());
+        
+        MultiArray<2, int> ref(array.shape()), res(array.shape());
+        linearSequence(ref.begin(), ref.end());
+        array.commitSubarray(Shape2(), ref);
+        array.releaseChunks(Shape2(), array.shape());
+        array.checkoutSubarray(Shape2(), res);
+        shouldEqualSequence(res.begin(), res.end(), ref.begin());
+    }
+};
+
+struct ChunkedArrayMmapTest
+{
+    typedef ChunkedArrayMmap<3, float> Array;
+    
+        // a unique file in the temporary directory, removed at the end of the test
+    struct TempFile
+    {
+        std::string name;
+        
+        TempFile()
+        {
+        #ifdef _WIN32
+            name = detail::winTempFileName();
+        #else
+            char const * dir = std::getenv("TMPDIR");
+            name = std::string(dir && *dir ? dir : "/tmp") + "/vigra_mmap_test_XXXXXX";
+            int file = ::mkstemp(&name[0]);
+            vigra_precondition(file != -1, "TempFile(): unable to create temporary file.");
+            ::close(file);
+        #endif
+        }
+        
+        ~TempFile()
+        {
+            std::remove(name.c_str());
+        }
+    };
+    
+    void testReopen()
+    {
+        TempFile tmp;
+        std::string const & filename = tmp.name;
+        Shape3 shape(20, 21, 22);
+        MultiArray<3, float> ref(shape, 42.0f);
+        ref.subarray(Shape3(0), Shape3(20, 21, 8)).init(1.0f);
+        ref(3, 4, 5) = 2.0f;
+        ref(19, 20, 7) = 3.0f;
+        
+        {
+            Array array(filename, shape, Shape3(8), 
+                        ChunkedArrayOptions().fillValue(42.0).cacheMax(4));
+            shouldEqual(array.fileName(), filename);
+            
+            // only write the first layer of chunks
+            array.subarray(Shape3(0), Shape3(20, 21, 8)).init(1.0f);
+            array.setItem(Shape3(3, 4, 5), 2.0f);
+            array.setItem(Shape3(19, 20, 7), 3.0f);
+        }
+        
+        {
+            Array array(filename, false, ChunkedArrayOptions().fillValue(0.0));
+            shouldEqual(array.shape(), shape);
+            shouldEqual(array.chunkShape(), Shape3(8));
+            should(!array.isReadOnly());
+            
+            // the remaining chunks were never written and still return the fill value
+            MultiArray<3, float> res(shape);
+            array.checkoutSubarray(Shape3(), res);
+            shouldEqualSequence(res.begin(), res.end(), ref.begin());
+            
+            array.setItem(Shape3(10, 10, 10), 4.0f);
+            ref(10, 10, 10) = 4.0f;
+        }
+        
+        {
+            Array array(filename, true);
+            should(array.isReadOnly());
+            
+            MultiArray<3, float> res(shape);
+            array.checkoutSubarray(Shape3(), res);
+            shouldEqualSequence(res.begin(), res.end(), ref.begin());
+            
+            // non-const iterators only modify the chunks in memory
+            {
+                Array::iterator i = array.begin();
+                shouldEqual(*i, 1.0f);
+                *i = 6.0f;
+                shouldEqual(array.getItem(Shape3()), 6.0f);
+                
+                // never written chunks are filled in memory
+                int filled = 0;
+                for(Array::iterator end = array.end(); i != end; ++i)
+                    if(*i == 42.0f)
+                        ++filled;
+                shouldEqual(filled, 20*21*14 - 1);
+            }
+            try
+            {
+                array.setItem(Shape3(10, 10, 20), 5.0f);
+                failTest("no exception thrown");
+            }
+            catch(PreconditionViolation & c)
+            {
+                std::string expected("\nPrecondition violation!\nChunkedArray::setItem(): array is read-only.");
+                std::string message(c.what());
+                should(0 == expected.compare(message.substr(0,expected.size())));
+            }
+            try
+            {
+                array.subarray(Shape3(0, 0, 16), shape);
+                failTest("no exception thrown");
+            }
+            catch(PreconditionViolation & c)
+            {
+                std::string expected("\nPrecondition violation!\nChunkedArray::subarray(): array is read-only.");
+                std::string message(c.what());
+                should(0 == expected.compare(message.substr(0,expected.size())));
+            }
+            
+            // const access to unwritten chunks still returns the fill value
+            Array const & carray = array;
+            shouldEqual(carray.getItem(Shape3(10, 10, 20)), 42.0f);
+        }
+        
+        {
+            // the file was not modified
+            Array array(filename, true);
+            MultiArray<3, float> res(shape);
+            array.checkoutSubarray(Shape3(), res);
+            shouldEqualSequence(res.begin(), res.end(), ref.begin());
+        }
+        
+        try
+        {
+            ChunkedArrayMmap<3, int> array(filename);
+            failTest("no exception thrown");
+        }
+        catch(PreconditionViolation & c)
+        {
+            std::string expected("\nPrecondition violation!\nChunkedArrayMmap(): value type mismatch between file and array.");
+            std::string message(c.what());
+            should(0 == expected.compare(message.substr(0,expected.size())));
+        }
+        
+        try
+        {
+            ChunkedArrayMmap<2, float> array(filename);
+            failTest("no exception thrown");
+        }
+        catch(PreconditionViolation & c)
+        {
+            std::string expected("\nPrecondition violation!\nChunkedArrayMmap(): dimension mismatch between file and array.");
+            std::string message(c.what());
+            should(0 == expected.compare(message.substr(0,expected.size())));
+        }
+    }
+};
+
 template <class Array>
 class ChunkedMultiArraySpeedTest
 {
@@ -1507,6 +1916,54 @@ public:
         std::string t = TOCS;
         std::cerr << "    indexing:  " << t << " (cache: " << array->cacheSize() << ")\n";
     }
+    
+    static void testThreadScalingRun(BaseArray * a, int startIndex, int d, double * sum)
+    {
+        typedef typename BaseArray::chunk_const_iterator ChunkIterator;
+        
+        ChunkIterator begin = a->chunk_cbegin(Shape3(), a->shape());
+        MultiArrayIndex count = prod(a->chunkArrayShape());
+        double res = 0.0;
+        for(MultiArrayIndex k=startIndex; k<count; k+=d)
+        {
+            ChunkIterator i(begin);
+            i += k;
+            res += std::accumulate(i->begin(), i->end(), 0.0);
+        }
+        *sum = res;
+    }
+    
+    void testThreadScaling()
+    {
+        // All chunks are asleep, and the cache is too small to keep them, 
+        // so that every chunk must be loaded and later evicted again. 
+        // Since loading happens outside of the global chunk lock, this 
+        // should scale with the number of threads.
+        int maxThreads = std::max(4, ParallelOptions().getActualNumThreads());
+        array->setCacheMaxSize(maxThreads);
+        double reference = 0.0;
+        
+        USETICTOC;
+        for(int n=1; n<=maxThreads; n*=2)
+        {
+            array->releaseChunks(Shape3(), shape);
+            
+            std::vector<double> sums(n);
+            std::vector<threading::thread> threads;
+            TIC;
+            for(int k=0; k<n; ++k)
+                threads.push_back(threading::thread(testThreadScalingRun, array.get(), k, n, &sums[k]));
+            for(int k=0; k<n; ++k)
+                threads[k].join();
+            std::string t = TOCS;
+            std::cerr << "    " << n << " thread(s): " << t << "\n";
+            
+            double sum = std::accumulate(sums.begin(), sums.end(), 0.0);
+            if(n == 1)
+                reference = sum;
+            shouldEqual(sum, reference);
+        }
+    }
 };
 
 struct ChunkedMultiArrayTestSuite
@@ -1536,6 +1993,8 @@ struct ChunkedMultiArrayTestSuite
         add( testCase( (&ChunkedMultiArraySpeedTest<ChunkedArrayCompressed<3, T> >::testIteratorSpeed )));
         add( testCase( (&ChunkedMultiArraySpeedTest<ChunkedArrayTmpFile<3, T> >::testIteratorSpeed )));
         add( testCase( (&ChunkedMultiArraySpeedTest<ChunkedArrayTmpFile<3, T> >::testIteratorSpeed_LargeCache )));
+        add( testCase( (&ChunkedMultiArraySpeedTest<ChunkedArrayCompressed<3, T> >::testThreadScaling )));
+        add( testCase( (&ChunkedMultiArraySpeedTest<ChunkedArrayTmpFile<3, T> >::testThreadScaling )));
 #ifdef HasHDF5
         add( testCase( (&ChunkedMultiArraySpeedTest<ChunkedArrayHDF5<3, T> >::testIteratorSpeed )));
         add( testCase( (&ChunkedMultiArraySpeedTest<ChunkedArrayHDF5<3, T> >::testIteratorSpeed_LargeCache )));
@@ -1562,6 +2021,7 @@ struct ChunkedMultiArrayTestSuite
         testImpl<ChunkedArrayLazy<3, float> >();
         testImpl<ChunkedArrayCompressed<3, float> >();
         testImpl<ChunkedArrayTmpFile<3, float> >();
+        testImpl<ChunkedArrayMmap<3, float> >();
 #ifdef HasHDF5
         testImpl<ChunkedArrayHDF5<3, float> >();
 #endif
@@ -1570,10 +2030,20 @@ struct ChunkedMultiArrayTestSuite
         testImpl<ChunkedArrayLazy<3, TinyVector<float, 3> > >();
         testImpl<ChunkedArrayCompressed<3, TinyVector<float, 3> > >();
         testImpl<ChunkedArrayTmpFile<3, TinyVector<float, 3> > >();
+        testImpl<ChunkedArrayMmap<3, TinyVector<float, 3> > >();
 #ifdef HasHDF5
         testImpl<ChunkedArrayHDF5<3, TinyVector<float, 3> > >();
 #endif
         
+        add( testCase( &ChunkedArrayCacheTest::testPolicies ) );
+        add( testCase( &ChunkedArrayCacheTest::testScanResistance ) );
+        add( testCase( &ChunkedArrayCacheTest::testStatistics ) );
+        add( testCase( &ChunkedArrayCacheTest::testByteBudget ) );
+        add( testCase( &ChunkedArrayCacheTest::testPrefetch ) );
+        add( testCase( &ChunkedArrayCacheTest::testCompressionThreads ) );
+        add( testCase( &ChunkedArrayCacheTest::testShuffle ) );
+        add( testCase( &ChunkedArrayMmapTest::testReopen ) );
+        
         testSpeedImpl<unsigned char>();
         testSpeedImpl<float>();
         testSpeedImpl<double>();
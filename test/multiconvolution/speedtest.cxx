@@ -9,6 +9,8 @@
 #include "vigra/convolution.hxx" 
 #include "vigra/navigator.hxx"
 #include "vigra/functorexpression.hxx"
+#include "vigra/multi_convolution.hxx"
+#include "vigra/timing.hxx"
 
 #include <ctime>
 
@@ -231,6 +233,33 @@ inline void convolveCopySrc(
 
 
 
+  /////////////////////////////////////////////////////////////////////////////////////////
+
+    // one axis, one line at a time (as convolveMultiArrayOneDimension() did before
+    // strided axes were processed in blocks of lines)
+template <unsigned int N, class T, class KT>
+void 
+convolveAxisLinewise(MultiArrayView<N, T> const & src, MultiArrayView<N, T> dest,
+                     unsigned int dim, Kernel1D<KT> const & kernel)
+{
+    typedef typename MultiArrayView<N, T>::const_traverser SrcTraverser;
+    typedef typename MultiArrayView<N, T>::traverser DestTraverser;
+    typedef typename NumericTraits<T>::RealPromote TmpType;
+
+    ArrayVector<TmpType> tmp(src.shape(dim));
+    MultiArrayNavigator<SrcTraverser, N> snav(src.traverser_begin(), src.shape(), dim);
+    MultiArrayNavigator<DestTraverser, N> dnav(dest.traverser_begin(), dest.shape(), dim);
+
+    for( ; snav.hasMore(); snav++, dnav++ ) 
+    {
+        copyLine(snav.begin(), snav.end(), StandardConstValueAccessor<T>(),
+                 tmp.begin(), StandardValueAccessor<TmpType>());
+        convolveLine(srcIterRange(tmp.begin(), tmp.end(), StandardConstValueAccessor<TmpType>()),
+                     destIter(dnav.begin(), StandardValueAccessor<T>()),
+                     kernel1d(kernel));
+    }
+}
+
   // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 } //-- namespace Impls
@@ -361,6 +390,54 @@ struct MultiArraySepConvSpeedTest
 };
 
 
+// Single-axis passes along the strided axes 1 and 2 of a 512^3 float volume:
+// line-wise convolution versus the blocked convolution of neighbouring lines
+// in convolveMultiArrayOneDimension().
+struct MultiArrayAxisPassSpeedTest
+{
+    typedef MultiArray<3, float> Volume;
+
+    Volume src, dest1, dest2;
+    Kernel1D<double> kernel;
+
+    MultiArrayAxisPassSpeedTest()
+    : src(Shape3(512)),
+      dest1(src.shape()),
+      dest2(src.shape())
+    {
+        for(int k=0; k<src.size(); ++k)
+            src[k] = float((k*7919) % 256);
+        kernel.initGaussian(2.0);
+    }
+
+    void testAxis(unsigned int dim)
+    {
+        USETICTOC;
+
+        TIC;
+        Impls::convolveAxisLinewise(src, dest1, dim, kernel);
+        double linewise = TOCN;
+
+        TIC;
+        convolveMultiArrayOneDimension(src, dest2, dim, kernel);
+        double blocked = TOCN;
+
+        std::cout << "    axis " << dim << ": line-wise " << linewise << " msec, blocked " 
+                  << blocked << " msec, speedup " << linewise / blocked << std::endl;
+        should(dest1 == dest2);
+    }
+
+    void testAxis1()
+    {
+        testAxis(1);
+    }
+
+    void testAxis2()
+    {
+        testAxis(2);
+    }
+};
+
 struct MultiArraySepConvSpeedTestSuite
 : public vigra::test_suite
 {
@@ -371,6 +448,8 @@ struct MultiArraySepConvSpeedTestSuite
         add( testCase( &MultiArraySepConvSpeedTest::test1 ) );
         add( testCase( &MultiArraySepConvSpeedTest::test2 ) );
         add( testCase( &MultiArraySepConvSpeedTest::testCorrectness ) );
+        add( testCase( &MultiArrayAxisPassSpeedTest::testAxis1 ) );
+        add( testCase( &MultiArrayAxisPassSpeedTest::testAxis2 ) );
     }
 };
 
@@ -47,6 +47,7 @@
 #include "vigra/unittest.hxx"
 #include "vigra/multi_array.hxx"
 #include "vigra/multi_convolution.hxx"
+#include "vigra/multi_feature_bank.hxx"
 #include "vigra/basicimageview.hxx"
 #include "vigra/convolution.hxx" 
 #include "vigra/navigator.hxx"
@@ -330,6 +331,226 @@ struct MultiArraySeparableConvolutionTest
         }
     }
 
+    void testLineBlocks()
+    {
+        // strided axes are convolved in blocks of lines, compare with line-wise convolution
+        makeRandom(srcImage);
+
+        static const BorderTreatmentMode modes[] = {
+            BORDER_TREATMENT_REFLECT, BORDER_TREATMENT_REPEAT, 
+            BORDER_TREATMENT_WRAP, BORDER_TREATMENT_ZEROPAD };
+
+        Kernel1D<double> kernel;
+        kernel.initExplicitly(-3, 2) = 0.1, -0.3, 0.25, 1.0, -0.2, 0.15;
+
+        typedef MultiArrayNavigator<Image3D::traverser, 3> Navigator;
+        for(int m=0; m<4; ++m)
+        {
+            kernel.setBorderTreatment(modes[m]);
+            for(int dim=1; dim<3; ++dim)
+            {
+                Image3D res(shape), ref(shape);
+                convolveMultiArrayOneDimension(srcImage, res, dim, kernel);
+
+                Navigator snav(srcImage.traverser_begin(), shape, dim),
+                          dnav(ref.traverser_begin(), shape, dim);
+                for( ; snav.hasMore(); snav++, dnav++ )
+                    convolveLine(srcIterRange(snav.begin(), snav.end(), StandardConstValueAccessor<PixelType>()),
+                                 destIter(dnav.begin(), StandardValueAccessor<PixelType>()), kernel1d(kernel));
+                shouldEqualSequence(res.begin(), res.end(), ref.begin());
+
+                Shape3 start(3, 5, 7), stop(41, 33, 29);
+                Image3D subarray(stop - start);
+                convolveMultiArrayOneDimension(srcImage, subarray, dim, kernel, start, stop);
+                should(subarray == ref.subarray(start, stop));
+            }
+
+            // in-place separable convolution
+            ArrayVector<Kernel1D<double> > kernels(3, kernel);
+            Image3D res(srcImage), ref(shape);
+            separableConvolveMultiArray(res, res, kernels.begin());
+            convolveMultiArrayOneDimension(srcImage, ref, 0, kernel);
+            convolveMultiArrayOneDimension(ref, ref, 1, kernel);
+            convolveMultiArrayOneDimension(ref, ref, 2, kernel);
+            shouldEqualSequenceTolerance(res.begin(), res.end(), ref.begin(), 1e-6);
+        }
+    }
+
+    void testParallel()
+    {
+        // the threaded filters must reproduce the serial results exactly
+        makeRandom(srcImage);
+
+        typedef MultiArray<3, TinyVector<PixelType, 6> > Image3x6;
+        ConvolutionOptions<3> serial, threaded = ConvolutionOptions<3>().numThreads(4);
+
+        Image3D res(shape), ref(shape);
+        gaussianSmoothMultiArray(srcImage, ref, 2.0, serial);
+        gaussianSmoothMultiArray(srcImage, res, 2.0, threaded);
+        should(res == ref);
+
+        laplacianOfGaussianMultiArray(srcImage, ref, 1.5, serial);
+        laplacianOfGaussianMultiArray(srcImage, res, 1.5, threaded);
+        should(res == ref);
+
+        Image3x3 gres(shape), gref(shape);
+        gaussianGradientMultiArray(srcImage, gref, 1.5, serial);
+        gaussianGradientMultiArray(srcImage, gres, 1.5, threaded);
+        should(gres == gref);
+
+        gaussianDivergenceMultiArray(gref, ref, 1.0, serial);
+        gaussianDivergenceMultiArray(gref, res, 1.0, threaded);
+        should(res == ref);
+
+        Image3x6 hres(shape), href(shape);
+        hessianOfGaussianMultiArray(srcImage, href, 1.5, serial);
+        hessianOfGaussianMultiArray(srcImage, hres, 1.5, threaded);
+        should(hres == href);
+
+        structureTensorMultiArray(srcImage, href, 1.0, 2.0, serial);
+        structureTensorMultiArray(srcImage, hres, 1.0, 2.0, threaded);
+        should(hres == href);
+
+        Shape3 start(3, 5, 7), stop(41, 33, 29);
+        Image3D sres(stop - start), sref(stop - start);
+        gaussianSmoothMultiArray(srcImage, sref, 2.0, serial.subarray(start, stop));
+        gaussianSmoothMultiArray(srcImage, sres, 2.0, threaded.subarray(start, stop));
+        should(sres == sref);
+
+        Image3x6 tres(stop - start), tref(stop - start);
+        hessianOfGaussianMultiArray(srcImage, tref, 1.5, serial);
+        hessianOfGaussianMultiArray(srcImage, tres, 1.5, threaded.numThreads(ParallelOptions::Auto));
+        should(tres == tref);
+    }
+
+    void testRecursiveFilter()
+    {
+        makeRandom(srcImage);
+        ConvolutionOptions<3> opt = ConvolutionOptions<3>().useRecursiveFilter();
+
+        // each axis is filtered by recursiveGaussianFilterLine()
+        Image3D res(shape), ref(srcImage);
+        gaussianSmoothMultiArray(srcImage, res, 3.0, opt);
+        for(int dim=0; dim<3; ++dim)
+        {
+            typedef MultiArrayNavigator<Image3D::traverser, 3> Navigator;
+            for(Navigator nav(ref.traverser_begin(), shape, dim); nav.hasMore(); nav++)
+                recursiveGaussianFilterLine(nav.begin(), nav.end(), StandardConstValueAccessor<PixelType>(),
+                                            nav.begin(), StandardValueAccessor<PixelType>(), 3.0);
+        }
+        should(res == ref);
+
+        // threads and subarrays don't change the result
+        Image3x3 grad(shape), gref(shape);
+        gaussianGradientMultiArray(srcImage, gref, 5.0, opt);
+        gaussianGradientMultiArray(srcImage, grad, 5.0, ConvolutionOptions<3>(opt).numThreads(4));
+        should(grad == gref);
+
+        Shape3 start(3, 5, 7), stop(41, 33, 29);
+        Image3D sres(stop - start);
+        gaussianSmoothMultiArray(srcImage, sres, 3.0, ConvolutionOptions<3>(opt).subarray(start, stop));
+        should(sres == res.subarray(start, stop));
+
+        MultiArray<3, TinyVector<PixelType, 6> > tres(shape), tref(shape);
+        structureTensorMultiArray(srcImage, tref, 1.0, 5.0, opt);
+        structureTensorMultiArray(srcImage, tres, 1.0, 5.0, ConvolutionOptions<3>(opt).numThreads(4));
+        should(tres == tref);
+
+        // derivatives of a linear function
+        Image3D wedge(shape);
+        makeWedge(wedge);
+        gaussianGradientMultiArray(wedge, grad, 5.0, opt);
+        laplacianOfGaussianMultiArray(wedge, res, 5.0, opt);
+        Shape3 p(shape / 2);
+        for(int k=0; k<3; ++k)
+            shouldEqualTolerance(grad[p][k], 1.0, 1e-2);
+        shouldEqualTolerance(res[p], 0.0, 1e-3);
+    }
+
+    template <class View>
+    void shouldEqualMaxDifference(Image3D const & ref, View const & res, double epsilon)
+    {
+        // absolute error, since relative errors are meaningless for near-zero derivatives
+        // (the float eigenvalue solver is ill-conditioned for nearly equal eigenvalues
+        //  and alone contributes errors of up to 1e-4 on the random test volume)
+        shouldEqual(ref.shape(), res.shape());
+        double maxDiff = 0.0;
+        for(int k=0; k<ref.size(); ++k)
+            maxDiff = std::max(maxDiff, (double)std::abs(ref[k] - res[k]));
+        should(maxDiff < epsilon);
+    }
+
+    void testFeatureBank()
+    {
+        // the feature bank must agree with the individual filters
+        makeRandom(srcImage);
+
+        typedef MultiArray<3, TinyVector<PixelType, 6> > Image3x6;
+        typedef MultiArray<4, PixelType> Features;
+
+        FeatureBankOptions features = FeatureBankOptions()
+                                        .gaussianSmoothing(1.0)
+                                        .hessianOfGaussianEigenvalues(1.0)
+                                        .gaussianGradientMagnitude(2.0)
+                                        .laplacianOfGaussian(1.0)
+                                        .structureTensorEigenvalues(1.0, 2.0)
+                                        .laplacianOfGaussian(2.0)
+                                        .gaussianSmoothing(2.0);
+        shouldEqual(features.size(), 7u);
+        shouldEqual(features.channelCount(3), 11u);
+
+        ConvolutionOptions<3> opt = ConvolutionOptions<3>().stepSize(TinyVector<double, 3>(1.0, 1.0, 2.0));
+        Features res(Shape4(shape[0], shape[1], shape[2], features.channelCount(3)));
+        featureBankMultiArray(srcImage, res, features, opt.numThreads(2));
+
+        Image3D ref(shape);
+        Image3x3 eigenvalues(shape);
+        Image3x6 tensor(shape);
+
+        gaussianSmoothMultiArray(srcImage, ref, 1.0, opt);
+        shouldEqualMaxDifference(ref, res.bindOuter(0), 1e-5);
+
+        hessianOfGaussianMultiArray(srcImage, tensor, 1.0, opt);
+        tensorEigenvaluesMultiArray(tensor, eigenvalues);
+        for(int k=0; k<3; ++k)
+        {
+            ref = eigenvalues.bindElementChannel(k);
+            shouldEqualMaxDifference(ref, res.bindOuter(1+k), 2e-4);
+        }
+
+        gaussianGradientMagnitude(srcImage, ref, opt.stdDev(2.0));
+        shouldEqualMaxDifference(ref, res.bindOuter(4), 1e-5);
+
+        laplacianOfGaussianMultiArray(srcImage, ref, 1.0, opt);
+        shouldEqualMaxDifference(ref, res.bindOuter(5), 1e-5);
+
+        structureTensorMultiArray(srcImage, tensor, 1.0, 2.0, opt);
+        tensorEigenvaluesMultiArray(tensor, eigenvalues);
+        for(int k=0; k<3; ++k)
+        {
+            ref = eigenvalues.bindElementChannel(k);
+            shouldEqualMaxDifference(ref, res.bindOuter(6+k), 2e-4);
+        }
+
+        laplacianOfGaussianMultiArray(srcImage, ref, 2.0, opt);
+        shouldEqualMaxDifference(ref, res.bindOuter(9), 1e-5);
+
+        gaussianSmoothMultiArray(srcImage, ref, 2.0, opt);
+        shouldEqualMaxDifference(ref, res.bindOuter(10), 1e-5);
+
+        try
+        {
+            featureBankMultiArray(srcImage, res.bindOuter(0).insertSingletonDimension(3), features);
+            failTest("featureBankMultiArray() failed to throw exception.");
+        }
+        catch(PreconditionViolation & e)
+        {
+            std::string expected("\nPrecondition violation!\nfeatureBankMultiArray(): wrong number of channels in output array."),
+                        actual(e.what());
+            shouldEqual(actual.substr(0, expected.size()), expected);
+        }
+    }
+
     void test_inplaceness1( const Image3D &src, float ksize, bool useDerivative )
     {
         Image3D da( src.shape() );
@@ -434,6 +655,29 @@ struct MultiArraySeparableConvolutionTest
         MultiArray<3, Multiband<double> > spectral(Shape3(shape[0], shape[1], 10));
         MultiArrayView<3, Multiband<double> > spectral_expanded(spectral);
         gaussianGradientMagnitude<2>(spectral_expanded, rmgrad, 1.0);
+
+        // 3D with anisotropic steps, ROI, threads and recursive filters
+        // must agree with the norm of the explicit gradient
+        Shape3 vshape(20, 25, 15);
+        MultiArray<3, double> vol(vshape), vmag(vshape), vref(vshape);
+        MultiArray<3, TinyVector<double, 3> > vgrad(vshape);
+        makeRandom(vol);
+
+        ConvolutionOptions<3> opt = ConvolutionOptions<3>().stepSize(TinyVector<double, 3>(1.0, 1.0, 2.0));
+        for(int recursive = 0; recursive < 2; ++recursive)
+        {
+            opt.useRecursiveFilter(recursive == 1);
+            gaussianGradientMultiArray(vol, vgrad, opt.stdDev(1.5).numThreads(ParallelOptions::NoThreads));
+            transformMultiArray(vgrad, vref, norm(Arg1()));
+            gaussianGradientMagnitude(vol, vmag, opt.stdDev(1.5).numThreads(3));
+            shouldEqualMaxDifference(vref, vmag, 1e-6);
+
+            Shape3 start(3, 4, 2), stop(-5, 20, -1);
+            MultiArray<3, float> roimag(Shape3(12, 16, 12));
+            gaussianGradientMagnitude(vol, roimag, ConvolutionOptions<3>(opt).subarray(start, stop));
+            shouldEqualMaxDifference(MultiArray<3, double>(vref.subarray(start, Shape3(15, 20, 14))), 
+                                     MultiArray<3, double>(roimag), 1e-5);
+        }
     }
 
     void test_laplacian()
@@ -592,6 +836,10 @@ struct MultiArraySeparableConvolutionTestSuite
                 add( testCase( &MultiArraySeparableConvolutionTest::test_InplaceN ) );
                 add( testCase( &MultiArraySeparableConvolutionTest::test_Inplace1 ) );
                 add( testCase( &MultiArraySeparableConvolutionTest::testSmoothing ) );
+                add( testCase( &MultiArraySeparableConvolutionTest::testLineBlocks ) );
+                add( testCase( &MultiArraySeparableConvolutionTest::testParallel ) );
+                add( testCase( &MultiArraySeparableConvolutionTest::testFeatureBank ) );
+                add( testCase( &MultiArraySeparableConvolutionTest::testRecursiveFilter ) );
                 add( testCase( &MultiArraySeparableConvolutionTest::test_gradient1 ) );
                 add( testCase( &MultiArraySeparableConvolutionTest::test_laplacian ) );
                 add( testCase( &MultiArraySeparableConvolutionTest::test_divergence ) );
@@ -0,0 +1,110 @@
+// -*- c++ -*-
+// $Id$
+
+#include "vigra/unittest.hxx"
+#include "vigra/multi_array.hxx"
+#include "vigra/accumulator.hxx"
+#include "vigra/random.hxx"
+#include "vigra/timing.hxx"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace vigra;
+using namespace vigra::acc;
+
+// Per-region intensity histograms (64 bins) of a 256x256x64 float volume
+// with 512 regions: the two-pass AutoRangeHistogram versus the single-pass
+// AdaptiveRangeHistogram, each with and without StandardQuantiles.
+struct RegionHistogramSpeedTest
+{
+    typedef MultiArray<3, float> Volume;
+    typedef MultiArray<3, int>   Labels;
+
+    Volume data;
+    Labels labels;
+
+    RegionHistogramSpeedTest()
+    : data(Shape3(256, 256, 64)),
+      labels(data.shape())
+    {
+        RandomMT19937 random(42);
+        for(int k=0; k<data.size(); ++k)
+            data[k] = float(1000.0*random.uniform());
+        for(int z=0; z<data.shape(2); ++z)
+            for(int y=0; y<data.shape(1); ++y)
+                for(int x=0; x<data.shape(0); ++x)
+                    labels(x,y,z) = x/32 + 8*(y/32) + 64*(z/16);
+    }
+
+    template <class Selected, class HistTag>
+    double time(std::string const & name, MultiArray<1, double> & counts)
+    {
+        typedef AccumulatorChainArray<CoupledArrays<3, float, int>,
+                              Select<DataArg<1>, LabelArg<2>, Count, Selected> > Chain;
+        Chain a;
+
+        // best of several runs, because single timings are noisy
+        USETICTOC;
+        double t = NumericTraits<double>::max();
+        for(int run=0; run<5; ++run)
+        {
+            a = Chain();
+            a.setHistogramOptions(HistogramOptions().setBinCount(64));
+            TIC;
+            extractFeatures(data, labels, a);
+            t = std::min(t, TOCN);
+        }
+        std::cout << "    " << name << ": " << t << " msec" << std::endl;
+
+        counts.reshape(Shape1(a.regionCount()));
+        for(unsigned int k=0; k<a.regionCount(); ++k)
+        {
+            MultiArray<1, double> h = get<HistTag>(a, k);
+            counts(k) = h.sum<double>();
+            shouldEqual(counts(k), get<Count>(a, k));
+        }
+        return t;
+    }
+
+    void testHistogram()
+    {
+        MultiArray<1, double> autoCounts, adaptiveCounts;
+        double tauto = time<AutoRangeHistogram<0>, AutoRangeHistogram<0> >(
+                                    "AutoRangeHistogram    ", autoCounts);
+        double tadaptive = time<AdaptiveRangeHistogram<0>, AdaptiveRangeHistogram<0> >(
+                                    "AdaptiveRangeHistogram", adaptiveCounts);
+        std::cout << "    speedup " << tauto / tadaptive << std::endl;
+        should(autoCounts == adaptiveCounts);
+    }
+
+    void testQuantiles()
+    {
+        MultiArray<1, double> autoCounts, adaptiveCounts;
+        double tauto = time<StandardQuantiles<AutoRangeHistogram<0> >, AutoRangeHistogram<0> >(
+                                    "StandardQuantiles<AutoRangeHistogram>    ", autoCounts);
+        double tadaptive = time<StandardQuantiles<AdaptiveRangeHistogram<0> >, AdaptiveRangeHistogram<0> >(
+                                    "StandardQuantiles<AdaptiveRangeHistogram>", adaptiveCounts);
+        std::cout << "    speedup " << tauto / tadaptive << std::endl;
+        should(autoCounts == adaptiveCounts);
+    }
+};
+
+struct ObjectFeaturesSpeedTestSuite
+: public vigra::test_suite
+{
+    ObjectFeaturesSpeedTestSuite()
+    : vigra::test_suite("ObjectFeaturesSpeedTestSuite")
+    {
+        add( testCase( &RegionHistogramSpeedTest::testHistogram ) );
+        add( testCase( &RegionHistogramSpeedTest::testQuantiles ) );
+    }
+};
+
+int main()
+{
+    ObjectFeaturesSpeedTestSuite test;
+    int failed = test.run();
+    std::cout << test.report() << std::endl;
+    return (failed != 0);
+}
@@ -1549,6 +1549,413 @@ struct AccumulatorTest
         shouldEqualTolerance(P(2.5, 2.0), get<ConvexHull>(chf, 1).hullCenter(), P(1e-15));
         shouldEqualTolerance(P(2.6666666666666667, 2.0), get<ConvexHull>(chf, 1).convexityDefectCenter(), P(1e-15));
     }
+
+    void testParallelExtraction()
+    {
+        using namespace vigra::acc;
+
+        Shape3 shape(40, 30, 20);
+        MultiArray<3, double> data(shape);
+        MultiArray<3, int> labels(shape);
+        for(int k=0; k<data.size(); ++k)
+        {
+            data[k] = (k*7919 % 1013) / 10.0;
+            labels[k] = (k / 37 + k*k) % 9;
+        }
+
+        // multi-pass chain, including global statistics, coordinates and histograms
+        typedef AccumulatorChainArray<CoupledArrays<3, double, int>,
+                    Select<DataArg<1>, LabelArg<2>, Count, Mean, Variance, Skewness, Kurtosis, 
+                           Minimum, Maximum, RegionCenter, Coord<Maximum>, 
+                           AutoRangeHistogram<16>, GlobalRangeHistogram<8>, 
+                           Global<Mean>, Global<Variance> > > A;
+        A serial, parallel;
+        serial.ignoreLabel(3);
+        parallel.ignoreLabel(3);
+        shouldEqual(parallel.passesRequired(), 2u);
+
+        extractFeatures(data, labels, serial);
+        extractFeatures(data, labels, parallel, ParallelOptions().numThreads(4));
+
+        shouldEqual(parallel.maxRegionLabel(), serial.maxRegionLabel());
+        shouldEqualTolerance(get<Global<Mean> >(parallel), get<Global<Mean> >(serial), 1e-12);
+        shouldEqualTolerance(get<Global<Variance> >(parallel), get<Global<Variance> >(serial), 1e-12);
+        for(int l=0; l<=serial.maxRegionLabel(); ++l)
+        {
+            shouldEqual(get<Count>(parallel, l), get<Count>(serial, l));
+            if(l == 3)
+                continue;
+            shouldEqualTolerance(get<Mean>(parallel, l), get<Mean>(serial, l), 1e-12);
+            shouldEqualTolerance(get<Variance>(parallel, l), get<Variance>(serial, l), 1e-12);
+            shouldEqualTolerance(get<Skewness>(parallel, l), get<Skewness>(serial, l), 1e-10);
+            shouldEqualTolerance(get<Kurtosis>(parallel, l), get<Kurtosis>(serial, l), 1e-10);
+            shouldEqual(get<Minimum>(parallel, l), get<Minimum>(serial, l));
+            shouldEqual(get<Maximum>(parallel, l), get<Maximum>(serial, l));
+            shouldEqualSequenceTolerance(get<RegionCenter>(parallel, l).begin(), get<RegionCenter>(parallel, l).end(),
+                                         get<RegionCenter>(serial, l).begin(), 1e-10);
+            shouldEqual(get<AutoRangeHistogram<16> >(parallel, l), get<AutoRangeHistogram<16> >(serial, l));
+            shouldEqual(get<GlobalRangeHistogram<8> >(parallel, l), get<GlobalRangeHistogram<8> >(serial, l));
+        }
+
+        // the result only depends on the number of threads
+        A again;
+        again.ignoreLabel(3);
+        extractFeatures(data, labels, again, ParallelOptions().numThreads(4));
+        for(int l=0; l<=serial.maxRegionLabel(); ++l)
+        {
+            if(l == 3)
+                continue;
+            shouldEqual(get<Variance>(again, l), get<Variance>(parallel, l));
+            shouldEqual(get<Kurtosis>(again, l), get<Kurtosis>(parallel, l));
+            shouldEqual(get<RegionCenter>(again, l), get<RegionCenter>(parallel, l));
+        }
+
+        // repeated calls accumulate all data, as in the sequential version
+        typedef AccumulatorChainArray<CoupledArrays<3, double, int>,
+                    Select<DataArg<1>, LabelArg<2>, Count, Sum, Mean, Minimum, Maximum,
+                           UserRangeHistogram<8>, Global<Count> > > C;
+        C serial2, parallel2;
+        serial2.setHistogramOptions(HistogramOptions().setMinMax(0.0, 102.4));
+        parallel2.setHistogramOptions(HistogramOptions().setMinMax(0.0, 102.4));
+        shouldEqual(parallel2.passesRequired(), 1u);
+        for(int k=0; k<2; ++k)
+        {
+            extractFeatures(data, labels, serial2);
+            extractFeatures(data, labels, parallel2, ParallelOptions().numThreads(4));
+        }
+        shouldEqual(get<Global<Count> >(parallel2), 2.0*data.size());
+        for(int l=0; l<=serial2.maxRegionLabel(); ++l)
+        {
+            shouldEqual(get<Count>(parallel2, l), get<Count>(serial2, l));
+            shouldEqualTolerance(get<Sum>(parallel2, l), get<Sum>(serial2, l), 1e-8);
+            shouldEqualTolerance(get<Mean>(parallel2, l), get<Mean>(serial2, l), 1e-12);
+            shouldEqual(get<Minimum>(parallel2, l), get<Minimum>(serial2, l));
+            shouldEqual(get<Maximum>(parallel2, l), get<Maximum>(serial2, l));
+            shouldEqual(get<UserRangeHistogram<8> >(parallel2, l), get<UserRangeHistogram<8> >(serial2, l));
+        }
+
+        // plain chain over a raw pointer range
+        typedef AccumulatorChain<double, Select<Mean, Variance, Kurtosis, Minimum> > B;
+        B b1, b2;
+        extractFeatures(data.data(), data.data()+data.size(), b1);
+        extractFeatures(data.data(), data.data()+data.size(), b2, ParallelOptions().numThreads(3));
+        shouldEqual(get<Count>(b2), get<Count>(b1));
+        shouldEqualTolerance(get<Mean>(b2), get<Mean>(b1), 1e-12);
+        shouldEqualTolerance(get<Variance>(b2), get<Variance>(b1), 1e-12);
+        shouldEqualTolerance(get<Kurtosis>(b2), get<Kurtosis>(b1), 1e-10);
+        shouldEqual(get<Minimum>(b2), get<Minimum>(b1));
+
+        typedef AccumulatorChain<double, Select<Mean, Variance, Maximum> > D;
+        D d1, d2;
+        for(int k=0; k<2; ++k)
+        {
+            extractFeatures(data.data(), data.data()+data.size(), d1);
+            extractFeatures(data.data(), data.data()+data.size(), d2, ParallelOptions().numThreads(3));
+        }
+        shouldEqual(get<Count>(d2), 2.0*data.size());
+        shouldEqual(get<Count>(d2), get<Count>(d1));
+        shouldEqualTolerance(get<Mean>(d2), get<Mean>(d1), 1e-12);
+        shouldEqualTolerance(get<Variance>(d2), get<Variance>(d1), 1e-12);
+        shouldEqual(get<Maximum>(d2), get<Maximum>(d1));
+
+        // statistics that cannot be merged are reported
+        AccumulatorChainArray<CoupledArrays<3, double, int>,
+                              Select<DataArg<1>, LabelArg<2>, SumOfAbsDifferences> > c;
+        try
+        {
+            extractFeatures(data, labels, c, ParallelOptions().numThreads(2));
+            failTest("no exception thrown");
+        }
+        catch(PreconditionViolation &)
+        {}
+    }
+
+    void testGetAll()
+    {
+        using namespace vigra::acc;
+
+        Shape2 shape(30, 20);
+        MultiArray<2, double> data(shape);
+        MultiArray<2, int> labels(shape);
+        for(int k=0; k<data.size(); ++k)
+        {
+            data[k] = (k*7919 % 1013) / 10.0;
+            labels[k] = (k / 17) % 5;
+        }
+
+        typedef Select<DataArg<1>, LabelArg<2>, Count, Mean, RegionCenter, Coord<Covariance>,
+                       AutoRangeHistogram<8>, AutoRangeHistogram<0> > Selected;
+        AccumulatorChainArray<CoupledArrays<2, double, int>, Selected> a;
+        a.setHistogramOptions(HistogramOptions().setBinCount(4));
+        extractFeatures(data, labels, a);
+
+        int n = a.regionCount();
+        shouldEqual(n, 5);
+
+        // write into the columns of a feature matrix
+        MultiArray<2, double> features(Shape2(n, 4));
+        getAll<Count>(a, features.bind<1>(0));
+        getAll<Mean>(a, features.bind<1>(1));
+        getAll<RegionCenter>(a, features.subarray(Shape2(0, 2), Shape2(n, 4)));
+
+        MultiArray<2, double> histograms8(Shape2(n, 8)), histograms4(Shape2(n, 4));
+        getAll<AutoRangeHistogram<8> >(a, histograms8);
+        getAll<AutoRangeHistogram<0> >(a, histograms4);
+
+        MultiArray<3, double> covariances(Shape3(n, 2, 2));
+        getAll<Coord<Covariance> >(a, covariances);
+
+        for(int k=0; k<n; ++k)
+        {
+            shouldEqual(features(k, 0), get<Count>(a, k));
+            shouldEqual(features(k, 1), get<Mean>(a, k));
+            shouldEqual(features(k, 2), get<RegionCenter>(a, k)[0]);
+            shouldEqual(features(k, 3), get<RegionCenter>(a, k)[1]);
+            for(int j=0; j<8; ++j)
+                shouldEqual(histograms8(k, j), get<AutoRangeHistogram<8> >(a, k)[j]);
+            for(int j=0; j<4; ++j)
+                shouldEqual(histograms4(k, j), get<AutoRangeHistogram<0> >(a, k)[j]);
+            shouldEqual(covariances.bind<0>(k), get<Coord<Covariance> >(a, k));
+        }
+
+        try
+        {
+            getAll<Mean>(a, MultiArray<1, double>(Shape1(n+1)));
+            failTest("no exception thrown");
+        }
+        catch(PreconditionViolation &)
+        {}
+        try
+        {
+            getAll<RegionCenter>(a, MultiArray<2, double>(Shape2(n, 3)));
+            failTest("no exception thrown");
+        }
+        catch(PreconditionViolation &)
+        {}
+
+        // sparse region storage: rows are ordered like regionLabel(k)
+        MultiArray<2, UInt64> sparseLabels(shape);
+        for(int k=0; k<data.size(); ++k)
+            sparseLabels[k] = (4 - labels[k]) * 1000003ull;
+        AccumulatorChainArray<CoupledArrays<2, double, UInt64>, Select<DataArg<1>, LabelArg<2>, Mean> > sparse;
+        sparse.setSparseRegionStorage();
+        extractFeatures(data, sparseLabels, sparse);
+        MultiArray<1, double> means((Shape1(n)));
+        getAll<Mean>(sparse, means);
+        for(int k=0; k<n; ++k)
+            shouldEqual(means(k), get<Mean>(sparse, sparse.regionLabel(k)));
+
+        // inactive statistics of a dynamic chain cannot be exported
+        DynamicAccumulatorChainArray<CoupledArrays<2, double, int>, 
+                                     Select<DataArg<1>, LabelArg<2>, Mean, Variance> > dynamic;
+        dynamic.activate<Mean>();
+        extractFeatures(data, labels, dynamic);
+        getAll<Mean>(dynamic, means);
+        for(int k=0; k<n; ++k)
+            shouldEqual(means(k), get<Mean>(a, k));
+        try
+        {
+            getAll<Variance>(dynamic, means);
+            failTest("no exception thrown");
+        }
+        catch(PreconditionViolation &)
+        {}
+    }
+
+    void testAdaptiveRangeHistogram()
+    {
+        using namespace vigra::acc;
+
+        static const int SIZE = 10000, HSIZE = 64;
+        MultiArray<1, double> data((Shape1(SIZE)));
+        for(int k=0; k<SIZE; ++k)
+            data[k] = (k < 4*SIZE/10)
+                          ? (k*7919 % 1013) / 1013.0          // values in [0, 1)
+                          : 500.0 + (k*104729 % 997) / 2.0;   // values in [500, 998.5)
+        
+        typedef AdaptiveRangeHistogram<HSIZE> Hist;
+        typedef AccumulatorChain<double, Select<Count, Minimum, Maximum, Hist, StandardQuantiles<Hist> > > A;
+        shouldEqual(A().passesRequired(), 1u);
+
+        A a, half1, half2, parallel;
+        extractFeatures(data.begin(), data.end(), a);
+        extractFeatures(data.begin(), data.begin()+SIZE/2, half1);
+        extractFeatures(data.begin()+SIZE/2, data.end(), half2);
+        extractFeatures(data.begin(), data.end(), parallel, ParallelOptions().numThreads(4));
+        half1 += half2;
+
+        double minimum = get<Minimum>(a), maximum = get<Maximum>(a);
+        A * chains[] = { &a, &half1, &parallel };
+        for(int c=0; c<3; ++c)
+        {
+            A & b = *chains[c];
+            LookupTag<Hist, A>::type const & h = getAccumulator<Hist>(b);
+            
+            // bin width is a power of two, and the histogram covers the data
+            double width = h.mapItemInverse(1.0) - h.mapItemInverse(0.0);
+            int exponent;
+            shouldEqual(std::frexp(width, &exponent), 0.5);
+            should(width <= 4.0*(maximum - minimum) / HSIZE);
+            should(h.mapItem(minimum) >= 0.0);
+            should(h.mapItem(maximum) < HSIZE);
+            shouldEqual(h.left_outliers, 0.0);
+            shouldEqual(h.right_outliers, 0.0);
+
+            // merging is exact: compare with the histogram of the data using the same bins
+            TinyVector<double, HSIZE> ref;
+            for(int k=0; k<SIZE; ++k)
+                ref[(int)h.mapItem(data[k])] += 1.0;
+            shouldEqual(get<Hist>(b), ref);
+
+            // quantiles are accurate up to the bin width
+            MultiArray<1, double> sorted(data);
+            std::sort(sorted.begin(), sorted.end());
+            double q[] = { 0.0, 0.1, 0.25, 0.5, 0.75, 0.9, 1.0 };
+            TinyVector<double, 7> quantiles = get<StandardQuantiles<Hist> >(b);
+            for(int k=0; k<7; ++k)
+                should(std::abs(quantiles[k] - sorted[std::min(SIZE-1, (int)(q[k]*SIZE))]) <= width);
+            shouldEqual(quantiles[0], minimum);
+            shouldEqual(quantiles[6], maximum);
+        }
+        
+        // constant data: counted in a provisional bin of width 1, quantiles equal the data value
+        A constant;
+        for(int k=0; k<10; ++k)
+            constant(3.5);
+        shouldEqual(getAccumulator<Hist>(constant).mapItemInverse(1.0) - getAccumulator<Hist>(constant).mapItemInverse(0.0), 1.0);
+        shouldEqual(get<Hist>(constant)[(int)getAccumulator<Hist>(constant).mapItem(3.5)], 10.0);
+        shouldEqual(sum(get<Hist>(constant)), 10.0);
+        shouldEqual(get<StandardQuantiles<Hist> >(constant), (TinyVector<double, 7>(3.5)));
+        constant(4.0);
+        shouldEqual(get<Hist>(constant)[0], 10.0);
+        shouldEqual(sum(get<Hist>(constant)), 11.0);
+        
+        // run-time bin count and initial range
+        typedef AccumulatorChain<double, Select<AdaptiveRangeHistogram<0> > > B;
+        B b;
+        b.setHistogramOptions(HistogramOptions().setBinCount(16).setMinMax(0.0, 100.0));
+        shouldEqual(getAccumulator<AdaptiveRangeHistogram<0> >(b).mapItemInverse(1.0), 8.0);
+        b(127.0);
+        b(128.0);  // shift the bins
+        shouldEqual(get<AdaptiveRangeHistogram<0> >(b).size(), 16);
+        shouldEqual(getAccumulator<AdaptiveRangeHistogram<0> >(b).mapItemInverse(0.0), 120.0);
+        shouldEqual(getAccumulator<AdaptiveRangeHistogram<0> >(b).mapItemInverse(1.0), 128.0);
+        shouldEqual(get<AdaptiveRangeHistogram<0> >(b)[0], 1.0);
+        shouldEqual(get<AdaptiveRangeHistogram<0> >(b)[1], 1.0);
+        b(0.0);    // double the bin width
+        shouldEqual(get<AdaptiveRangeHistogram<0> >(b)[0], 1.0);
+        shouldEqual(get<AdaptiveRangeHistogram<0> >(b)[7], 1.0);
+        shouldEqual(get<AdaptiveRangeHistogram<0> >(b)[8], 1.0);
+        shouldEqual(getAccumulator<AdaptiveRangeHistogram<0> >(b).mapItemInverse(1.0), 16.0);
+
+        // values just below the upper border must not map to bin 'size'
+        B c;
+        c.setHistogramOptions(HistogramOptions().setBinCount(8));
+        c(-5.0);
+        c(-1.0);
+        c(std::nextafter(3.0, 0.0));
+        shouldEqual(getAccumulator<AdaptiveRangeHistogram<0> >(c).mapItemInverse(0.0), -5.0);
+        shouldEqual(getAccumulator<AdaptiveRangeHistogram<0> >(c).mapItemInverse(8.0), 3.0);
+        shouldEqual(get<AdaptiveRangeHistogram<0> >(c)[7], 1.0);
+        shouldEqual(get<AdaptiveRangeHistogram<0> >(c).sum<double>(), 3.0);
+    }
+
+    void testSparseRegionStorage()
+    {
+        using namespace vigra::acc;
+
+        Shape3 shape(30, 20, 10);
+        MultiArray<3, double> data(shape);
+        MultiArray<3, int> labels(shape);
+        MultiArray<3, UInt64> sparseLabels(shape);
+        const UInt64 stride = 1000000007ull;
+        for(int k=0; k<data.size(); ++k)
+        {
+            data[k] = (k*7919 % 1013) / 10.0;
+            labels[k] = (k / 23) % 7;
+            sparseLabels[k] = labels[k] * stride;
+        }
+
+        typedef Select<DataArg<1>, LabelArg<2>, Count, Mean, Variance, Skewness, Maximum,
+                       RegionCenter, AutoRangeHistogram<8>, Global<Mean>, Global<Count> > Selected;
+        AccumulatorChainArray<CoupledArrays<3, double, int>, Selected> dense;
+        typedef AccumulatorChainArray<CoupledArrays<3, double, UInt64>, Selected> Sparse;
+        Sparse sparse, parallel;
+
+        dense.ignoreLabel(2);
+        sparse.ignoreLabel(2*stride);
+        parallel.ignoreLabel(2*stride);
+        sparse.setSparseRegionStorage();
+        parallel.setSparseRegionStorage();
+        should(sparse.sparseRegionStorage());
+        should(!dense.sparseRegionStorage());
+
+        extractFeatures(data, labels, dense);
+        extractFeatures(data, sparseLabels, sparse);
+        extractFeatures(data, sparseLabels, parallel, ParallelOptions().numThreads(3));
+
+        shouldEqual(sparse.regionCount(), 6u);
+        shouldEqual(parallel.regionCount(), 6u);
+        shouldEqual(sparse.maxRegionLabel(), (MultiArrayIndex)(6*stride));
+        should(!sparse.hasRegion(2*stride));
+        should(!sparse.hasRegion(1));
+        shouldEqual(get<Global<Count> >(sparse), get<Global<Count> >(dense));
+        shouldEqualTolerance(get<Global<Mean> >(sparse), get<Global<Mean> >(dense), 1e-12);
+
+        for(unsigned int k=0; k<sparse.regionCount(); ++k)
+        {
+            MultiArrayIndex label = sparse.regionLabel(k);
+            int l = (int)(label / stride);
+            should(sparse.hasRegion(label));
+            shouldEqual(label % stride, 0);
+            shouldEqual(get<Count>(sparse, label), get<Count>(dense, l));
+            shouldEqual(get<Count>(parallel, label), get<Count>(dense, l));
+            shouldEqual(get<Mean>(sparse, label), get<Mean>(dense, l));
+            shouldEqual(get<Variance>(sparse, label), get<Variance>(dense, l));
+            shouldEqual(get<Skewness>(sparse, label), get<Skewness>(dense, l));
+            shouldEqual(get<Maximum>(sparse, label), get<Maximum>(dense, l));
+            shouldEqual(get<RegionCenter>(sparse, label), get<RegionCenter>(dense, l));
+            shouldEqual(get<AutoRangeHistogram<8> >(sparse, label), get<AutoRangeHistogram<8> >(dense, l));
+            shouldEqualTolerance(get<Mean>(parallel, label), get<Mean>(dense, l), 1e-12);
+            shouldEqualTolerance(get<Skewness>(parallel, label), get<Skewness>(dense, l), 1e-6);
+            shouldEqual(get<AutoRangeHistogram<8> >(parallel, label), get<AutoRangeHistogram<8> >(dense, l));
+        }
+
+        try
+        {
+            get<Mean>(sparse, 1);
+            failTest("no exception thrown");
+        }
+        catch(PreconditionViolation &)
+        {}
+
+        // merge by label: split the data in two halves
+        typedef AccumulatorChainArray<CoupledArrays<3, double, UInt64>, 
+                                      Select<DataArg<1>, LabelArg<2>, Count, Mean, Maximum> > Mergeable;
+        Mergeable all, half1, half2;
+        all.setSparseRegionStorage();
+        half1.setSparseRegionStorage();
+        half2.setSparseRegionStorage();
+        extractFeatures(data, sparseLabels, all);
+        Shape3 middle(0, 0, shape[2] / 2);
+        extractFeatures(data.subarray(Shape3(), Shape3(shape[0], shape[1], middle[2])), 
+                        sparseLabels.subarray(Shape3(), Shape3(shape[0], shape[1], middle[2])), half1);
+        extractFeatures(data.subarray(middle, shape), sparseLabels.subarray(middle, shape), half2);
+        half1.merge(half2);
+        shouldEqual(half1.regionCount(), all.regionCount());
+        for(unsigned int k=0; k<all.regionCount(); ++k)
+        {
+            MultiArrayIndex label = all.regionLabel(k);
+            shouldEqual(get<Count>(half1, label), get<Count>(all, label));
+            shouldEqualTolerance(get<Mean>(half1, label), get<Mean>(all, label), 1e-12);
+            shouldEqual(get<Maximum>(half1, label), get<Maximum>(all, label));
+        }
+
+        // merge two regions
+        half1.merge(0, stride);
+        shouldEqual(get<Count>(half1, 0), get<Count>(all, 0) + get<Count>(all, stride));
+        shouldEqual(get<Count>(half1, stride), 0.0);
+    }
 };
 
 struct FeaturesTestSuite : public vigra::test_suite
@@ -1566,6 +1973,10 @@ struct FeaturesTestSuite : public vigra::test_suite
         add(testCase(&AccumulatorTest::testRegionAccumulators));
         add(testCase(&AccumulatorTest::testIndexSpecifiers));
         add(testCase(&AccumulatorTest::testConvexHullFeatures));
+        add(testCase(&AccumulatorTest::testParallelExtraction));
+        add(testCase(&AccumulatorTest::testSparseRegionStorage));
+        add(testCase(&AccumulatorTest::testGetAll));
+        add(testCase(&AccumulatorTest::testAdaptiveRangeHistogram));
     }
 };
 
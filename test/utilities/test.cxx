@@ -39,6 +39,10 @@
 #include <algorithm>
 #include <queue>
 #include <set>
+#include <numeric>
+#include <cmath>
+#include <chrono>
+#include <thread>
 
 #include "vigra/unittest.hxx"
 #include "vigra/accessor.hxx"
@@ -49,6 +53,7 @@
 #include "vigra/priority_queue.hxx"
 #include "vigra/algorithm.hxx"
 #include "vigra/compression.hxx"
+#include "vigra/threadpool.hxx"
 
 
 using namespace vigra;
@@ -1247,6 +1252,64 @@ struct CompressionTest
         shouldEqualSequence(data.begin(), data.end(), decompressed.begin());
     }
     
+    void testZSTD()
+    {
+        ArrayVector<char> compressed;
+    #ifdef HasZSTD
+        compress(data.begin(), data.size(), compressed, ZSTD);
+        
+        should(compressed.size() < data.size() / 100);
+        
+        ArrayVector<char> decompressed(data.size());
+        
+        uncompress(compressed.begin(), compressed.size(),
+                   decompressed.begin(), decompressed.size(), ZSTD);
+                   
+        shouldEqualSequence(data.begin(), data.end(), decompressed.begin());
+    #else
+        try
+        {
+            compress(data.begin(), data.size(), compressed, ZSTD);
+            failTest("missing ZSTD did not throw exception.");
+        }
+        catch(ContractViolation & c)
+        {
+            std::string expected("\nPrecondition violation!\ncompress(): VIGRA was compiled without ZSTD compression.");
+            std::string message(c.what());
+            should(0 == expected.compare(message.substr(0,expected.size())));
+        }
+        
+    #endif
+    }
+    
+    void testShuffle()
+    {
+        // the size is not a multiple of the type size
+        ArrayVector<char> shuffled(data.size()), unshuffled(data.size());
+        byteShuffle(data.begin(), shuffled.begin(), data.size(), 3);
+        shouldEqual(shuffled[1], data[3]);
+        shouldEqual(shuffled[333333], data[1]);
+        shouldEqual(shuffled.back(), data.back());
+        byteUnshuffle(shuffled.begin(), unshuffled.begin(), data.size(), 3);
+        shouldEqualSequence(data.begin(), data.end(), unshuffled.begin());
+        
+        ArrayVector<float> values(100000);
+        for(unsigned int k=0; k<values.size(); ++k)
+            values[k] = std::sqrt((float)k);
+        char const * source = (char const *)values.begin();
+        std::size_t size = values.size()*sizeof(float);
+        
+        ArrayVector<char> plain, compressed;
+        compress(source, size, plain, LZ4);
+        compress(source, size, compressed, LZ4, sizeof(float));
+        should(compressed.size() < plain.size());
+        
+        ArrayVector<float> decompressed(values.size());
+        uncompress(compressed.begin(), compressed.size(),
+                   (char *)decompressed.begin(), size, LZ4, sizeof(float));
+        shouldEqualSequence(values.begin(), values.end(), decompressed.begin());
+    }
+    
     void testNoCompression()
     {
         ArrayVector<char> compressed;
@@ -1263,6 +1326,166 @@ struct CompressionTest
     }
 };
 
+struct ThreadPoolTest
+{
+    void testParallelForeach()
+    {
+        int n = 10000;
+        std::vector<int> v(n);
+        linearSequence(v.begin(), v.end(), 1);
+
+        ThreadPool pool(4);
+        shouldEqual(pool.nThreads(), 4u);
+
+        std::vector<long> sums(pool.nThreads(), 0);
+        parallel_foreach(pool, v.begin(), v.end(),
+            [&sums](int threadIndex, int x)
+            {
+                sums[threadIndex] += x;
+            });
+        shouldEqual(std::accumulate(sums.begin(), sums.end(), 0l), (long)n*(n+1)/2);
+
+        std::vector<int> squares(n, 0);
+        parallel_foreach(pool, n,
+            [&squares](int, std::ptrdiff_t i)
+            {
+                squares[i] = (int)(i*i);
+            });
+        for(int k = 0; k < n; ++k)
+            shouldEqual(squares[k], k*k);
+
+        // only the calling thread is used when there are no workers
+        std::set<threading::thread::id> threadIds;
+        parallel_foreach(ParallelOptions::NoThreads, v.begin(), v.end(),
+            [&threadIds](int threadIndex, int)
+            {
+                shouldEqual(threadIndex, 0);
+                threadIds.insert(threading::this_thread::get_id());
+            });
+        shouldEqual(threadIds.size(), 1u);
+        should(*threadIds.begin() == threading::this_thread::get_id());
+    }
+
+    void testNested()
+    {
+        ThreadPool pool(3);
+        std::vector<threading::atomic_long> counts(100);
+        for(std::size_t k = 0; k < counts.size(); ++k)
+            counts[k] = 0;
+
+        parallel_foreach(pool, 10,
+            [&pool, &counts](int, std::ptrdiff_t)
+            {
+                parallel_foreach(pool, counts.size(),
+                    [&counts](int, std::ptrdiff_t i)
+                    {
+                        counts[i].fetch_add(1);
+                    });
+            });
+        for(std::size_t k = 0; k < counts.size(); ++k)
+            shouldEqual(counts[k].load(), 10);
+    }
+
+    void testException()
+    {
+        ThreadPool pool(4);
+        std::vector<int> v(1000, 0);
+        try
+        {
+            parallel_foreach(pool, v.begin(), v.end(),
+                [](int, int)
+                {
+                    throw std::runtime_error("test exception");
+                });
+            failTest("parallel_foreach() did not rethrow the exception.");
+        }
+        catch(std::runtime_error & e)
+        {
+            shouldEqual(std::string(e.what()), std::string("test exception"));
+        }
+
+        // the pool is still usable afterwards
+        threading::atomic_long count(0);
+        parallel_foreach(pool, v.begin(), v.end(),
+            [&count](int, int)
+            {
+                count.fetch_add(1);
+            });
+        shouldEqual(count.load(), 1000);
+    }
+
+    void testExceptionWaitsForAllChunks()
+    {
+        // the first chunk fails at once, while the others are still busy:
+        // parallel_foreach() must not return before they are done, because
+        // they refer to the functor and counters on the caller's stack
+        ThreadPool pool(2);
+        threading::atomic_long running(0), finished(0);
+        try
+        {
+            parallel_foreach(pool, 16,
+                [&running, &finished](int, std::ptrdiff_t k)
+                {
+                    if(k == 0)
+                        throw std::runtime_error("test exception");
+                    running.fetch_add(1);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                    finished.fetch_add(1);
+                    running.fetch_sub(1);
+                });
+            failTest("parallel_foreach() did not rethrow the exception.");
+        }
+        catch(std::runtime_error & e)
+        {
+            shouldEqual(std::string(e.what()), std::string("test exception"));
+        }
+        shouldEqual(running.load(), 0);
+        should(finished.load() > 0);
+
+        // likewise with a temporary pool
+        finished.store(0);
+        try
+        {
+            parallel_foreach(3, 16,
+                [&finished](int, std::ptrdiff_t k)
+                {
+                    if(k == 0)
+                        throw std::runtime_error("test exception");
+                    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                    finished.fetch_add(1);
+                });
+            failTest("parallel_foreach() did not rethrow the exception.");
+        }
+        catch(std::runtime_error &)
+        {}
+        should(finished.load() > 0);
+    }
+
+    void testEnqueue()
+    {
+        ThreadPool pool(ParallelOptions().numThreads(2));
+
+        threading::future<int> f = pool.enqueueReturning([](int) { return 42; });
+        shouldEqual(f.get(), 42);
+
+        threading::atomic_long count(0);
+        for(int k = 0; k < 100; ++k)
+            pool.enqueue([&count](int threadIndex)
+                         {
+                             should(threadIndex >= 0 && threadIndex < 2);
+                             count.fetch_add(1);
+                         });
+        pool.waitFinished();
+        shouldEqual(count.load(), 100);
+        shouldEqual(pool.currentThreadIndex(), -1);
+
+        ParallelOptions options;
+        should(options.getNumThreads() >= 1);
+        shouldEqual(options.numThreads(ParallelOptions::NoThreads).getNumThreads(), 0);
+        shouldEqual(options.getActualNumThreads(), 1);
+    }
+};
+
 struct UtilitiesTestSuite
 : public vigra::test_suite
 {
@@ -1286,7 +1509,14 @@ struct UtilitiesTestSuite
         add( testCase( &stringTest));
         add( testCase( &CompressionTest::testZLIB));
         add( testCase( &CompressionTest::testLZ4));
+        add( testCase( &CompressionTest::testZSTD));
+        add( testCase( &CompressionTest::testShuffle));
         add( testCase( &CompressionTest::testNoCompression));
+        add( testCase( &ThreadPoolTest::testParallelForeach));
+        add( testCase( &ThreadPoolTest::testNested));
+        add( testCase( &ThreadPoolTest::testException));
+        add( testCase( &ThreadPoolTest::testExceptionWaitsForAllChunks));
+        add( testCase( &ThreadPoolTest::testEnqueue));
     }
 };
 
@@ -669,6 +669,17 @@ void defineChunkedArrayImpl()
         .add_property("cache_max_size", 
              &Array::cacheMaxSize, &Array::setCacheMaxSize,
              "\nget/set the size of the chunk cache.\n")
+        .add_property("cache_max_bytes", 
+             &Array::cacheMaxBytes, &Array::setCacheMaxBytes,
+             "\nget/set the memory limit of the chunk cache in bytes (0: unlimited).\n")
+        .add_property("cache_bytes", &Array::cacheBytes,
+             "\nmemory currently occupied by the chunk cache.\n")
+        .add_property("cache_hits", &Array::cacheHits,
+             "\nnumber of chunk accesses that found the chunk in memory.\n")
+        .add_property("cache_misses", &Array::cacheMisses,
+             "\nnumber of chunk accesses that had to load the chunk.\n")
+        .add_property("cache_evictions", &Array::cacheEvictions,
+             "\nnumber of chunks unloaded by the cache policy.\n")
         .add_property("dtype", &ChunkedArray_dtype<N, T>, 
              "\nthe array's value type\n")
         .add_property("ndim", &ChunkedArray_ndim<N, T>, 
@@ -741,12 +752,18 @@ void defineChunkedArray()
          "   ``Compression.ZLIB_NONE:``\n      ZLIB no compression (level = 0)\n"
          "   ``Compression.ZLIB_FAST:``\n      ZLIB fast compression (level = 1)\n"
          "   ``Compression.ZLIB_BEST:``\n      ZLIB best compression (level = 9)\n"
-         "   ``Compression.LZ4:``\n      LZ4 compression (very fast)\n\n")
+         "   ``Compression.LZ4:``\n      LZ4 compression (very fast)\n"
+         "   ``Compression.ZSTD_FAST:``\n      Zstandard fast compression (level = 1)\n"
+         "   ``Compression.ZSTD:``\n      Zstandard default compression (level = 3)\n"
+         "   ``Compression.ZSTD_BEST:``\n      Zstandard high compression (level = 19)\n\n")
         .value("ZLIB", vigra::ZLIB)
         .value("ZLIB_NONE", vigra::ZLIB_NONE)
         .value("ZLIB_FAST", vigra::ZLIB_FAST)
         .value("ZLIB_BEST", vigra::ZLIB_BEST)
         .value("LZ4", vigra::LZ4)
+        .value("ZSTD_FAST", vigra::ZSTD_FAST)
+        .value("ZSTD", vigra::ZSTD)
+        .value("ZSTD_BEST", vigra::ZSTD_BEST)
     ;
 
 #ifdef HasHDF5
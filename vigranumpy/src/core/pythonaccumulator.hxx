@@ -44,6 +44,7 @@
 #include <vigra/numpy_array_converters.hxx>
 #include <vigra/accumulator.hxx>
 #include <vigra/timing.hxx>
+#include <algorithm>
 #include <map>
 
 namespace python = boost::python;
@@ -117,6 +118,59 @@ struct GetTag_Visitor
 struct GetArrayTag_Visitor
 : public GetTag_Visitor
 {
+    struct IdentityPermutation;
+    
+        // move entry j along axis M of 'res' to position p(j) by swapping
+        // the corresponding slices along the cycles of the permutation
+    template <unsigned int M, unsigned int N, class T, class Permutation>
+    static void permuteAxis(NumpyArray<N, T> & res, Permutation const & p)
+    {
+        ArrayVector<bool> done(res.shape(M), false);
+        for(int j=0; j<res.shape(M); ++j)
+        {
+            if(done[j])
+                continue;
+            done[j] = true;
+            for(int i=p(j); i != j; i=p(i))
+            {
+                MultiArrayView<N-1, T, StridedArrayTag> sj = res.template bind<M>(j),
+                                                        si = res.template bind<M>(i);
+                std::swap_ranges(sj.begin(), sj.end(), si.begin());
+                done[i] = true;
+            }
+        }
+    }
+    
+        // export the results of all regions as rows of 'res',
+        // and reorder the columns according to the permutation
+    template <class TAG, class Accu, class T, class Permutation>
+    static void permutedExport(Accu & a, NumpyArray<2, T> & res, Permutation const & p)
+    {
+        getAll<TAG>(a, res);
+        permuteAxis<1>(res, p);
+    }
+    
+        // same for matrix results, whose rows and columns are both reordered
+    template <class TAG, class Accu, class T, class Permutation>
+    static void permutedExport(Accu & a, NumpyArray<3, T> & res, Permutation const & p)
+    {
+        getAll<TAG>(a, res);
+        permuteAxis<1>(res, p);
+        permuteAxis<2>(res, p);
+    }
+    
+    template <class TAG, class Accu, class T>
+    static void permutedExport(Accu & a, NumpyArray<2, T> & res, IdentityPermutation const &)
+    {
+        getAll<TAG>(a, res);
+    }
+    
+    template <class TAG, class Accu, class T>
+    static void permutedExport(Accu & a, NumpyArray<3, T> & res, IdentityPermutation const &)
+    {
+        getAll<TAG>(a, res);
+    }
+    
     template <class TAG, class T, class Accu>
     struct ToPythonArray
     {
@@ -127,8 +181,7 @@ struct GetArrayTag_Visitor
             Shape1 s(n);
             NumpyArray<1, T> res(s);
             
-            for(unsigned int k=0; k<n; ++k)
-                res(k) = get<TAG>(a, k);
+            getAll<TAG>(a, res);
             return python::object(res);
         }
     };
@@ -143,9 +196,7 @@ struct GetArrayTag_Visitor
             Shape2 s(n, N);
             NumpyArray<2, T> res(s);
             
-            for(unsigned int k=0; k<n; ++k)
-                for(int j=0; j<N; ++j)
-                    res(k, p(j)) = get<TAG>(a, k)[j];
+            permutedExport<TAG>(a, res, p);
             return python::object(res);
         }
     };
@@ -161,9 +212,7 @@ struct GetArrayTag_Visitor
             Shape2 s(n, N);
             NumpyArray<2, T> res(s);
             
-            for(unsigned int k=0; k<n; ++k)
-                for(int j=0; j<N; ++j)
-                    res(k, p(j)) = get<TAG>(a, k)[j];
+            permutedExport<TAG>(a, res, p);
             return python::object(res);
         }
     };
@@ -179,10 +228,7 @@ struct GetArrayTag_Visitor
             Shape3 s(n, m[0], m[1]);
             NumpyArray<3, T> res(s);
             
-            for(unsigned int k=0; k<n; ++k)
-                for(int i=0; i<m[0]; ++i)
-                    for(int j=0; j<m[1]; ++j)
-                        res(k, p(i), p(j)) = get<TAG>(a, k)(i, j);
+            permutedExport<TAG>(a, res, p);
             return python::object(res);
         }
     };